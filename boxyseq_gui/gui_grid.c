@@ -485,8 +485,5 @@ void gui_grid_order_boundary(gui_grid* ggr, int dir)
     if (!ggr->action_grb)
         return;
 
-    grbound_manager* grbman;
-    grbman = boxyseq_grbound_manager(ggr->bs);
-    grbound_manager_grbound_order(grbman, ggr->action_grb, dir);
-    grbound_manager_update_rt_data(grbman);
+    boxyseq_ui_grbound_order(ggr->bs, ggr->action_grb, dir);
 }
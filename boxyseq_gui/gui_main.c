@@ -4,6 +4,7 @@
 #include "debug.h"
 #include "gui_grid.h"
 #include "grid_boundary.h"
+#include "real_time_data.h"
 
 #include "include/gui_main_editor.h"
 
@@ -56,7 +57,17 @@ static gboolean idle_update_position(jackdata* jd)
 
 static gboolean gui_boxyseq_update(boxyseq* bs)
 {
+    int g;
+
     boxyseq_ui_collect_events(bs);
+    cytiming_ui_update(boxyseq_cycle_timing(bs));
+    debug_log_drain(0);
+    jrnl_ui_drain(boxyseq_journal(bs));
+    rtdata_ui_reclaim();
+
+    for (g = 0; g < boxyseq_grid_count(bs); ++g)
+        grid_ui_stats_update(boxyseq_grid(bs, g));
+
     return TRUE;
 }
 
@@ -129,6 +140,19 @@ static gboolean gui_key_press_event(GtkWidget *widget,
         gui_grid_boundary_event_toggle_process(_gui->ggr);
         break;
 
+    case GDK_KEY_s:
+        cytiming_stats_dump(cytiming_ui_stats(
+                                boxyseq_cycle_timing(_gui->bs)));
+        break;
+
+    case GDK_KEY_S:
+        cytiming_ui_reset(boxyseq_cycle_timing(_gui->bs));
+        break;
+
+    case GDK_KEY_f:
+        boxyseq_ui_stats_dump(_gui->bs);
+        break;
+
     case GDK_Up:
     case GDK_KP_Up:
         gui_grid_direction(_gui->ggr, UP);
@@ -3,11 +3,16 @@
 #include "gui_main.h"
 #include "jack_process.h"
 #include "musical_scale.h"
+#include "offline_render.h"
 
 
 #include <stdlib.h>
 #include <unistd.h>
 
+
+#define RENDER_FRAME_RATE   48000
+#define RENDER_NFRAMES      1024
+
 pattern*    new_pat(pattern_manager* patman,
                     int ch,
                     int steps,
@@ -65,11 +70,12 @@ pattern*    new_pat(pattern_manager* patman,
 }
 
 
-int main(int argc, char** argv)
+/*  builds the demo session: four patterns on two pattern ports, a midi
+    out port for each grid, and a boundary or more within each grid,
+    all drawn from the session seed. returns the first pattern.
+*/
+static pattern* demo_session(boxyseq* bs, const jrnlsession* session)
 {
-    boxyseq*    bs;
-    jackdata*   jd;
-
     pattern_manager*    patman;
     grbound_manager*    grbman;
     moport_manager*     mopman;
@@ -83,27 +89,13 @@ int main(int argc, char** argv)
     pattern*    pat2 = 0;
     pattern*    pat3 = 0;
     grbound*    grb;
-    moport*     mop1;
+    moport*     mop[BOXYSEQ_MAX_GRIDS];
     evport*     patport1;
     evport*     patport2;
 
+    int grids = session->grids;
     int i;
 
-    double r, g, b;
-
-    _Bool err = -1;
-
-    if (!(bs = boxyseq_new(argc, argv)))
-        exit(err);
-
-    if (!(jd = jackdata_new()))
-        goto quit;
-
-    if (!jackdata_startup(jd, bs))
-        goto quit;
-
-/*    boxyseq_ui_place_static_block(bs, 32, 32, 64, 64);*/
-
     patman = boxyseq_pattern_manager(bs);
     grbman = boxyseq_grbound_manager(bs);
     mopman = boxyseq_moport_manager(bs);
@@ -123,28 +115,36 @@ int main(int argc, char** argv)
 
 
     patport1 = evport_manager_evport_new(patportman, "patport1",
-                                                    RT_EVLIST_SORT_POS);
+                                                    RT_EVLIST_SORT_POS
+                                                    | RT_EVLIST_HEAP);
 
     patport2 = evport_manager_evport_new(patportman, "patport2",
-                                                    RT_EVLIST_SORT_POS);
+                                                    RT_EVLIST_SORT_POS
+                                                    | RT_EVLIST_HEAP);
 
     pat0 = new_pat(patman, 0,   16, 8, 0.0,     2, 1.25, 8.75,  8,9,2,3);
     pattern_set_output_port(pat0, patport1);
+    pattern_set_random_seed(pat0, session->seed);
     pattern_update_rt_data(pat0);
 
     pat1 = new_pat(patman, 0,   16, 8, 8.0,     2, 1.25, 8.75,  2,3,8,9);
     pattern_set_output_port(pat1, patport2);
+    pattern_set_random_seed(pat1, session->seed);
     pattern_update_rt_data(pat1);
 
     pat2 = new_pat(patman, 1,   8, 4, 0.0,      2, 3.5, 5.5,    4,5,12,13);
     pattern_set_output_port(pat2, patport1);
+    pattern_set_random_seed(pat2, session->seed);
     pattern_update_rt_data(pat2);
 
     pat3 = new_pat(patman, 1,   8, 4, 4.0,      2, 3.5, 5.5,    12,13,4,5);
     pattern_set_output_port(pat3, patport2);
+    pattern_set_random_seed(pat3, session->seed);
     pattern_update_rt_data(pat3);
 
-    mop1 = moport_manager_moport_new(mopman);
+    /* a midi out port for each grid lets the grids run in parallel */
+    for (i = 0; i < grids; ++i)
+        mop[i] = moport_manager_moport_new(mopman);
 
     scales = sclist_new();
 
@@ -156,9 +156,9 @@ int main(int argc, char** argv)
     int keyint = note_number("C#");
 
 
-    srand(time(0));
+    srand(session->seed);
 
-    for (i = 0; i < 2; ++i)
+    for (i = 0; i < (grids > 2 ? grids : 2); ++i)
     {
         int x, y, w, h;
 
@@ -175,9 +175,10 @@ int main(int argc, char** argv)
 
         grb = grbound_manager_grbound_new(grbman);
         grbound_fsbound_set(grb, x, y, w, h);
-        grbound_set_input_port(grb, i == 0 ? patport1 : patport2);
+        grbound_set_input_port(grb, (i & 1) ? patport2 : patport1);
 
-        grbound_midi_out_port_set(grb, mop1);
+        grbound_grid_set(grb, i % grids);
+        grbound_midi_out_port_set(grb, mop[i % grids]);
 
         grbound_scale_binary_set(grb, scint);
         grbound_scale_key_set(grb, keyint);
@@ -192,38 +193,169 @@ int main(int argc, char** argv)
     moport_manager_update_rt_data(mopman);
     evport_manager_update_rt_data(patportman);
 
+    sclist_free(scales);
 
-/*******************************************
- *******************************************
- *******************************************
- *******************************************
- *******************************************
- \/\/\/\/\/\/\/\/\/\/\/\/\/\/\/\/\/\/\/\/\/*/
-
-#ifdef NO_REAL_TIME
-st = 128;
-t = 0;
-_Bool repositioned = 1;
+    return pat0;
+}
 
-bbt_t looplen = pattern_loop_length(pat1);
 
-for (i = 0; i <  looplen * 1; i += st)
+int main(int argc, char** argv)
 {
-    if ((i % looplen ) < st)
-        MESSAGE("-----------ph:%d nph:%d looplen:%d\n",
-                i, i + st, looplen );
+    boxyseq*    bs;
+    jackdata*   jd = 0;
+    offrender*  rdr = 0;
 
-    boxyseq_rt_play(bs, st, repositioned, i,   i + st);
-    repositioned = 0;
-}
-#endif
+    const char* render_file = 0;
+    int         render_bars = 16;
+    int         grids = 1;
+    int         opt;
+
+    const char* journal_file = 0;
+    const char* replay_file = 0;
+    jrnl*       journal = 0;
+    jrnl*       replay = 0;
+    jrnlsession session = { .seed = time(0), .grids = 1 };
+
+    pattern*    pat0 = 0;
+
+    int i;
+
+    _Bool err = -1;
+
+    while ((opt = getopt(argc, argv, "o:b:g:s:j:r:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'o':
+            render_file = optarg;
+            break;
+
+        case 'b':
+            render_bars = atoi(optarg);
+            break;
+
+        case 'g':
+            grids = atoi(optarg);
+            break;
+
+        case 's':
+            session.seed = strtoul(optarg, 0, 0);
+            break;
+
+        case 'j':
+            journal_file = optarg;
+            break;
+
+        case 'r':
+            replay_file = optarg;
+            break;
+
+        default:
+            fprintf(stderr, "usage: %s [-g grids] [-s seed] "
+                            "[-j journal.bsj] "
+                            "[-o render.mid [-b bars | -r journal.bsj]]\n",
+                            argv[0]);
+            exit(err);
+        }
+    }
 
-/*/\/\/\/\/\/\/\/\/\/\/\/\/\/\/\/\/\/\/\/\/\
- *******************************************
- *******************************************
- *******************************************
- *******************************************
- *******************************************/
+    if (replay_file)
+    {
+        if (!render_file)
+        {
+            fprintf(stderr, "replaying a journal needs -o render.mid\n");
+            exit(err);
+        }
+
+        /* the grids are made as they were, the rest is journaled */
+        if (!(replay = jrnl_load(replay_file)))
+            exit(err);
+
+        session = *jrnl_session(replay);
+        grids = session.grids;
+    }
+
+    session.grids = grids;
+
+    if (grids < 1 || grids > BOXYSEQ_MAX_GRIDS)
+    {
+        fprintf(stderr, "grids must be from 1 to %d\n", BOXYSEQ_MAX_GRIDS);
+        exit(err);
+    }
+
+    if (!(bs = boxyseq_new(argc, argv)))
+        exit(err);
+
+    for (i = 1; i < grids; ++i)
+        if (boxyseq_grid_new(bs, FSWIDTH, FSHEIGHT) == -1)
+            goto quit;
+
+    if (journal_file)
+    {
+        if (!(journal = jrnl_new(journal_file, &session)))
+            goto quit;
+
+        boxyseq_set_journal(bs, journal);
+    }
+
+    if (render_file)
+    {
+        if (!(rdr = offrender_new(bs, RENDER_FRAME_RATE, RENDER_NFRAMES)))
+            goto quit;
+    }
+    else
+    {
+        if (!(jd = jackdata_new()))
+            goto quit;
+
+        if (!jackdata_startup(jd, bs))
+            goto quit;
+    }
+
+/*    boxyseq_ui_place_static_block(bs, 0, 32, 32, 64, 64);*/
+
+    /*  the RT thread sees the session once it is complete. a replay
+        builds the session from the journal.
+    */
+    if (!replay)
+    {
+        rtdata_ui_scene_begin();
+        pat0 = demo_session(bs, &session);
+        rtdata_ui_scene_commit();
+    }
+
+
+    if (render_file)
+    {
+        if (replay)
+        {
+            if (offrender_replay(rdr, replay)
+             && offrender_write_smf(rdr, render_file))
+            {
+                MESSAGE("replayed '%s', %lu midi events to '%s'\n",
+                        replay_file,
+                        (unsigned long)offrender_event_count(rdr),
+                        render_file);
+                err = 0;
+            }
+        }
+        else if (offrender_run(rdr, render_bars * pattern_loop_length(pat0))
+              && offrender_stop(rdr)
+              && offrender_write_smf(rdr, render_file))
+        {
+            MESSAGE("rendered %d bars, %lu midi events to '%s'\n",
+                    render_bars,
+                    (unsigned long)offrender_event_count(rdr),
+                    render_file);
+            err = 0;
+        }
+
+        cytiming_stats_dump(cytiming_ui_stats(boxyseq_cycle_timing(bs)));
+        boxyseq_ui_stats_dump(bs);
+
+        offrender_free(rdr);
+        goto quit;
+    }
 
 
 printf("-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=\n");
@@ -232,16 +364,22 @@ printf("-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=\n");
         goto quit;
 #endif
 
-    sclist_free(scales);
 
     boxyseq_shutdown(bs);
 
     jackdata_shutdown(jd);
 
+    /* whatever the process thread logged since the last drain */
+    debug_log_drain(0);
+
     jackdata_free(jd);
 
 quit:
 
+    boxyseq_set_journal(bs, 0);
+    jrnl_free(journal);
+    jrnl_free(replay);
+
     boxyseq_free(bs);
 
     if (err)
@@ -0,0 +1,479 @@
+#include "freespace_state.h"
+#include "basebox.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/*  freespace_bench
+ *-------------------
+ *  times the freespace operations under seeded workloads and prints the
+ *  results as JSON. the same seed generates the same workload on every
+ *  build, so that runs can be compared across changes and across the
+ *  freespace word width backends (one freespace_bench_N per width).
+ *
+ *  usage: freespace_bench_N [seed [ticks [workload]]]
+ *
+ *  each workload runs for a number of ticks. in each tick the areas whose
+ *  release has come are returned to the freespace with freespace_add (or
+ *  freespace_block_add) and new ones are placed. each operation is timed
+ *  individually with the monotonic clock, so the times include the cost
+ *  of reading it (a few tens of ns).
+ */
+
+
+#if defined(USE_64BIT_ARRAY)
+    #define BACKEND "64 bit"
+#elif defined(USE_32BIT_ARRAY)
+    #define BACKEND "32 bit"
+#elif defined(USE_16BIT_ARRAY)
+    #define BACKEND "16 bit"
+#elif defined(USE_8BIT_ARRAY)
+    #define BACKEND "8 bit"
+#else
+    #define BACKEND "1 bit"
+#endif
+
+
+#define DEFAULT_TICKS   100000
+#define MAX_LIVE        4096
+#define MAX_CHORD       6
+#define MAX_BLOCKS      24
+
+
+enum OPS
+{
+    OP_FIND,
+    OP_FIND_MANY,
+    OP_REMOVE,
+    OP_ADD,
+    OP_BLOCK_REMOVE,
+    OP_BLOCK_ADD,
+    OP_COUNT
+};
+
+
+static const char* op_names[OP_COUNT] =
+{
+    "find",
+    "find_many",
+    "remove",
+    "add",
+    "block_remove",
+    "block_add"
+};
+
+
+typedef struct
+{
+    uint32_t*   ns;
+    size_t      count;
+    size_t      size;
+} timings;
+
+
+typedef struct
+{
+    int x, y, w, h;
+    long release;
+    int block;
+} live_area;
+
+
+typedef struct
+{
+    freespace*  fs;
+    uint32_t    rng;
+    long        tick;
+
+    live_area   live[MAX_LIVE];
+    int         nlive;
+    int         nblocks;
+
+    long        placed;
+    long        failed;
+
+    timings     ops[OP_COUNT];
+} bench;
+
+
+typedef struct
+{
+    const char* name;
+    void      (*step)(bench*);
+} workload;
+
+
+static uint32_t bench_rand(bench* b)
+{
+    /* xorshift32, so workloads don't depend upon the C library */
+    uint32_t r = b->rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    return b->rng = r;
+}
+
+
+/* a random number from lo to hi inclusive */
+static int bench_range(bench* b, int lo, int hi)
+{
+    return lo + (int)(bench_rand(b) % (uint32_t)(hi - lo + 1));
+}
+
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+
+static void timings_add(timings* t, uint64_t ns)
+{
+    if (t->count == t->size)
+    {
+        size_t size = t->size ? t->size * 2 : 4096;
+        uint32_t* p = realloc(t->ns, size * sizeof(*p));
+
+        if (!p)
+        {
+            fprintf(stderr, "out of memory for timings\n");
+            exit(EXIT_FAILURE);
+        }
+
+        t->ns = p;
+        t->size = size;
+    }
+
+    t->ns[t->count++] = (ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)ns;
+}
+
+
+#define TIMED( b, op, call )                                \
+    do {                                                    \
+        uint64_t t0 = now_ns();                             \
+        call;                                               \
+        timings_add(&(b)->ops[( op )], now_ns() - t0);      \
+    } while (0)
+
+
+static void live_push(bench* b, int x, int y, int w, int h,
+                                    long duration, int block)
+{
+    live_area* a;
+
+    if (b->nlive == MAX_LIVE)
+        return;
+
+    a = &b->live[b->nlive++];
+    a->x = x;
+    a->y = y;
+    a->w = w;
+    a->h = h;
+    a->release = b->tick + duration;
+    a->block = block;
+
+    if (block)
+        ++b->nblocks;
+}
+
+
+static void release_due(bench* b)
+{
+    int i = 0;
+
+    while (i < b->nlive)
+    {
+        live_area* a = &b->live[i];
+
+        if (a->release > b->tick)
+        {
+            ++i;
+            continue;
+        }
+
+        if (a->block)
+        {
+            TIMED(b, OP_BLOCK_ADD,
+                    freespace_block_add(b->fs, a->x, a->y, a->w, a->h));
+            --b->nblocks;
+        }
+        else
+        {
+            TIMED(b, OP_ADD,
+                    freespace_add(b->fs, a->x, a->y, a->w, a->h));
+        }
+
+        *a = b->live[--b->nlive];
+    }
+}
+
+
+static void random_boundary(bench* b, basebox* bound, int minw, int minh)
+{
+    bound->w = bench_range(b, minw, FSWIDTH);
+    bound->h = bench_range(b, minh, FSHEIGHT);
+    bound->x = bench_range(b, 0, FSWIDTH - bound->w);
+    bound->y = bench_range(b, 0, FSHEIGHT - bound->h);
+}
+
+
+/* finds and removes a single note box using the given placement flags */
+static void place_note(bench* b, int flags, int maxw, int maxh,
+                                    int mindur, int maxdur)
+{
+    basebox bound;
+    int w = bench_range(b, 1, maxw);
+    int h = bench_range(b, 1, maxh);
+    int x, y;
+    bool found;
+
+    random_boundary(b, &bound, w, h);
+
+    TIMED(b, OP_FIND,
+            found = freespace_find(b->fs, &bound, flags, w, h, &x, &y));
+
+    if (!found)
+    {
+        ++b->failed;
+        return;
+    }
+
+    TIMED(b, OP_REMOVE, freespace_remove(b->fs, x, y, w, h));
+    live_push(b, x, y, w, h, bench_range(b, mindur, maxdur), 0);
+    ++b->placed;
+}
+
+
+/*  random churn: a note box of up to 8 x 8 each tick, first-fit in any
+    direction, held for up to 64 ticks.
+*/
+static void step_churn(bench* b)
+{
+    place_note(b, bench_range(b, 0, 7), 8, 8, 1, 64);
+}
+
+
+/*  dense chords: every fourth tick three to six note boxes struck
+    together within one boundary, placed with freespace_find_many.
+*/
+static void step_chords(bench* b)
+{
+    basebox bound;
+    basebox areas[MAX_CHORD];
+    int count, i, placed;
+    int flags = bench_range(b, 0, 7);
+
+    if (b->tick % 4)
+        return;
+
+    count = bench_range(b, 3, MAX_CHORD);
+
+    for (i = 0; i < count; ++i)
+    {
+        areas[i].w = bench_range(b, 1, 6);
+        areas[i].h = bench_range(b, 1, 6);
+    }
+
+    random_boundary(b, &bound, 16, 16);
+
+    TIMED(b, OP_FIND_MANY,
+            placed = freespace_find_many(b->fs, &bound, flags,
+                                                    areas, count));
+
+    b->placed += placed;
+    b->failed += count - placed;
+
+    for (i = 0; i < count; ++i)
+    {
+        if (areas[i].x != -1)
+            live_push(b, areas[i].x, areas[i].y, areas[i].w, areas[i].h,
+                                            bench_range(b, 16, 128), 0);
+    }
+}
+
+
+/*  long-release blocks: up to MAX_BLOCKS block-areas of 8 x 8 to
+    32 x 32, overlapping anything, held for thousands of ticks while
+    note boxes churn around them.
+*/
+static void step_blocks(bench* b)
+{
+    if (b->nblocks < MAX_BLOCKS && bench_range(b, 0, 63) == 0)
+    {
+        int w = bench_range(b, 8, 32);
+        int h = bench_range(b, 8, 32);
+        int x = bench_range(b, 0, FSWIDTH - w);
+        int y = bench_range(b, 0, FSHEIGHT - h);
+
+        TIMED(b, OP_BLOCK_REMOVE,
+                freespace_block_remove(b->fs, x, y, w, h));
+        live_push(b, x, y, w, h, bench_range(b, 2000, 8000), 1);
+    }
+
+    place_note(b, bench_range(b, 0, 7), 8, 8, 1, 64);
+}
+
+
+/*  mixed placement flags: churn using every direction and placement
+    strategy, with a random target for FSPLACE_NEAREST.
+*/
+static void step_mixed(bench* b)
+{
+    int flags = bench_range(b, 0, 7)
+              | (bench_range(b, 0, 3) * FSPLACE_NEAREST);
+
+    if ((flags & FSPLACE_STRATEGY_MASK) == FSPLACE_NEAREST)
+        freespace_target_set(b->fs, bench_range(b, 0, FSWIDTH - 1),
+                                    bench_range(b, 0, FSHEIGHT - 1));
+
+    place_note(b, flags, 8, 8, 1, 64);
+}
+
+
+static const workload workloads[] =
+{
+    { "churn",  step_churn  },
+    { "chords", step_chords },
+    { "blocks", step_blocks },
+    { "mixed",  step_mixed  },
+    { 0, 0 }
+};
+
+
+static int cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+
+static uint32_t percentile(const timings* t, double p)
+{
+    size_t i = (size_t)(p * (double)(t->count - 1) + 0.5);
+    return t->ns[i];
+}
+
+
+static void print_ops(bench* b)
+{
+    int op;
+    int first = 1;
+    uint64_t all_ns = 0;
+    size_t all_count = 0;
+
+    printf("      \"ops\": {");
+
+    for (op = 0; op < OP_COUNT; ++op)
+    {
+        timings* t = &b->ops[op];
+        uint64_t total = 0;
+        size_t i;
+
+        if (!t->count)
+            continue;
+
+        for (i = 0; i < t->count; ++i)
+            total += t->ns[i];
+
+        all_ns += total;
+        all_count += t->count;
+
+        qsort(t->ns, t->count, sizeof(*t->ns), cmp_u32);
+
+        printf("%s\n        \"%s\": { \"count\": %zu, \"mean_ns\": %.1f, "
+               "\"p50_ns\": %u, \"p90_ns\": %u, \"p99_ns\": %u, "
+               "\"p999_ns\": %u, \"max_ns\": %u, \"ops_per_sec\": %.0f }",
+                first ? "" : ",",
+                op_names[op], t->count, (double)total / t->count,
+                percentile(t, 0.5), percentile(t, 0.9),
+                percentile(t, 0.99), percentile(t, 0.999),
+                t->ns[t->count - 1],
+                total ? t->count * 1e9 / total : 0.0);
+
+        first = 0;
+    }
+
+    printf("\n      },\n      \"total_ops\": %zu,\n"
+           "      \"ops_per_sec\": %.0f\n",
+                all_count, all_ns ? all_count * 1e9 / all_ns : 0.0);
+}
+
+
+static void run(const workload* wl, uint32_t seed, long ticks, int first)
+{
+    bench* b = calloc(1, sizeof(*b));
+    int op;
+
+    if (!b || !(b->fs = freespace_new()))
+    {
+        fprintf(stderr, "failed to create freespace\n");
+        exit(EXIT_FAILURE);
+    }
+
+    b->rng = seed ? seed : 1;
+    freespace_seed(b->fs, b->rng);
+
+    for (b->tick = 0; b->tick < ticks; ++b->tick)
+    {
+        release_due(b);
+        wl->step(b);
+    }
+
+    printf("%s    {\n      \"name\": \"%s\",\n"
+           "      \"placed\": %ld,\n      \"failed\": %ld,\n",
+                first ? "" : ",\n", wl->name, b->placed, b->failed);
+
+    print_ops(b);
+    printf("    }");
+
+    for (op = 0; op < OP_COUNT; ++op)
+        free(b->ops[op].ns);
+
+    freespace_free(b->fs);
+    free(b);
+}
+
+
+int main(int argc, char** argv)
+{
+    uint32_t seed = (argc > 1) ? (uint32_t)strtoul(argv[1], 0, 10) : 1;
+    long ticks = (argc > 2) ? strtol(argv[2], 0, 10) : DEFAULT_TICKS;
+    const char* only = (argc > 3) ? argv[3] : 0;
+    const workload* wl;
+    int first = 1;
+
+    if (ticks < 1)
+    {
+        fprintf(stderr, "usage: %s [seed [ticks [workload]]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("{\n  \"backend\": \"%s\",\n  \"seed\": %u,\n  \"ticks\": %ld,\n"
+           "  \"workloads\": [\n", BACKEND, seed, ticks);
+
+    for (wl = workloads; wl->name; ++wl)
+    {
+        if (only && strcmp(only, wl->name))
+            continue;
+
+        run(wl, seed, ticks, first);
+        first = 0;
+    }
+
+    printf("\n  ]\n}\n");
+
+    if (first && only)
+    {
+        fprintf(stderr, "unknown workload: %s\n", only);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
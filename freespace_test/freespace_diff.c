@@ -0,0 +1,662 @@
+#include "freespace_diff.h"
+
+#include "freespace_ref.h"
+#include "freespace_state.h"
+#include "basebox.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define DIFF_ROUND_OPS  2000    /* operations between each fresh grid */
+#define DIFF_CHECK_OPS  256     /* operations between checking every cell */
+#define DIFF_MANY       6       /* most areas in a find_many */
+
+
+enum DIFF_OPS
+{
+    DIFF_FIND,
+    DIFF_FIND_MANY,
+    DIFF_REMOVE,
+    DIFF_ADD,
+    DIFF_BLOCK_REMOVE,
+    DIFF_BLOCK_ADD,
+    DIFF_TEST,
+    DIFF_CHECK
+};
+
+
+typedef struct
+{
+    int type;
+    int flags;
+    int tx, ty;             /* find target */
+    basebox bound;          /* find boundary */
+    int x, y, w, h;         /* area, or find size */
+    int count;              /* find_many */
+    int aw[DIFF_MANY];
+    int ah[DIFF_MANY];
+} diff_op;
+
+
+typedef struct
+{
+    uint32_t rng;
+    int width;
+    int height;
+
+    diff_op ops[DIFF_ROUND_OPS];
+    int nops;
+} diff_round;
+
+
+static uint32_t diff_rand(uint32_t* rng)
+{
+    uint32_t r = *rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    return *rng = r;
+}
+
+
+static int diff_range(uint32_t* rng, int lo, int hi)
+{
+    return lo + (int)(diff_rand(rng) % (uint32_t)(hi - lo + 1));
+}
+
+
+/*  the boundary clipped to the grid, and the target freespace_find uses
+    for FSPLACE_NEAREST within it.
+*/
+static void diff_target(freespace* fs, const diff_op* op,
+                                int width, int height,
+                                basebox* clipped, int* tx, int* ty)
+{
+    *clipped = op->bound;
+
+    if (clipped->x + clipped->w > freespace_width(fs))
+        clipped->w = freespace_width(fs) - clipped->x;
+
+    if (clipped->y + clipped->h > freespace_height(fs))
+        clipped->h = freespace_height(fs) - clipped->y;
+
+    *tx = (op->tx >= 0) ? op->tx
+        : (op->flags & FSPLACE_LEFT_TO_RIGHT)
+            ? clipped->x : clipped->x + clipped->w - width;
+
+    *ty = (op->ty >= 0) ? op->ty
+        : (op->flags & FSPLACE_TOP_TO_BOTTOM)
+            ? clipped->y : clipped->y + clipped->h - height;
+}
+
+
+/*  checks the result of the freespace finding an area against the
+    reference. returns true, having described why when report is set,
+    if they diverge.
+*/
+static bool diff_found(freespace* fs, fsref* ref, const diff_op* op,
+                                int width, int height,
+                                bool found, int x, int y, bool report)
+{
+    basebox clipped;
+    int rx, ry, tx, ty;
+    bool rfound = fsref_find(ref, &op->bound, op->flags,
+                                        width, height, &rx, &ry);
+    const char* why = 0;
+
+    diff_target(fs, op, width, height, &clipped, &tx, &ty);
+
+    if (found != rfound)
+        why = found ? "found where the reference found nothing"
+                    : "found nothing where the reference did";
+    else if (!found)
+    {
+        if (x != -1 || y != -1)
+            why = "failed without setting the result to -1, -1";
+    }
+    else if (!fsref_fits(ref, &op->bound, x, y, width, height))
+        why = "found an area which is used or outside the boundary";
+    else
+    {
+        switch (op->flags & FSPLACE_STRATEGY_MASK)
+        {
+        case FSPLACE_FIRST_FIT:
+            if (x != rx || y != ry)
+                why = "first-fit found a different area";
+            break;
+
+        case FSPLACE_NEAREST:
+            if ((long)(x - tx) * (x - tx) + (long)(y - ty) * (y - ty)
+                    != fsref_nearest(ref, &clipped, width, height, tx, ty))
+                why = "nearest found an area further from the target";
+            break;
+
+        case FSPLACE_BEST_FIT:
+            if (fsref_gap(ref, &clipped, x, y, width, height)
+                    != fsref_best(ref, &clipped, op->flags, width, height))
+                why = "best-fit found an area with a larger gap";
+            break;
+        }
+    }
+
+    if (why && report)
+    {
+        printf("/* diverged: %s. freespace %d, %d (%s) "
+                                    "reference %d, %d */\n",
+                        why, x, y, found ? "found" : "not found", rx, ry);
+    }
+
+    return why != 0;
+}
+
+
+static void diff_print(const diff_op* op)
+{
+    int i;
+
+    switch (op->type)
+    {
+    case DIFF_FIND:
+    case DIFF_FIND_MANY:
+        printf("freespace_target_set(fs, %d, %d);\n", op->tx, op->ty);
+        printf("box_set_coords(&box, %d, %d, %d, %d);\n",
+                op->bound.x, op->bound.y, op->bound.w, op->bound.h);
+
+        if (op->type == DIFF_FIND)
+        {
+            printf("freespace_find(fs, &box, 0x%04x, %d, %d, &x, &y);\n",
+                                        op->flags, op->w, op->h);
+            break;
+        }
+
+        for (i = 0; i < op->count; ++i)
+            printf("areas[%d].w = %d; areas[%d].h = %d;\n",
+                                    i, op->aw[i], i, op->ah[i]);
+
+        printf("freespace_find_many(fs, &box, 0x%04x, areas, %d);\n",
+                                        op->flags, op->count);
+        break;
+
+    case DIFF_REMOVE:
+        printf("freespace_remove(fs, %d, %d, %d, %d);\n",
+                                    op->x, op->y, op->w, op->h);
+        break;
+
+    case DIFF_ADD:
+        printf("freespace_add(fs, %d, %d, %d, %d);\n",
+                                    op->x, op->y, op->w, op->h);
+        break;
+
+    case DIFF_BLOCK_REMOVE:
+        printf("freespace_block_remove(fs, %d, %d, %d, %d);\n",
+                                    op->x, op->y, op->w, op->h);
+        break;
+
+    case DIFF_BLOCK_ADD:
+        printf("freespace_block_add(fs, %d, %d, %d, %d);\n",
+                                    op->x, op->y, op->w, op->h);
+        break;
+
+    case DIFF_TEST:
+        printf("freespace_test(fs, %d, %d, %d, %d);\n",
+                                    op->x, op->y, op->w, op->h);
+        break;
+
+    case DIFF_CHECK:
+        printf("/* every cell checked */\n");
+        break;
+    }
+}
+
+
+/*  performs the operation upon both. returns true if they diverge. */
+static bool diff_apply(freespace* fs, fsref* ref, const diff_op* op,
+                                                        bool report)
+{
+    basebox areas[DIFF_MANY];
+    int i, x, y;
+    bool found;
+
+    if (report)
+        diff_print(op);
+
+    switch (op->type)
+    {
+    case DIFF_FIND:
+        freespace_target_set(fs, op->tx, op->ty);
+        found = freespace_find(fs, (basebox*)&op->bound, op->flags,
+                                            op->w, op->h, &x, &y);
+        return diff_found(fs, ref, op, op->w, op->h, found, x, y, report);
+
+    case DIFF_FIND_MANY:
+        for (i = 0; i < op->count; ++i)
+        {
+            areas[i].w = op->aw[i];
+            areas[i].h = op->ah[i];
+        }
+
+        freespace_target_set(fs, op->tx, op->ty);
+        freespace_find_many(fs, (basebox*)&op->bound, op->flags,
+                                                areas, op->count);
+
+        /*  the areas found have been removed one by one, so each is
+            checked against the reference as it was at the time.
+        */
+        for (i = 0; i < op->count; ++i)
+        {
+            found = (areas[i].x != -1);
+
+            if (diff_found(fs, ref, op, op->aw[i], op->ah[i],
+                            found, areas[i].x, areas[i].y, report))
+            {
+                if (report)
+                    printf("/* for areas[%d] */\n", i);
+
+                return true;
+            }
+
+            if (found)
+                fsref_remove(ref, areas[i].x, areas[i].y,
+                                  areas[i].w, areas[i].h);
+        }
+        return false;
+
+    case DIFF_REMOVE:
+        freespace_remove(fs, op->x, op->y, op->w, op->h);
+        fsref_remove(ref, op->x, op->y, op->w, op->h);
+        return false;
+
+    case DIFF_ADD:
+        freespace_add(fs, op->x, op->y, op->w, op->h);
+        fsref_add(ref, op->x, op->y, op->w, op->h);
+        return false;
+
+    case DIFF_BLOCK_REMOVE:
+        freespace_block_remove(fs, op->x, op->y, op->w, op->h);
+        fsref_remove(ref, op->x, op->y, op->w, op->h);
+        return false;
+
+    case DIFF_BLOCK_ADD:
+        freespace_block_add(fs, op->x, op->y, op->w, op->h);
+        fsref_add(ref, op->x, op->y, op->w, op->h);
+        return false;
+
+    case DIFF_TEST:
+        if (freespace_test(fs, op->x, op->y, op->w, op->h)
+         != fsref_test(ref, op->x, op->y, op->w, op->h))
+        {
+            if (report)
+                printf("/* diverged: freespace_test differs */\n");
+            return true;
+        }
+        return false;
+
+    case DIFF_CHECK:
+        for (y = 0; y < FSHEIGHT; ++y)
+        {
+            for (x = 0; x < FSWIDTH; ++x)
+            {
+                if (freespace_test(fs, x, y, 1, 1)
+                 != fsref_test(ref, x, y, 1, 1))
+                {
+                    if (report)
+                        printf("/* diverged: cell %d, %d differs */\n",
+                                                                x, y);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    return false;
+}
+
+
+/*  replays the operations upon a fresh grid of each. returns true if
+    they diverge, with the index of the operation they diverge at.
+*/
+static bool diff_replay(int width, int height, const diff_op* ops, int n,
+                                        bool report, int* at)
+{
+    freespace* fs = freespace_new_size(width, height);
+    fsref* ref = fsref_new(width, height);
+    bool diverged = false;
+    int i;
+
+    if (!fs || !ref)
+    {
+        fprintf(stderr, "out of memory for freespace_diff\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (report)
+        printf("fs = freespace_new_size(%d, %d);\n", width, height);
+
+    for (i = 0; i < n && !diverged; ++i)
+        diverged = diff_apply(fs, ref, &ops[i], report);
+
+    if (at)
+        *at = i - 1;
+
+    freespace_free(fs);
+    fsref_free(ref);
+
+    return diverged;
+}
+
+
+/*  cuts the operations down to as few as still diverge, by removing
+    ever smaller chunks of those before the last for as long as the
+    remainder still does.
+*/
+static int diff_minimize(int width, int height, diff_op* ops, int n)
+{
+    static diff_op trial[DIFF_ROUND_OPS];
+    int chunk;
+
+    for (chunk = (n - 1) / 2; chunk > 0; chunk /= 2)
+    {
+        int start = 0;
+
+        while (start < n - 1)
+        {
+            int len = (start + chunk < n - 1) ? chunk : n - 1 - start;
+            int at;
+
+            memcpy(trial, ops, start * sizeof(*ops));
+            memcpy(trial + start, ops + start + len,
+                                    (n - start - len) * sizeof(*ops));
+
+            if (diff_replay(width, height, trial, n - len, false, &at)
+             && at == n - len - 1)
+            {
+                memcpy(ops, trial, (n - len) * sizeof(*ops));
+                n -= len;
+            }
+            else
+                start += len;
+        }
+    }
+
+    return n;
+}
+
+
+static void diff_area(uint32_t* rng, int width, int height,
+                                int maxw, int maxh, diff_op* op)
+{
+    op->w = diff_range(rng, 1, (maxw < width) ? maxw : width);
+    op->h = diff_range(rng, 1, (maxh < height) ? maxh : height);
+    op->x = diff_range(rng, 0, width - op->w);
+    op->y = diff_range(rng, 0, height - op->h);
+}
+
+
+/*  generates a round of operations while performing them, keeping
+    track of the areas found and blocks placed so they can be returned.
+*/
+static bool diff_generate(diff_round* rd, int* at)
+{
+    static diff_op placed[DIFF_ROUND_OPS * DIFF_MANY];
+    static diff_op blocks[DIFF_ROUND_OPS];
+    int nplaced = 0;
+    int nblocks = 0;
+
+    uint32_t* rng = &rd->rng;
+    freespace* fs;
+    fsref* ref;
+    bool diverged = false;
+
+    rd->nops = 0;
+
+    if (diff_range(rng, 0, 3))
+    {
+        rd->width = FSWIDTH;
+        rd->height = FSHEIGHT;
+    }
+    else
+    {
+        rd->width = diff_range(rng, 1, FSWIDTH);
+        rd->height = diff_range(rng, 1, FSHEIGHT);
+    }
+
+    fs = freespace_new_size(rd->width, rd->height);
+    ref = fsref_new(rd->width, rd->height);
+
+    if (!fs || !ref)
+    {
+        fprintf(stderr, "out of memory for freespace_diff\n");
+        exit(EXIT_FAILURE);
+    }
+
+    while (rd->nops < DIFF_ROUND_OPS && !diverged)
+    {
+        diff_op* op = &rd->ops[rd->nops];
+        int r = diff_range(rng, 0, 99);
+
+        memset(op, 0, sizeof(*op));
+
+        if (rd->nops % DIFF_CHECK_OPS == DIFF_CHECK_OPS - 1)
+            op->type = DIFF_CHECK;
+        else if (r < 45)
+        {
+            op->type = (r < 40) ? DIFF_FIND : DIFF_FIND_MANY;
+            op->flags = diff_range(rng, 0, 7);
+
+            if (diff_range(rng, 0, 1))
+                op->flags |= diff_range(rng, 1, 3) * FSPLACE_NEAREST;
+
+            op->tx = op->ty = -1;
+
+            if (diff_range(rng, 0, 1))
+            {
+                op->tx = diff_range(rng, 0, FSWIDTH - 1);
+                op->ty = diff_range(rng, 0, FSHEIGHT - 1);
+            }
+
+            /* boundaries may reach beyond a smaller grid */
+            op->bound.w = diff_range(rng, 1, FSWIDTH);
+            op->bound.h = diff_range(rng, 1, FSHEIGHT);
+            op->bound.x = diff_range(rng, 0, FSWIDTH - op->bound.w);
+            op->bound.y = diff_range(rng, 0, FSHEIGHT - op->bound.h);
+
+            if (op->type == DIFF_FIND_MANY)
+            {
+                int i;
+
+                op->count = diff_range(rng, 1, DIFF_MANY);
+
+                for (i = 0; i < op->count; ++i)
+                {
+                    op->aw[i] = diff_range(rng, 1, 8);
+                    op->ah[i] = diff_range(rng, 1, 8);
+                }
+            }
+            else if (diff_range(rng, 0, 9) == 0)
+            {
+                /* an area the size of the boundary */
+                op->w = op->bound.w;
+                op->h = op->bound.h;
+            }
+            else
+            {
+                op->w = diff_range(rng, 1, diff_range(rng, 0, 3)
+                                                ? 8 : op->bound.w);
+                op->h = diff_range(rng, 1, diff_range(rng, 0, 3)
+                                                ? 8 : op->bound.h);
+            }
+        }
+        else if (r < 75 && nplaced)
+        {
+            int i = diff_range(rng, 0, nplaced - 1);
+
+            *op = placed[i];
+            op->type = DIFF_ADD;
+            placed[i] = placed[--nplaced];
+        }
+        else if (r < 80)
+        {
+            op->type = DIFF_BLOCK_REMOVE;
+            diff_area(rng, rd->width, rd->height, 32, 32, op);
+            blocks[nblocks++] = *op;
+        }
+        else if (r < 85 && nblocks)
+        {
+            int i = diff_range(rng, 0, nblocks - 1);
+
+            *op = blocks[i];
+            op->type = DIFF_BLOCK_ADD;
+            blocks[i] = blocks[--nblocks];
+        }
+        else if (r < 88)
+        {
+            /* space returned which was never removed, or removed
+               and never returned */
+            op->type = diff_range(rng, 0, 1) ? DIFF_ADD : DIFF_REMOVE;
+            diff_area(rng, rd->width, rd->height, 16, 16, op);
+        }
+        else
+        {
+            op->type = DIFF_TEST;
+            diff_area(rng, rd->width, rd->height, 8, 8, op);
+
+            /* sometimes partly or wholly outside of the grid */
+            if (diff_range(rng, 0, 9) == 0)
+                op->x += diff_range(rng, 0, 8);
+        }
+
+        ++rd->nops;
+
+        if (op->type == DIFF_FIND)
+        {
+            int x, y;
+            bool found;
+
+            freespace_target_set(fs, op->tx, op->ty);
+            found = freespace_find(fs, &op->bound, op->flags,
+                                            op->w, op->h, &x, &y);
+
+            diverged = diff_found(fs, ref, op, op->w, op->h,
+                                            found, x, y, false);
+
+            if (found && !diverged && rd->nops < DIFF_ROUND_OPS)
+            {
+                diff_op* rm = &rd->ops[rd->nops++];
+
+                memset(rm, 0, sizeof(*rm));
+                rm->type = DIFF_REMOVE;
+                rm->x = x;
+                rm->y = y;
+                rm->w = op->w;
+                rm->h = op->h;
+
+                freespace_remove(fs, x, y, rm->w, rm->h);
+                fsref_remove(ref, x, y, rm->w, rm->h);
+
+                placed[nplaced++] = *rm;
+            }
+        }
+        else if (op->type == DIFF_FIND_MANY)
+        {
+            basebox areas[DIFF_MANY];
+            int i;
+
+            for (i = 0; i < op->count; ++i)
+            {
+                areas[i].w = op->aw[i];
+                areas[i].h = op->ah[i];
+            }
+
+            freespace_target_set(fs, op->tx, op->ty);
+            freespace_find_many(fs, &op->bound, op->flags,
+                                                areas, op->count);
+
+            for (i = 0; i < op->count && !diverged; ++i)
+            {
+                bool found = (areas[i].x != -1);
+
+                diverged = diff_found(fs, ref, op, op->aw[i], op->ah[i],
+                                    found, areas[i].x, areas[i].y, false);
+
+                if (found && !diverged)
+                {
+                    diff_op* a = &placed[nplaced++];
+
+                    fsref_remove(ref, areas[i].x, areas[i].y,
+                                      areas[i].w, areas[i].h);
+
+                    memset(a, 0, sizeof(*a));
+                    a->x = areas[i].x;
+                    a->y = areas[i].y;
+                    a->w = areas[i].w;
+                    a->h = areas[i].h;
+                }
+            }
+        }
+        else
+            diverged = diff_apply(fs, ref, op, false);
+    }
+
+    *at = rd->nops - 1;
+
+    freespace_free(fs);
+    fsref_free(ref);
+
+    return diverged;
+}
+
+
+int freespace_diff(unsigned seed, long ops)
+{
+    static diff_round rd;
+    long done = 0;
+    long round;
+
+    rd.rng = seed ? seed : 1;
+
+    for (round = 0; done < ops; ++round)
+    {
+        uint32_t rng = rd.rng;
+        int at;
+
+        if (diff_generate(&rd, &at))
+        {
+            int n;
+
+            printf("freespace_diff: divergence at operation %ld "
+                   "(round %ld, seed %u, %d x %d grid)\n",
+                            done + at, round, seed, rd.width, rd.height);
+
+            /*  the REMOVE following a FIND is generated after the FIND
+                is performed, so the round must be replayed to be sure
+                it diverges at the same operation.
+            */
+            if (!diff_replay(rd.width, rd.height, rd.ops, at + 1,
+                                                        false, &at))
+            {
+                printf("freespace_diff: round state %u does not replay\n",
+                                                                    rng);
+                return 1;
+            }
+
+            n = diff_minimize(rd.width, rd.height, rd.ops, at + 1);
+
+            printf("freespace_diff: minimal replay of %d operations:\n",
+                                                                    n);
+            diff_replay(rd.width, rd.height, rd.ops, n, true, 0);
+
+            return 1;
+        }
+
+        done += rd.nops;
+    }
+
+    printf("freespace_diff: %ld operations in %ld rounds, "
+           "no divergence (seed %u)\n", done, round, seed);
+
+    return 0;
+}
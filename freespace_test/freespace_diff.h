@@ -0,0 +1,20 @@
+#ifndef FREESPACE_DIFF_H
+#define FREESPACE_DIFF_H
+
+
+/*  freespace_diff
+ *------------------
+ *  differential test of the freespace state against the reference
+ *  implementation (freespace_ref.h). runs ops random operations (finds
+ *  with every placement flag and strategy, find_many, removes, adds,
+ *  block-areas, tests) against both, in rounds upon grids of random
+ *  sizes, checking every result and periodically every cell.
+ *
+ *  at the first divergence the operations of that round are cut down to
+ *  as few as still diverge, which are printed as a replay of freespace
+ *  calls, and 1 is returned. returns 0 when no divergence was found.
+ */
+int     freespace_diff(unsigned seed, long ops);
+
+
+#endif
@@ -0,0 +1,249 @@
+#include "freespace_ref.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+struct freespace_ref
+{
+    int width;
+    int height;
+    uint8_t refs[FSHEIGHT][FSWIDTH];
+};
+
+
+fsref* fsref_new(int width, int height)
+{
+    fsref* ref;
+
+    if (width < 1 || width > FSWIDTH || height < 1 || height > FSHEIGHT)
+        return 0;
+
+    if (!(ref = malloc(sizeof(*ref))))
+        return 0;
+
+    ref->width = width;
+    ref->height = height;
+
+    fsref_clear(ref);
+
+    return ref;
+}
+
+
+void fsref_free(fsref* ref)
+{
+    free(ref);
+}
+
+
+void fsref_clear(fsref* ref)
+{
+    int x, y;
+
+    /* the cells outside of the grid are used, and stay used */
+    for (y = 0; y < FSHEIGHT; ++y)
+        for (x = 0; x < FSWIDTH; ++x)
+            ref->refs[y][x] = (x < ref->width && y < ref->height)
+                                    ? 0 : UINT8_MAX;
+}
+
+
+void fsref_remove(fsref* ref, int x0, int y0, int width, int height)
+{
+    int x, y;
+
+    for (y = y0; y < y0 + height; ++y)
+        for (x = x0; x < x0 + width; ++x)
+            if (ref->refs[y][x] < UINT8_MAX)
+                ++ref->refs[y][x];
+}
+
+
+void fsref_add(fsref* ref, int x0, int y0, int width, int height)
+{
+    int x, y;
+
+    for (y = y0; y < y0 + height && y < ref->height; ++y)
+        for (x = x0; x < x0 + width && x < ref->width; ++x)
+            if (ref->refs[y][x] > 0)
+                --ref->refs[y][x];
+}
+
+
+static bool area_free(fsref* ref, int x0, int y0, int width, int height)
+{
+    int x, y;
+
+    for (y = y0; y < y0 + height; ++y)
+        for (x = x0; x < x0 + width; ++x)
+            if (ref->refs[y][x])
+                return false;
+
+    return true;
+}
+
+
+bool fsref_test(fsref* ref, int x, int y, int width, int height)
+{
+    if (x < 0 || y < 0 || width < 1 || height < 1
+     || x + width > ref->width || y + height > ref->height)
+    {
+        return false;
+    }
+
+    return area_free(ref, x, y, width, height);
+}
+
+
+static void clip(fsref* ref, const basebox* boundary, basebox* clipped)
+{
+    *clipped = *boundary;
+
+    if (clipped->x + clipped->w > ref->width)
+        clipped->w = ref->width - clipped->x;
+
+    if (clipped->y + clipped->h > ref->height)
+        clipped->h = ref->height - clipped->y;
+}
+
+
+bool fsref_fits(fsref* ref, const basebox* boundary,
+                                int x, int y, int width, int height)
+{
+    basebox b;
+
+    clip(ref, boundary, &b);
+
+    if (width < 1 || height < 1
+     || x < b.x || y < b.y || x + width > b.x + b.w
+                           || y + height > b.y + b.h)
+    {
+        return false;
+    }
+
+    return area_free(ref, x, y, width, height);
+}
+
+
+bool fsref_find(fsref* ref, const basebox* boundary, int flags,
+                                int width,      int height,
+                                int* resultx,   int* resulty )
+{
+    basebox b;
+    int i, j;
+
+    *resultx = *resulty = -1;
+
+    clip(ref, boundary, &b);
+
+    if (width < 1 || width > b.w || height < 1 || height > b.h)
+        return false;
+
+    /* i is the row (or column) and j the position within it */
+    for (i = 0; i < ((flags & FSPLACE_ROW_SMART) ? b.h - height
+                                                 : b.w - width) + 1; ++i)
+    {
+        for (j = 0; j < ((flags & FSPLACE_ROW_SMART) ? b.w - width
+                                                     : b.h - height) + 1;
+                                                                    ++j)
+        {
+            int x = (flags & FSPLACE_ROW_SMART) ? j : i;
+            int y = (flags & FSPLACE_ROW_SMART) ? i : j;
+
+            x = (flags & FSPLACE_LEFT_TO_RIGHT)
+                    ? b.x + x : b.x + b.w - width - x;
+
+            y = (flags & FSPLACE_TOP_TO_BOTTOM)
+                    ? b.y + y : b.y + b.h - height - y;
+
+            if (area_free(ref, x, y, width, height))
+            {
+                *resultx = x;
+                *resulty = y;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+
+long fsref_nearest(fsref* ref, const basebox* boundary,
+                                int width, int height, int tx, int ty)
+{
+    long best = -1;
+    int x, y;
+
+    for (y = boundary->y; y < boundary->y + boundary->h; ++y)
+    {
+        for (x = boundary->x; x < boundary->x + boundary->w; ++x)
+        {
+            long d = (long)(x - tx) * (x - tx) + (long)(y - ty) * (y - ty);
+
+            if ((best < 0 || d < best)
+             && fsref_fits(ref, boundary, x, y, width, height))
+            {
+                best = d;
+            }
+        }
+    }
+
+    return best;
+}
+
+
+int fsref_gap(fsref* ref, const basebox* boundary,
+                                int x, int y, int width, int height)
+{
+    int gap = 0;
+    int i;
+
+    for (i = x - 1; fsref_fits(ref, boundary, i, y, width, height); --i)
+        ++gap;
+
+    for (i = x + 1; fsref_fits(ref, boundary, i, y, width, height); ++i)
+        ++gap;
+
+    for (i = y - 1; fsref_fits(ref, boundary, x, i, width, height); --i)
+        ++gap;
+
+    for (i = y + 1; fsref_fits(ref, boundary, x, i, width, height); ++i)
+        ++gap;
+
+    return gap;
+}
+
+
+int fsref_best(fsref* ref, const basebox* boundary, int flags,
+                                int width, int height)
+{
+    int best = -1;
+    int x, y;
+
+    for (y = boundary->y; y < boundary->y + boundary->h; ++y)
+    {
+        for (x = boundary->x; x < boundary->x + boundary->w; ++x)
+        {
+            int x0 = x;
+            int gap;
+
+            if (!fsref_fits(ref, boundary, x, y, width, height))
+                continue;
+
+            /* the run of positions across, tried at the start end */
+            while (fsref_fits(ref, boundary, x + 1, y, width, height))
+                ++x;
+
+            gap = fsref_gap(ref, boundary,
+                            (flags & FSPLACE_LEFT_TO_RIGHT) ? x0 : x, y,
+                                                        width, height);
+            if (best < 0 || gap < best)
+                best = gap;
+        }
+    }
+
+    return best;
+}
@@ -0,0 +1,72 @@
+#ifndef FREESPACE_REF_H
+#define FREESPACE_REF_H
+
+
+#include "basebox.h"
+#include "freespace_state.h"
+
+
+/*  the reference freespace state
+ *---------------------------------
+ *  a naive cell by cell implementation of the freespace state, slow but
+ *  simple enough to be obviously correct. it keeps a count of the areas
+ *  using each cell exactly as the freespace state does, and searches by
+ *  trying every position in turn. freespace_diff runs the two side by
+ *  side and reports where they disagree.
+ */
+
+typedef struct freespace_ref fsref;
+
+
+fsref*      fsref_new(int width, int height);
+void        fsref_free(fsref*);
+
+void        fsref_clear(fsref*);
+
+void        fsref_remove(fsref*, int x, int y, int width, int height);
+void        fsref_add(fsref*, int x, int y, int width, int height);
+
+bool        fsref_test(fsref*, int x, int y, int width, int height);
+
+
+/*  fsref_fits: whether the area at x, y fits within the boundary (clipped
+                to the grid) and is entirely unused space.
+*/
+bool        fsref_fits(fsref*, const basebox* boundary,
+                                int x, int y, int width, int height);
+
+
+/*  fsref_find: first-fit search, scanning row by row (or column by column
+                when not FSPLACE_ROW_SMART) in the directions given by the
+                placement flags. the placement strategy is ignored.
+*/
+bool        fsref_find(fsref*, const basebox* boundary, int flags,
+                                int width,      int height,
+                                int* resultx,   int* resulty );
+
+
+/*  the placement strategies choose between positions which can be equally
+    good, so they are checked by how good a position is rather than which:
+
+    fsref_nearest:  the least squared distance of any position from the
+                    target tx, ty (as resolved by freespace_target_set).
+                    returns -1 if there is no position.
+
+    fsref_gap:      the gap about the position x, y as FSPLACE_BEST_FIT
+                    measures it: the positions in the run across it which
+                    it could slide to, plus those down.
+
+    fsref_best:     the least gap of any position FSPLACE_BEST_FIT would
+                    consider, or -1 if there is no position.
+*/
+long        fsref_nearest(fsref*, const basebox* boundary,
+                                int width, int height, int tx, int ty);
+
+int         fsref_gap(fsref*, const basebox* boundary,
+                                int x, int y, int width, int height);
+
+int         fsref_best(fsref*, const basebox* boundary, int flags,
+                                int width, int height);
+
+
+#endif
@@ -1,9 +1,11 @@
 #include "debug.h"
+#include "freespace_diff.h"
 #include "freespace_state.h"
 #include "basebox.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include <sys/time.h>
@@ -34,6 +36,17 @@ int main(int argc, char** argv)
                           | FSPLACE_LEFT_TO_RIGHT
                           | FSPLACE_TOP_TO_BOTTOM;
 
+    /*  freespace_test diff [seed [operations]] runs the differential
+        test against the reference implementation instead.
+    */
+    if (argc > 1 && !strcmp(argv[1], "diff"))
+    {
+        unsigned seed = (argc > 2) ? strtoul(argv[2], 0, 10) : 1;
+        long ops = (argc > 3) ? strtol(argv[3], 0, 10) : 1000000;
+
+        return freespace_diff(seed, ops);
+    }
+
     freespace* fs = freespace_new();
 
 
@@ -85,6 +98,12 @@ int main(int argc, char** argv)
 
     freespace_dump(fs,0);
 
+    if (freespace_test(fs, resx, resy, w, h))
+        WARNING("freespace_test: placed box area reported free\n");
+
+    if (!freespace_test(fs, 128 - w, 128 - h, w, h))
+        WARNING("freespace_test: empty corner reported used\n");
+
 /*
     freespace_add(fs, 0, 0, w, h);
 
@@ -3,19 +3,33 @@
 
 #include "debug.h"
 #include "event_port.h"
+#include "event_wheel.h"
 #include "grid_boundary.h"
 #include "midi_out_port.h"
 #include "real_time_data.h"
 
 
+#include <stdint.h>
 #include <stdlib.h>
 
 
 #include "include/grid_boundary_data.h"
 
 
+/* the most note-ons placed together by grid_rt_process_intersort */
+#define GRID_PLACE_BATCH 16
+
+/* copies of the freespace held by the ringbuffer */
+#define GRID_STATS_RING_SIZE 2
+
+/* cycles between publishing copies of the freespace */
+#define GRID_STATS_PUBLISH_INTERVAL 32
+
+
 struct box_grid
 {
+    int index;
+
     evport_manager* portman;
 
     evport* intersort;
@@ -26,13 +40,22 @@ struct box_grid
                                 into an appropriate order for
                                 eventual MIDI output.
                             */
-    evport* block_port;
+    evpool*     block_pool;
+    rt_evwheel* blocks;     /* keyed on box_release */
 
     jack_ringbuffer_t*  ui_note_on_buf;
     jack_ringbuffer_t*  ui_note_off_buf;
     jack_ringbuffer_t*  ui_unplace_buf;
 
     freespace*  fs;
+
+    jack_ringbuffer_t*  stats_ring;
+    int                 stats_countdown;
+    void*               stats_rows;     /* RT only */
+
+    /* UI only */
+    void*       ui_rows;
+    freespace*  ui_fs;
 };
 
 
@@ -45,30 +68,51 @@ struct box_grid
 */
 
 
-grid* grid_new(void)
+grid* grid_new(int index, int width, int height)
 {
     grid* gr = malloc(sizeof(*gr));
 
     if (!gr)
         goto fail0;
 
+    gr->index = index;
+
     if (!(gr->portman = evport_manager_new("grid")))
         goto fail1;
 
     gr->intersort = evport_manager_evport_new(  gr->portman,
                                                 "intersort",
-                                                RT_EVLIST_SORT_POS);
+                                                RT_EVLIST_SORT_POS
+                                                | RT_EVLIST_HEAP);
     if (!gr->intersort)
         goto fail2;
 
-    gr->block_port = evport_manager_evport_new( gr->portman,
-                                                "block",
-                                                RT_EVLIST_SORT_POS);
-    if (!gr->block_port)
+    if (!(gr->block_pool = evpool_new(DEFAULT_EVPOOL_SIZE * 16,
+                                                    "grid blocks")))
         goto fail2;
 
-    if (!(gr->fs = freespace_new()))
-        goto fail2;
+    if (!(gr->blocks = rt_evwheel_new(gr->block_pool, "grid blocks")))
+        goto fail3;
+
+    if (!(gr->fs = freespace_new_size(width, height)))
+        goto fail4;
+
+    /* (a ringbuffer holds one byte less than it is created with) */
+    gr->stats_ring = jack_ringbuffer_create(GRID_STATS_RING_SIZE
+                                            * freespace_rows_size() + 1);
+    if (!gr->stats_ring)
+        goto fail5;
+
+    if (!(gr->stats_rows = malloc(freespace_rows_size())))
+        goto fail6;
+
+    if (!(gr->ui_rows = malloc(freespace_rows_size())))
+        goto fail7;
+
+    if (!(gr->ui_fs = freespace_new_size(width, height)))
+        goto fail8;
+
+    gr->stats_countdown = GRID_STATS_PUBLISH_INTERVAL;
 
     gr->ui_note_on_buf = 0;
     gr->ui_note_off_buf = 0;
@@ -76,6 +120,18 @@ grid* grid_new(void)
 
     return gr;
 
+fail8:
+    free(gr->ui_rows);
+fail7:
+    free(gr->stats_rows);
+fail6:
+    jack_ringbuffer_free(gr->stats_ring);
+fail5:
+    freespace_free(gr->fs);
+fail4:
+    rt_evwheel_free(gr->blocks);
+fail3:
+    evpool_free(gr->block_pool);
 fail2:
     evport_manager_free(gr->portman);
 fail1:
@@ -91,7 +147,13 @@ void grid_free(grid* gr)
     if (!gr)
         return;
 
+    freespace_free(gr->ui_fs);
+    free(gr->ui_rows);
+    free(gr->stats_rows);
+    jack_ringbuffer_free(gr->stats_ring);
     freespace_free(gr->fs);
+    rt_evwheel_free(gr->blocks);
+    evpool_free(gr->block_pool);
     evport_manager_free(gr->portman);
     free(gr);
 }
@@ -109,6 +171,57 @@ freespace*  grid_get_freespace(grid* gr)
 }
 
 
+void grid_rt_publish_stats(grid* gr)
+{
+    const size_t size = freespace_rows_size();
+
+    if (--gr->stats_countdown > 0)
+        return;
+
+    /* if the reader isn't keeping up, try again next cycle */
+    if (jack_ringbuffer_write_space(gr->stats_ring) < size)
+        return;
+
+    freespace_rows_copy(gr->fs, gr->stats_rows);
+    jack_ringbuffer_write(gr->stats_ring, (const char*)gr->stats_rows, size);
+    gr->stats_countdown = GRID_STATS_PUBLISH_INTERVAL;
+}
+
+
+bool grid_ui_stats_update(grid* gr)
+{
+    const size_t size = freespace_rows_size();
+
+    if (jack_ringbuffer_read_space(gr->stats_ring) < size)
+        return 0;
+
+    /* only the most recent copy is of any interest */
+    while (jack_ringbuffer_read_space(gr->stats_ring) >= size * 2)
+        jack_ringbuffer_read_advance(gr->stats_ring, size);
+
+    jack_ringbuffer_read(gr->stats_ring, (char*)gr->ui_rows, size);
+    freespace_rows_load(gr->ui_fs, gr->ui_rows);
+
+    return 1;
+}
+
+
+void grid_ui_stats(grid* gr, const basebox* boundary, fsstats* st)
+{
+    basebox all;
+
+    if (!boundary)
+    {
+        all.x = all.y = 0;
+        all.w = freespace_width(gr->ui_fs);
+        all.h = freespace_height(gr->ui_fs);
+        boundary = &all;
+    }
+
+    freespace_stats(gr->ui_fs, boundary, st);
+}
+
+
 void grid_set_ui_note_on_buf(grid* gr, jack_ringbuffer_t* rb)
 {
     gr->ui_note_on_buf = rb;
@@ -175,7 +288,7 @@ void grid_rt_flush_intersort(grid* gr, bbt_t ph, bbt_t nph,
                 event_dump(&ev);
             }
             else
-                evport_write_event(gr->block_port, &ev);
+                rt_evwheel_event_add(gr->blocks, &ev);
 
             #ifndef NDEBUG
             sz =
@@ -209,182 +322,275 @@ void grid_rt_flush_intersort(grid* gr, bbt_t ph, bbt_t nph,
 }
 
 
-void grid_rt_process_intersort(grid* gr, bbt_t ph, bbt_t nph,
+/*  outputs and schedules the ending of an event placed by
+    grid_rt_process_intersort.
+*/
+static void grid_rt_placed_event(grid* gr, event* ev, grbound* rtgrb,
+                                    bbt_t ph, bbt_t nph,
                                     jack_nframes_t nframes,
                                     double frames_per_tick)
 {
-    /*  events inside the intersort must only ocurr within this cycle
-        the event within the intersort is processed by pos (nb. not by
-        note_dur or box_release).
-    */
+    #ifndef NDEBUG
+    size_t sz;
+    #endif
 
-    event ev;
+    if (EVENT_IS_TYPE( ev, EV_TYPE_NOTE ))
+    {
+        /* must set velocity before "pushing for pitch" */
+        if (rtgrb->flags & FSPLACE_TOP_TO_BOTTOM)
+            ev->note_velocity = ev->box.y;
+        else
+            ev->note_velocity = ev->box.y + ev->box.h;
 
-    evport_read_reset(gr->intersort);
+        ev->note_pitch = moport_rt_push_event_pitch(rtgrb->midiout, ev,
+                                                    rtgrb->flags,
+                                                    rtgrb->scale_mask);
+        if (ev->note_pitch == -1)
+        {
+            if ((rtgrb->flags & GRBOUND_BLOCK_ON_NOTE_FAIL))
+            {
+                ev->pos = ev->box_release;
+                EVENT_SET_TYPE( ev, EV_TYPE_BLOCK );
+                /*  send to block port to maintain event until
+                    it expires */
+                rt_evwheel_event_add(gr->blocks, ev);
+            }
+        }
+        else
+        {
+            moport_rt_output_jack_midi_event(rtgrb->midiout, ev,
+                                             ph, nframes,
+                                             frames_per_tick);
+        }
+    }
+    else
+    {
+        ev->pos = ev->box_release;
+        rt_evwheel_event_add(gr->blocks, ev);
+    }
 
-    while(evport_read_and_remove_event(gr->intersort, &ev))
+    #ifndef NDEBUG
+    sz =
+    #endif
+    jack_ringbuffer_write(gr->ui_note_on_buf, (char*)ev, sizeof(*ev));
+    #ifndef NDEBUG
+    if (sz != sizeof(*ev))
+        DWARNING("failed to queue note on event to ui\n");
+    #endif
+
+    /* check for events which end aswell as begin this cycle */
+    if (EVENT_IS_TYPE( ev, EV_TYPE_NOTE ))
     {
-        #ifndef NDEBUG
-        size_t sz;
-        #endif
+        if (ev->note_dur < nph)
+        {
+            ev->pos = ev->note_dur;
+            EVENT_SET_STATUS_OFF( ev );
+            evport_write_event(gr->intersort, ev);
+            DMESSAGE("note ends this cycle!\n");
+        }
+    }
+    else
+    {
+        if (ev->box_release < nph)
+        {
+            ev->pos = ev->box_release;
+            EVENT_SET_STATUS_OFF( ev );
+            evport_write_event(gr->intersort, ev);
+            DMESSAGE("block ends this cycle!\n");
+        }
+    }
+}
 
-        grbound* rtgrb = rtdata_data(ev.grb->rt);
 
-        #ifndef NDEBUG
-        if (ev.pos < ph || ev.pos > nph)
-            DWARNING("invalid event position\n");
+/*  places or ends the event read from the intersort of the grid. */
+static void grid_rt_process_event(grid* gr, event* ev,
+                                    bbt_t ph, bbt_t nph,
+                                    jack_nframes_t nframes,
+                                    double frames_per_tick)
+{
+    #ifndef NDEBUG
+    size_t sz;
+    #endif
+
+    grbound* rtgrb = rtdata_data(ev->grb->rt);
+
+    #ifndef NDEBUG
+    if (ev->pos < ph || ev->pos > nph)
+        DWARNING("invalid event position\n");
 /*
-        event_flags_to_str(ev.flags, buf);
-        DMESSAGE("ph~nph: %6d ~ %6d\t[%s] pos: %d dur:%d rel:%d\n",
-                    ph, nph, buf, ev.pos, ev.note_dur, ev.box_release);
+    event_flags_to_str(ev->flags, buf);
+    DMESSAGE("ph~nph: %6d ~ %6d\t[%s] pos: %d dur:%d rel:%d\n",
+                ph, nph, buf, ev->pos, ev->note_dur, ev->box_release);
 */
+    #endif
+
+    if (EVENT_IS_STATUS_ON( ev ))
+    {
+        /*  chords and simultaneous hits within the same boundary
+            are placed together (see freespace_find_many).
+        */
+        event batch[GRID_PLACE_BATCH];
+        basebox areas[GRID_PLACE_BATCH];
+        event next;
+        int i, count = 1;
+
+        #ifndef NDEBUG
+        if (ph == 0 && nph == 4)
+        {
+            DWARNING("intersort should not be "
+                     "adding events right now!\n");
+        }
         #endif
 
-        if (EVENT_IS_STATUS_ON( &ev ))
+        event_copy(&batch[0], ev);
+
+        while (count < GRID_PLACE_BATCH
+            && evport_peek_event(gr->intersort, &next)
+            && next.pos == ev->pos
+            && next.grb == ev->grb
+            && EVENT_IS_STATUS_ON( &next ))
         {
-            #ifndef NDEBUG
-            if (ph == 0 && nph == 4)
-            {
-                DWARNING("intersort should not be "
-                         "adding events right now!\n");
-            }
-            #endif
+            evport_read_and_remove_event(gr->intersort,
+                                                &batch[count++]);
+        }
 
-            if (freespace_find( gr->fs,
-                                &rtgrb->box,
-                                rtgrb->flags,
-                                ev.box.w,   ev.box.h,
-                                &ev.box.x,  &ev.box.y ))
-            {
-                if (EVENT_IS_TYPE( &ev, EV_TYPE_NOTE ))
-                {
-                    /* must set velocity before "pushing for pitch" */
-                    if (rtgrb->flags & FSPLACE_TOP_TO_BOTTOM)
-                        ev.note_velocity = ev.box.y;
-                    else
-                        ev.note_velocity = ev.box.y + ev.box.h;
-
-                    ev.note_pitch =
-                            moport_rt_push_event_pitch(rtgrb->midiout,
-                                                        &ev,
-                                                        rtgrb->flags,
-                                                        rtgrb->scale_bin,
-                                                        rtgrb->scale_key );
-                    if (ev.note_pitch == -1)
-                    {
-                        if ((rtgrb->flags & GRBOUND_BLOCK_ON_NOTE_FAIL))
-                        {
-                            ev.pos = ev.box_release;
-                            EVENT_SET_TYPE( &ev, EV_TYPE_BLOCK );
-                            /*  send to block port to maintain event until
-                                it expires */
-                            evport_write_event(gr->block_port, &ev);
-                        }
-                    }
-                    else
-                    {
-                        moport_rt_output_jack_midi_event(rtgrb->midiout,
-                                                         &ev,
-                                                         ph, nframes,
-                                                         frames_per_tick);
-                    }
-                }
-                else
-                {
-                    ev.pos = ev.box_release;
-                    evport_write_event(gr->block_port, &ev);
-                }
-
-                freespace_remove(gr->fs,    ev.box.x, ev.box.y,
-                                            ev.box.w, ev.box.h );
-
-                #ifndef NDEBUG
-                sz =
-                #endif
-                jack_ringbuffer_write(gr->ui_note_on_buf, (char*)&ev,
-                                                             sizeof(ev));
-                #ifndef NDEBUG
-                if (sz != sizeof(ev))
-                    DWARNING("failed to queue note on event to ui\n");
-                #endif
-
-                /* check for events which end aswell as begin this cycle */
-                if (EVENT_IS_TYPE( &ev, EV_TYPE_NOTE ))
-                {
-                    if (ev.note_dur < nph)
-                    {
-                        ev.pos = ev.note_dur;
-                        EVENT_SET_STATUS_OFF( &ev );
-                        evport_write_event(gr->intersort, &ev);
-                        DMESSAGE("note ends this cycle!\n");
-                    }
-                }
-                else
-                {
-                    if (ev.box_release < nph)
-                    {
-                        ev.pos = ev.box_release;
-                        EVENT_SET_STATUS_OFF( &ev );
-                        evport_write_event(gr->intersort, &ev);
-                        DMESSAGE("block ends this cycle!\n");
-                    }
-                }
-            }
+        for (i = 0; i < count; ++i)
+        {
+            areas[i].w = batch[i].box.w;
+            areas[i].h = batch[i].box.h;
         }
-        else /* EVENT_IS_STATUS_OFF( &ev ) */
+
+        freespace_target_set(gr->fs, rtgrb->target_x,
+                                     rtgrb->target_y);
+
+        freespace_find_many(gr->fs, &rtgrb->box, rtgrb->flags,
+                                                    areas, count);
+
+        for (i = 0; i < count; ++i)
         {
-            if (EVENT_IS_TYPE( &ev, EV_TYPE_NOTE ))
+            if (areas[i].x == -1)
+                continue;
+
+            batch[i].box.x = areas[i].x;
+            batch[i].box.y = areas[i].y;
+            batch[i].grid = gr->index;
+
+            grid_rt_placed_event(gr, &batch[i], rtgrb, ph, nph,
+                                        nframes, frames_per_tick);
+        }
+    }
+    else /* EVENT_IS_STATUS_OFF( ev ) */
+    {
+        if (EVENT_IS_TYPE( ev, EV_TYPE_NOTE ))
+        {
+            EVENT_SET_TYPE( ev, EV_TYPE_BLOCK );
+            EVENT_SET_STATUS_OFF( ev );
+
+            moport_rt_output_jack_midi_event(rtgrb->midiout, ev,
+                                             ph, nframes,
+                                             frames_per_tick);
+            ev->pos = ev->box_release;
+
+            if (ev->box_release < nph)
             {
-                EVENT_SET_TYPE( &ev, EV_TYPE_BLOCK );
-                EVENT_SET_STATUS_OFF( &ev );
-
-                moport_rt_output_jack_midi_event(rtgrb->midiout, &ev,
-                                                 ph, nframes,
-                                                 frames_per_tick);
-                ev.pos = ev.box_release;
-
-                if (ev.box_release < nph)
-                {
-                    evport_write_event(gr->intersort, &ev);
-                    DMESSAGE("block ends this cycle!\n");
-                    event_dump(&ev);
-                }
-                else
-                    evport_write_event(gr->block_port, &ev);
-
-                #ifndef NDEBUG
-                sz =
-                #endif
-                jack_ringbuffer_write(gr->ui_note_off_buf, (char*)&ev,
-                                                             sizeof(ev));
-                #ifndef NDEBUG
-                if (sz != sizeof(ev))
-                    DWARNING("failed to queue unplace event to ui\n");
-                #endif
+                evport_write_event(gr->intersort, ev);
+                DMESSAGE("block ends this cycle!\n");
+                event_dump(ev);
             }
             else
+                rt_evwheel_event_add(gr->blocks, ev);
+
+            #ifndef NDEBUG
+            sz =
+            #endif
+            jack_ringbuffer_write(gr->ui_note_off_buf, (char*)ev,
+                                                        sizeof(*ev));
+            #ifndef NDEBUG
+            if (sz != sizeof(*ev))
+                DWARNING("failed to queue unplace event to ui\n");
+            #endif
+        }
+        else
+        {
+            freespace_add(gr->fs,   ev->box.x,   ev->box.y,
+                                    ev->box.w,   ev->box.h );
+            #ifndef NDEBUG
+            sz =
+            #endif
+            jack_ringbuffer_write(gr->ui_unplace_buf, (char*)ev,
+                                                        sizeof(*ev));
+            #ifndef NDEBUG
+            if (sz != sizeof(*ev))
+                DWARNING("failed to queue unplace event to ui\n");
+            #endif
+        }
+    }
+}
+
+
+void grid_rt_process_intersort(grid* gr, bbt_t ph, bbt_t nph,
+                                    jack_nframes_t nframes,
+                                    double frames_per_tick)
+{
+    grid_rt_process_intersorts(&gr, 1, ph, nph, nframes, frames_per_tick);
+}
+
+
+void grid_rt_process_intersorts(grid** grids, int count,
+                                    bbt_t ph, bbt_t nph,
+                                    jack_nframes_t nframes,
+                                    double frames_per_tick)
+{
+    /*  events inside the intersort must only ocurr within this cycle
+        the event within the intersort is processed by pos (nb. not by
+        note_dur or box_release).
+    */
+
+    event ev;
+    int i;
+
+    for (i = 0; i < count; ++i)
+        evport_read_reset(grids[i]->intersort);
+
+    if (count == 1)
+    {
+        while(evport_read_and_remove_event(grids[0]->intersort, &ev))
+            grid_rt_process_event(grids[0], &ev, ph, nph,
+                                            nframes, frames_per_tick);
+        return;
+    }
+
+    /*  the grids share midi out ports, the MIDI for which must be output
+        in order. so the events of all the intersorts are processed
+        together, earliest first.
+    */
+    for (;;)
+    {
+        grid* gr = 0;
+        bbt_t pos = 0;
+
+        for (i = 0; i < count; ++i)
+        {
+            if (evport_peek_event(grids[i]->intersort, &ev)
+             && (!gr || ev.pos < pos))
             {
-                freespace_add(gr->fs,   ev.box.x,   ev.box.y,
-                                        ev.box.w,   ev.box.h );
-                #ifndef NDEBUG
-                sz =
-                #endif
-                jack_ringbuffer_write(gr->ui_unplace_buf, (char*)&ev,
-                                                             sizeof(ev));
-                #ifndef NDEBUG
-                if (sz != sizeof(ev))
-                    DWARNING("failed to queue unplace event to ui\n");
-                #endif
+                gr = grids[i];
+                pos = ev.pos;
             }
         }
+
+        if (!gr)
+            break;
+
+        evport_read_and_remove_event(gr->intersort, &ev);
+        grid_rt_process_event(gr, &ev, ph, nph, nframes, frames_per_tick);
     }
 }
 
-
 void grid_rt_process_blocks(grid* gr, bbt_t ph, bbt_t nph)
 {
 /*
-        purpose: process events within block_port,
+        purpose: process block events within the grid,
         these are events which don't emit any
         MIDI messages within their lifetime, but are still
         placed and unplaced as blocks within the grid.
@@ -397,23 +603,28 @@ void grid_rt_process_blocks(grid* gr, bbt_t ph, bbt_t nph)
         the usage of this port differs slightly in that
         the events it contains stay in the port for the
         duration of the note (hmmm yeah, ummm...)
+
+        the blocks are kept in a timing wheel so only those
+        expiring this cycle are looked at. blocks which should
+        have expired before ph (there shouldn't be any) are
+        expired now rather than being left behind forever.
 */
     event ev;
 
-    evport_read_reset(gr->block_port);
+    /*  the wheel only turns forward. after a stop or relocate it's
+        been flushed so start it again from here.
+    */
+    if (!rt_evwheel_count(gr->blocks) || ph < rt_evwheel_now(gr->blocks))
+        rt_evwheel_reset(gr->blocks, ph);
 
-    while(evport_read_event(gr->block_port, &ev))
+    while(rt_evwheel_expire_event(gr->blocks, nph, &ev))
     {
         /*#ifndef NDEBUG
         EVENT_IS(&ev, EV_STATUS_OFF | EV_TYPE_BLOCK);
         #endif*/
 
-        if (ev.pos >= ph && ev.pos < nph)
-        {
-            EVENT_SET_STATUS_OFF( &ev );
-            evport_write_event(gr->intersort, &ev);
-            evport_and_remove_event(gr->block_port);
-        }
+        EVENT_SET_STATUS_OFF( &ev );
+        evport_write_event(gr->intersort, &ev);
     }
 }
 
@@ -425,9 +636,7 @@ void grid_rt_flush_blocks_to_intersort(grid* gr)
 
     DMESSAGE("flushing blocks to intersort...\n");
 
-    evport_read_reset(gr->block_port);
-
-    while(evport_read_and_remove_event(gr->block_port, &ev))
+    while(rt_evwheel_remove_event(gr->blocks, &ev))
     {
         ev.pos = 0;
         ev.note_dur = 1;
@@ -443,7 +652,8 @@ void grid_rt_flush_blocks_to_intersort(grid* gr)
 
 bool grid_rt_add_block_area(grid* gr, int x, int y, int w, int h)
 {
-    if (x < 0 || y < 0 || w < 1 || h < 1)
+    if (x < 0 || y < 0 || w < 1 || h < 1
+     || x + w > freespace_width(gr->fs) || y + h > freespace_height(gr->fs))
         return false;
 
     bool ret = freespace_block_remove(gr->fs, x, y, w, h);
@@ -458,7 +668,9 @@ bool grid_rt_add_block_area(grid* gr, int x, int y, int w, int h)
         ev.box.y = y;
         ev.box.w = w;
         ev.box.h = h;
-        evport_write_event(gr->block_port, &ev);
+        /* block-areas never expire, only flush */
+        ev.pos = ev.box_release = INT32_MAX;
+        rt_evwheel_event_add(gr->blocks, &ev);
     }
 
     return ret;
@@ -471,16 +683,15 @@ bool grid_rt_add_block_area_event(grid* gr, event* ev)
 }
 
 
-void grid_dump_block_events(grid* gr)
+static void grid_dump_block_event(event* ev)
 {
-    event ev;
+    event_dump(ev);
+}
 
-    DMESSAGE("grid block-events dump...\n");
 
-    evport_read_reset(gr->block_port);
+void grid_dump_block_events(grid* gr)
+{
+    DMESSAGE("grid block-events dump...\n");
 
-    while(evport_read_event(gr->block_port, &ev))
-    {
-        event_dump(&ev);
-    }
+    rt_evwheel_for_each(gr->blocks, grid_dump_block_event);
 }
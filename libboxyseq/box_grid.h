@@ -16,7 +16,12 @@ extern "C" {
 #include "freespace_state.h"
 
 
-grid*       grid_new(void);
+/*  index is that of the grid within its boxyseq. it is recorded on the
+    events the grid places so that their endings find their way back.
+    width and height are those of its freespace (see freespace_new_size),
+    boundaries reaching beyond them place events within them only.
+*/
+grid*       grid_new(int index, int width, int height);
 void        grid_free(grid*);
 
 /* grid intersort: port for collecting all events occurring this cycle */
@@ -29,6 +34,21 @@ void        grid_set_ui_note_on_buf(    grid*, jack_ringbuffer_t*);
 void        grid_set_ui_note_off_buf(   grid*, jack_ringbuffer_t*);
 void        grid_set_ui_unplace_buf(    grid*, jack_ringbuffer_t*);
 
+/*  freespace stats
+ *-------------------
+ *  measuring the freespace (see freespace_stats) costs too much to do
+ *  from the RT thread. instead, every so often, grid_rt_publish_stats
+ *  copies which cells of the grid are in use into a ringbuffer, from
+ *  which grid_ui_stats_update loads the most recent copy into a freespace
+ *  of the UI's own. returns true if there was one. grid_ui_stats then
+ *  measures the boundary within that copy (the whole grid if boundary is
+ *  NULL) so the GUI can warn of a boundary filling up or fragmenting
+ *  before placement begins to fail.
+ */
+void        grid_rt_publish_stats(grid*);
+bool        grid_ui_stats_update(grid*);
+void        grid_ui_stats(grid*, const basebox* boundary, fsstats*);
+
 /*void        grid_rt_process_intersort(grid*, bbt_t ph, bbt_t nph);*/
 
 void        grid_rt_process_intersort(grid*,    bbt_t ph,
@@ -36,6 +56,19 @@ void        grid_rt_process_intersort(grid*,    bbt_t ph,
                                                 jack_nframes_t nframes,
                                                 double frames_per_tick);
 
+/*  grid_rt_process_intersorts
+ *------------------------------
+ *  processes the intersorts of grids which output to the same midi out
+ *  ports (see grbound_manager_rt_group_grids) as one, earliest event
+ *  first, so that the MIDI output to each port is in order. each grid
+ *  still places within its own freespace.
+ */
+void        grid_rt_process_intersorts(grid** grids,    int count,
+                                                bbt_t ph,
+                                                bbt_t nph,
+                                                jack_nframes_t nframes,
+                                                double frames_per_tick);
+
 void        grid_rt_flush_intersort(    grid* gr,   bbt_t ph,
                                                     bbt_t nph,
                                                     jack_nframes_t nframes,
@@ -43,7 +76,7 @@ void        grid_rt_flush_intersort(    grid* gr,   bbt_t ph,
 
 /*  grid_rt_process_blocks
  *--------------------------
- *  process block events stored in the block port
+ *  process block events stored in the grid
  *      * check if block duration expired
  *      * if expired, move event from block port to unplace port.
  */
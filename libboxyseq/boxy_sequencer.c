@@ -4,14 +4,32 @@
 #include "debug.h"
 
 
+#include <glib.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>     /* sysconf */
 
 
 #include "include/boxy_sequencer_data.h"
 
 
+static void boxyseq_grids_free(boxyseq* bs)
+{
+    int g;
+
+    for (g = 0; g < bs->grid_count; ++g)
+    {
+        jack_ringbuffer_free(bs->ui_unplace_buf[g]);
+        jack_ringbuffer_free(bs->ui_note_off_buf[g]);
+        jack_ringbuffer_free(bs->ui_note_on_buf[g]);
+        grid_free(bs->grids[g]);
+    }
+
+    bs->grid_count = 0;
+}
+
+
 boxyseq* boxyseq_new(int argc, char** argv)
 {
     char* tmp;
@@ -38,28 +56,17 @@ boxyseq* boxyseq_new(int argc, char** argv)
     if (!(bs->ports_pattern =   evport_manager_new("pattern")))
         goto fail5;
 
-    if (!(bs->gr = grid_new()))
-        goto fail6;
-
-    bs->ui_note_on_buf = jack_ringbuffer_create(DEFAULT_EVBUF_SIZE
-                                                        * sizeof(event));
-    if (!bs->ui_note_on_buf)
-        goto fail7;
-
-    bs->ui_note_off_buf = jack_ringbuffer_create(DEFAULT_EVBUF_SIZE
-                                                        * sizeof(event));
-    if (!bs->ui_note_off_buf)
-        goto fail8;
+    bs->grid_count = 0;
+    bs->rt_grid_count = 0;
+    bs->workers = 0;
 
-    bs->ui_unplace_buf = jack_ringbuffer_create(DEFAULT_EVBUF_SIZE
-                                                        * sizeof(event));
-    if (!bs->ui_unplace_buf)
-        goto fail9;
+    if (boxyseq_grid_new(bs, FSWIDTH, FSHEIGHT) != 0)
+        goto fail6;
 
     bs->ui_input_buf = jack_ringbuffer_create(DEFAULT_EVBUF_SIZE
                                                         * sizeof(event));
     if (!bs->ui_input_buf)
-        goto fail10;
+        goto fail7;
 
     /*
     if (!jack_ringbuffer_mlock(bs->ui_note_on_buf)
@@ -67,25 +74,24 @@ boxyseq* boxyseq_new(int argc, char** argv)
      || !jack_ringbuffer_mlock(bs->ui_unplace_buf)
      || !jack_ringbuffer_mlock(bs->ui_input_buf))
     {
-        goto fail11;
+        goto fail8;
     }
     */
     if (!(bs->ui_eventlist = evlist_new()))
-        goto fail11;
+        goto fail8;
 
-    grid_set_ui_note_on_buf(bs->gr,     bs->ui_note_on_buf);
-    grid_set_ui_note_off_buf(bs->gr,    bs->ui_note_off_buf);
-    grid_set_ui_unplace_buf(bs->gr,     bs->ui_unplace_buf);
+    if (!(bs->timing = cytiming_new()))
+        goto fail9;
 
+    bs->journal = 0;
+    bs->replayed = 0;
     bs->rt_quitting = 0;
 
     return bs;
 
-fail11: jack_ringbuffer_free(bs->ui_input_buf);
-fail10: jack_ringbuffer_free(bs->ui_unplace_buf);
-fail9:  jack_ringbuffer_free(bs->ui_note_off_buf);
-fail8:  jack_ringbuffer_free(bs->ui_note_on_buf);
-fail7:  grid_free(bs->gr);
+fail9:  evlist_free(bs->ui_eventlist);
+fail8:  jack_ringbuffer_free(bs->ui_input_buf);
+fail7:  boxyseq_grids_free(bs);
 fail6:  evport_manager_free(bs->ports_pattern);
 fail5:  moport_manager_free(bs->moports);
 fail4:  grbound_manager_free(bs->grbounds);
@@ -102,14 +108,18 @@ void boxyseq_free(boxyseq* bs)
     if (!bs)
         return;
 
+    if (bs->replayed)
+        g_hash_table_destroy(bs->replayed);
+
+    wkpool_free(bs->workers);
+
+    cytiming_free(bs->timing);
+
     evlist_free(bs->ui_eventlist);
 
     jack_ringbuffer_free(bs->ui_input_buf);
-    jack_ringbuffer_free(bs->ui_unplace_buf);
-    jack_ringbuffer_free(bs->ui_note_off_buf);
-    jack_ringbuffer_free(bs->ui_note_on_buf);
 
-    grid_free(bs->gr);
+    boxyseq_grids_free(bs);
 
     evport_manager_free(bs->ports_pattern);
     moport_manager_free(bs->moports);
@@ -135,8 +145,20 @@ jackdata* boxyseq_jackdata(boxyseq* bs)
 
 void boxyseq_set_jackdata(boxyseq* bs, jackdata* jd)
 {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+
     bs->jd = jd;
     moport_manager_jack_client_set(bs->moports, jackdata_client(jd));
+
+    if (bs->workers)
+        return;
+
+    /* the RT thread works through the jobs too */
+    if (threads > BOXYSEQ_MAX_GRIDS - 1)
+        threads = BOXYSEQ_MAX_GRIDS - 1;
+
+    if (!(bs->workers = wkpool_new(jackdata_client(jd), threads)))
+        WARNING("grids will be processed one after another\n");
 }
 
 
@@ -164,23 +186,368 @@ moport_manager* boxyseq_moport_manager(boxyseq*bs)
 }
 
 
-jack_ringbuffer_t* boxyseq_ui_note_on_buf(const boxyseq* bs)
+cytiming* boxyseq_cycle_timing(boxyseq* bs)
+{
+    return bs->timing;
+}
+
+
+/*  journals what the scene just committed published. the boundaries
+    and patterns are found from their rtdata, the rest are lists.
+*/
+static void boxyseq_ui_published(rtdata* rt, void* data)
+{
+    boxyseq* bs = data;
+    grbound* grb;
+    pattern* pat;
+    evport* port;
+    int i;
+
+    if (rt == grbound_manager_rtdata(bs->grbounds))
+        jrnl_ui_list(bs->journal, JRNL_GRBOUNDS, rt, 0, 0);
+    else if (rt == pattern_manager_rtdata(bs->patterns))
+        jrnl_ui_list(bs->journal, JRNL_PATTERNS, rt, 0, 0);
+    else if (rt == evport_manager_rtdata(bs->ports_pattern))
+    {
+        for (i = 0; (port = evport_manager_evport_nth(bs->ports_pattern, i));
+                                                                        ++i)
+            jrnl_ui_list(bs->journal, JRNL_EVPORTS, rt, i,
+                                                    evport_flags(port));
+    }
+    else if (rt == moport_manager_rtdata(bs->moports))
+    {
+        for (i = 0; moport_manager_moport_nth(bs->moports, i); ++i)
+            jrnl_ui_list(bs->journal, JRNL_MOPORTS, rt, i, 0);
+    }
+    else if ((grb = grbound_manager_grbound_by_rtdata(bs->grbounds, rt)))
+    {
+        jrnl_ui_grbound(bs->journal, grb,
+                evport_manager_evport_index(bs->ports_pattern,
+                                            grbound_input_port(grb)),
+                moport_manager_moport_index(bs->moports,
+                                            grbound_midi_out_port(grb)));
+    }
+    else if ((pat = pattern_manager_pattern_by_rtdata(bs->patterns, rt)))
+    {
+        jrnl_ui_pattern(bs->journal, pat,
+                evport_manager_evport_index(bs->ports_pattern,
+                                            pattern_output_port(pat)));
+    }
+}
+
+
+void boxyseq_set_journal(boxyseq* bs, jrnl* jr)
+{
+    bs->journal = jr;
+    rtdata_ui_set_published_cb(jr ? boxyseq_ui_published : 0, bs);
+}
+
+
+jrnl* boxyseq_journal(boxyseq* bs)
+{
+    return bs->journal;
+}
+
+
+void boxyseq_ui_grbound_order(boxyseq* bs, grbound* grb, int dir)
+{
+    grbound_manager_grbound_order(bs->grbounds, grb, dir);
+    grbound_manager_update_rt_data(bs->grbounds);
+    jrnl_ui_grbound_order(bs->journal, bs->grbounds, grb, dir);
+}
+
+
+bool boxyseq_ui_input_event(boxyseq* bs, const event* ev)
+{
+    size_t sz = jack_ringbuffer_write(bs->ui_input_buf, (const char*)ev,
+                                                        sizeof(*ev));
+    if (sz != sizeof(*ev))
+    {
+        WARNING("failed to queue input event\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+
+bool boxyseq_ui_replay_ports(boxyseq* bs, jrnl* jr)
+{
+    size_t count = jrnl_record_count(jr);
+    size_t i;
+
+    for (i = 0; i < count; ++i)
+    {
+        const jrnlrec* rec = jrnl_record(jr, i);
+
+        if (rec->type == JRNL_EVPORTS)
+        {
+            while (!evport_manager_evport_nth(bs->ports_pattern, rec->port))
+            {
+                if (!evport_manager_evport_new(bs->ports_pattern,
+                                                "replay", rec->flags))
+                    return 0;
+            }
+        }
+        else if (rec->type == JRNL_MOPORTS)
+        {
+            while (!moport_manager_moport_nth(bs->moports, rec->port))
+            {
+                if (!moport_manager_moport_new(bs->moports))
+                    return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+
+/*  the boundary or pattern made in place of the one journaled as id,
+    making it first if need be.
+*/
+static void* boxyseq_replayed(boxyseq* bs, const jrnlrec* rec)
+{
+    void* obj;
+
+    if (!bs->replayed && !(bs->replayed = g_hash_table_new(g_direct_hash,
+                                                            g_direct_equal)))
+        return 0;
+
+    if ((obj = g_hash_table_lookup(bs->replayed, GUINT_TO_POINTER(rec->id))))
+        return obj;
+
+    switch (rec->type)
+    {
+    case JRNL_GRBOUND:
+        obj = grbound_manager_grbound_new(bs->grbounds);
+        break;
+
+    case JRNL_PATTERN:
+        obj = pattern_manager_pattern_new(bs->patterns);
+        break;
+
+    default:
+        WARNING("journal %u is not in the session\n", rec->id);
+        return 0;
+    }
+
+    if (obj)
+        g_hash_table_insert(bs->replayed, GUINT_TO_POINTER(rec->id), obj);
+
+    return obj;
+}
+
+
+static bool boxyseq_ui_replay_pattern(boxyseq* bs, pattern* pat,
+                                                   const jrnlrec* rec)
+{
+    evlist* el = pattern_event_list(pat);
+    size_t i;
+
+    pattern_state_set(pat, &rec->pat);
+    pattern_set_output_port(pat,
+                    evport_manager_evport_nth(bs->ports_pattern, rec->port));
+
+    evlist_delete(el, false);
+
+    for (i = 0; i < rec->event_count; ++i)
+    {
+        event* ev = event_new();
+
+        if (!ev)
+            return 0;
+
+        /* bytes and all, as the pattern compares them when updated */
+        memcpy(ev, &rec->events[i], sizeof(*ev));
+
+        if (!evlist_add_event(el, ev))
+        {
+            free(ev);
+            return 0;
+        }
+    }
+
+    pattern_update_rt_data(pat);
+
+    return 1;
+}
+
+
+bool boxyseq_ui_replay(boxyseq* bs, const jrnlrec* rec)
 {
-    return bs->ui_note_on_buf;
+    grbound* grb;
+
+    switch (rec->type)
+    {
+    case JRNL_GRBOUND:
+        if (!(grb = boxyseq_replayed(bs, rec)))
+            return 0;
+
+        grbound_state_set(grb, &rec->grb);
+        grbound_set_input_port(grb,
+                    evport_manager_evport_nth(bs->ports_pattern, rec->port));
+        grbound_midi_out_port_set(grb,
+                    moport_manager_moport_nth(bs->moports, rec->moport));
+        grbound_update_rt_data(grb);
+        return 1;
+
+    case JRNL_GRBOUND_ORDER:
+        if (!(grb = boxyseq_replayed(bs, rec)))
+            return 0;
+
+        boxyseq_ui_grbound_order(bs, grb, rec->dir);
+        return 1;
+
+    case JRNL_PATTERN:
+    {
+        pattern* pat = boxyseq_replayed(bs, rec);
+        return pat && boxyseq_ui_replay_pattern(bs, pat, rec);
+    }
+
+    case JRNL_GRBOUNDS:
+        grbound_manager_update_rt_data(bs->grbounds);
+        return 1;
+
+    case JRNL_PATTERNS:
+        pattern_manager_update_rt_data(bs->patterns);
+        return 1;
+
+    case JRNL_EVPORTS:
+        evport_manager_update_rt_data(bs->ports_pattern);
+        return 1;
+
+    case JRNL_MOPORTS:
+        moport_manager_update_rt_data(bs->moports);
+        return 1;
+
+    default:
+        WARNING("not a journaled change\n");
+        return 0;
+    }
 }
 
-jack_ringbuffer_t* boxyseq_ui_note_off_buf(const boxyseq* bs)
+
+int boxyseq_grid_new(boxyseq* bs, int width, int height)
 {
-    return bs->ui_note_off_buf;
+    int g = bs->grid_count;
+    grid* gr;
+
+    if (g == BOXYSEQ_MAX_GRIDS)
+    {
+        WARNING("no more than %d grids\n", BOXYSEQ_MAX_GRIDS);
+        return -1;
+    }
+
+    if (!(gr = grid_new(g, width, height)))
+        goto fail0;
+
+    bs->ui_note_on_buf[g] = jack_ringbuffer_create(DEFAULT_EVBUF_SIZE
+                                                        * sizeof(event));
+    if (!bs->ui_note_on_buf[g])
+        goto fail1;
+
+    bs->ui_note_off_buf[g] = jack_ringbuffer_create(DEFAULT_EVBUF_SIZE
+                                                        * sizeof(event));
+    if (!bs->ui_note_off_buf[g])
+        goto fail2;
+
+    bs->ui_unplace_buf[g] = jack_ringbuffer_create(DEFAULT_EVBUF_SIZE
+                                                        * sizeof(event));
+    if (!bs->ui_unplace_buf[g])
+        goto fail3;
+
+    grid_set_ui_note_on_buf(gr,     bs->ui_note_on_buf[g]);
+    grid_set_ui_note_off_buf(gr,    bs->ui_note_off_buf[g]);
+    grid_set_ui_unplace_buf(gr,     bs->ui_unplace_buf[g]);
+
+    bs->grids[g] = gr;
+    bs->intersorts[g] = grid_get_intersort(gr);
+
+    /* only now may the RT thread see it */
+    g_atomic_int_set(&bs->grid_count, g + 1);
+
+    return g;
+
+fail3:  jack_ringbuffer_free(bs->ui_note_off_buf[g]);
+fail2:  jack_ringbuffer_free(bs->ui_note_on_buf[g]);
+fail1:  grid_free(gr);
+fail0:  WARNING("failed to create grid\n");
+    return -1;
+}
+
+
+int boxyseq_grid_count(boxyseq* bs)
+{
+    return bs->grid_count;
 }
 
-jack_ringbuffer_t* boxyseq_ui_unplace_buf(const boxyseq* bs)
+
+grid* boxyseq_grid(boxyseq* bs, int index)
 {
-    return bs->ui_unplace_buf;
+    return (index < 0 || index >= bs->grid_count) ? 0 : bs->grids[index];
+}
+
+
+void boxyseq_ui_grbound_stats(boxyseq* bs, grbound* grb, fsstats* st)
+{
+    grid* gr = boxyseq_grid(bs, grbound_grid(grb));
+    basebox box;
+
+    if (!gr)
+    {
+        memset(st, 0, sizeof(*st));
+        return;
+    }
+
+    grbound_fsbound_get(grb, &box.x, &box.y, &box.w, &box.h);
+    grid_ui_stats(gr, &box, st);
+}
+
+
+void boxyseq_ui_stats_dump(boxyseq* bs)
+{
+    grbound* grb;
+    fsstats st;
+    int g, n = 0;
+
+    for (g = 0; g < bs->grid_count; ++g)
+    {
+        MESSAGE("grid %d:\n", g);
+        grid_ui_stats(bs->grids[g], 0, &st);
+        freespace_stats_dump(&st);
+    }
+
+    grb = grbound_manager_grbound_first(bs->grbounds);
+
+    while (grb)
+    {
+        MESSAGE("boundary %d (grid %d):\n", n++, grbound_grid(grb));
+        boxyseq_ui_grbound_stats(bs, grb, &st);
+        freespace_stats_dump(&st);
+        grb = grbound_manager_grbound_next(bs->grbounds);
+    }
+}
+
+
+jack_ringbuffer_t* boxyseq_ui_note_on_buf(const boxyseq* bs, int grid)
+{
+    return bs->ui_note_on_buf[grid];
+}
+
+jack_ringbuffer_t* boxyseq_ui_note_off_buf(const boxyseq* bs, int grid)
+{
+    return bs->ui_note_off_buf[grid];
+}
+
+jack_ringbuffer_t* boxyseq_ui_unplace_buf(const boxyseq* bs, int grid)
+{
+    return bs->ui_unplace_buf[grid];
 }
 
 
 void boxyseq_ui_place_static_block( const boxyseq* bs,
+                                    int grid,
                                     int x,      int y,
                                     int width,  int height)
 {
@@ -192,6 +559,7 @@ void boxyseq_ui_place_static_block( const boxyseq* bs,
     ev.box.y = y;
     ev.box.w = width;
     ev.box.h = height;
+    ev.grid = grid;
 
     EVENT_SET_TYPE( &ev, EV_TYPE_STATIC );
     EVENT_SET_STATUS_ON( &ev );
@@ -207,12 +575,38 @@ void boxyseq_rt_init_jack_cycle(boxyseq* bs, jack_nframes_t nframes)
 }
 
 
+/*  processes the blocks and intersorts of the grids grouped under the grid
+    rt_jobs[job], and publishes their stats.
+*/
+static void boxyseq_rt_process_grids(void* arg, int job)
+{
+    boxyseq* bs = arg;
+    grid* grids[BOXYSEQ_MAX_GRIDS];
+    int lead = bs->rt_jobs[job];
+    int g, count = 0;
+
+    for (g = lead; g < bs->rt_grid_count; ++g)
+    {
+        if (bs->rt_group[g] != lead)
+            continue;
+
+        grid_rt_process_blocks(bs->grids[g], bs->rt_ph, bs->rt_nph);
+        grids[count++] = bs->grids[g];
+    }
+
+    grid_rt_process_intersorts(grids, count, bs->rt_ph, bs->rt_nph,
+                                bs->rt_nframes, bs->rt_frames_per_tick);
+
+    for (g = 0; g < count; ++g)
+        grid_rt_publish_stats(grids[g]);
+}
+
+
 void boxyseq_rt_play(boxyseq* bs,
                      jack_nframes_t nframes,
-                     bool repositioned,
                      bbt_t ph, bbt_t nph)
 {
-    evport* intersort;
+    int g, jobs = 0;
 
     if (bs->rt_quitting)
         return;
@@ -222,6 +616,7 @@ void boxyseq_rt_play(boxyseq* bs,
         event ev;
 
         jack_ringbuffer_read(bs->ui_input_buf, (char*)&ev, sizeof(ev));
+        jrnl_rt_input(bs->journal, &ev);
 
         switch(EVENT_GET_TYPE( &ev ))
         {
@@ -232,7 +627,12 @@ void boxyseq_rt_play(boxyseq* bs,
             return;
 
         case EV_TYPE_STATIC:
-            if (!grid_rt_add_block_area(bs->gr, ev.box.x, ev.box.y,
+            if (ev.grid < 0 || ev.grid >= g_atomic_int_get(&bs->grid_count))
+            {
+                WARNING("block-area for unknown grid %d\n", ev.grid);
+            }
+            else if (!grid_rt_add_block_area(bs->grids[ev.grid],
+                                                ev.box.x, ev.box.y,
                                                 ev.box.w, ev.box.h))
             {
                 WARNING("failed to add block-area\n");
@@ -249,14 +649,49 @@ void boxyseq_rt_play(boxyseq* bs,
         }
     }
 
-    intersort = grid_get_intersort(bs->gr);
-    moport_manager_rt_pull_ending(bs->moports, ph, nph, intersort);
+    cytiming_rt_begin(bs->timing);
+
+    bs->rt_grid_count = g_atomic_int_get(&bs->grid_count);
+
+    memset(bs->rt_joins, 0, sizeof(bs->rt_joins));
+
+    moport_manager_rt_pull_ending(bs->moports, ph, nph, bs->intersorts,
+                                                    bs->rt_joins,
+                                                    bs->rt_grid_count);
+    cytiming_rt_stage(bs->timing, CYTIMING_PULL_ENDING);
+
     evport_manager_rt_clear_all(bs->ports_pattern);
-    pattern_manager_rt_play(bs->patterns, repositioned, ph, nph);
-    grbound_manager_rt_pull_starting(bs->grbounds, intersort);
-    grid_rt_process_blocks(bs->gr, ph, nph);
-    grid_rt_process_intersort(bs->gr, ph, nph, nframes,
-                        jackdata_rt_transport_frames_per_tick(bs->jd));
+    pattern_manager_rt_play(bs->patterns, ph, nph);
+    cytiming_rt_stage(bs->timing, CYTIMING_PATTERN_PLAY);
+
+    grbound_manager_rt_pull_starting(bs->grbounds, bs->intersorts,
+                                                    bs->rt_grid_count);
+    cytiming_rt_stage(bs->timing, CYTIMING_PULL_STARTING);
+
+    grbound_manager_rt_group_grids(bs->grbounds, bs->rt_group,
+                                                    bs->rt_joins,
+                                                    bs->rt_grid_count);
+
+    for (g = 0; g < bs->rt_grid_count; ++g)
+        if (bs->rt_group[g] == g)
+            bs->rt_jobs[jobs++] = g;
+
+    bs->rt_ph = ph;
+    bs->rt_nph = nph;
+    bs->rt_nframes = nframes;
+    bs->rt_frames_per_tick = jackdata_rt_transport_frames_per_tick(bs->jd);
+
+    if (bs->workers)
+        wkpool_rt_run(bs->workers, boxyseq_rt_process_grids, bs, jobs);
+    else
+    {
+        for (g = 0; g < jobs; ++g)
+            boxyseq_rt_process_grids(bs, g);
+    }
+
+    cytiming_rt_stage(bs->timing, CYTIMING_PROCESS_GRIDS);
+
+    cytiming_rt_end(bs->timing);
 }
 
 
@@ -266,22 +701,32 @@ void boxyseq_rt_clear(boxyseq* bs, bbt_t ph, bbt_t nph,
     event ev;
     size_t sz;
 
+    int g, count = g_atomic_int_get(&bs->grid_count);
+
     DMESSAGE("clearing... ph:%d nph:%d\n", ph, nph);
 
-    evport* intersort = grid_get_intersort(bs->gr);
     evport_manager_rt_clear_all(bs->ports_pattern);
-    moport_manager_rt_pull_playing_and_empty(bs->moports, 0, 4, intersort);
+    moport_manager_rt_pull_playing_and_empty(bs->moports, 0, 4,
+                                            bs->intersorts, count);
     grbound_manager_rt_empty_incoming(bs->grbounds);
-    grid_rt_flush_blocks_to_intersort(bs->gr);
-    grid_rt_flush_intersort(bs->gr, 0, 4, nframes,
+
+    for (g = 0; g < count; ++g)
+    {
+        grid_rt_flush_blocks_to_intersort(bs->grids[g]);
+        grid_rt_flush_intersort(bs->grids[g], 0, 4, nframes,
                             jackdata_rt_transport_frames_per_tick(bs->jd));
+    }
 
     EVENT_SET_TYPE(&ev, EV_TYPE_CLEAR);
-    sz = jack_ringbuffer_write(bs->ui_unplace_buf, (char*)&ev, sizeof(ev));
 
-    if (sz != sizeof(ev))
+    for (g = 0; g < count; ++g)
     {
-        DWARNING("failed to queue clear-event\n");
+        sz = jack_ringbuffer_write(bs->ui_unplace_buf[g], (char*)&ev,
+                                                        sizeof(ev));
+        if (sz != sizeof(ev))
+        {
+            DWARNING("failed to queue clear-event\n");
+        }
     }
 }
 
@@ -309,16 +754,17 @@ void boxyseq_shutdown(boxyseq* bs)
 }
 
 
-int boxyseq_ui_collect_events(boxyseq* bs)
+static int boxyseq_ui_collect_grid_events(boxyseq* bs, int g)
 {
     int ret = 0;
     int dump = 0;
 
-    while (jack_ringbuffer_read_space(bs->ui_note_on_buf) >= sizeof(event))
+    while (jack_ringbuffer_read_space(bs->ui_note_on_buf[g])
+                                                    >= sizeof(event))
     {
         event evin;
 
-        jack_ringbuffer_read(bs->ui_note_on_buf, (char*)&evin,
+        jack_ringbuffer_read(bs->ui_note_on_buf[g], (char*)&evin,
                                                   sizeof(evin));
 
         if (dump)
@@ -328,12 +774,13 @@ int boxyseq_ui_collect_events(boxyseq* bs)
         ret = 1;
     }
 
-    while (jack_ringbuffer_read_space(bs->ui_unplace_buf) >= sizeof(event))
+    while (jack_ringbuffer_read_space(bs->ui_unplace_buf[g])
+                                                    >= sizeof(event))
     {
         lnode* ln;
         event evin;
 
-        jack_ringbuffer_read(bs->ui_unplace_buf, (char*)&evin,
+        jack_ringbuffer_read(bs->ui_unplace_buf[g], (char*)&evin,
                                                   sizeof(evin));
 
         if (EVENT_IS_TYPE( &evin, EV_TYPE_CLEAR ))
@@ -353,7 +800,8 @@ int boxyseq_ui_collect_events(boxyseq* bs)
             event* ev = lnode_data(ln);
             lnode* nln = lnode_next(ln);
 
-            if (ev->box.x == evin.box.x
+            if (ev->grb == evin.grb
+             && ev->box.x == evin.box.x
              && ev->box.y == evin.box.y
              && ev->box.w == evin.box.w
              && ev->box.h == evin.box.h)
@@ -370,12 +818,13 @@ int boxyseq_ui_collect_events(boxyseq* bs)
     if (dump)
         DMESSAGE("------ read ui note off buf\n");
 
-    while (jack_ringbuffer_read_space(bs->ui_note_off_buf) >= sizeof(event))
+    while (jack_ringbuffer_read_space(bs->ui_note_off_buf[g])
+                                                    >= sizeof(event))
     {
         lnode* ln;
         event evin;
 
-        jack_ringbuffer_read(bs->ui_note_off_buf, (char*)&evin,
+        jack_ringbuffer_read(bs->ui_note_off_buf[g], (char*)&evin,
                                                    sizeof(evin));
         ln = evlist_head(bs->ui_eventlist);
 
@@ -386,7 +835,8 @@ int boxyseq_ui_collect_events(boxyseq* bs)
         {
             event* ev = lnode_data(ln);
 
-            if (ev->box.x == evin.box.x
+            if (ev->grb == evin.grb
+             && ev->box.x == evin.box.x
              && ev->box.y == evin.box.y
              && ev->box.w == evin.box.w
              && ev->box.h == evin.box.h)
@@ -406,6 +856,17 @@ int boxyseq_ui_collect_events(boxyseq* bs)
 }
 
 
+int boxyseq_ui_collect_events(boxyseq* bs)
+{
+    int g, ret = 0;
+
+    for (g = 0; g < bs->grid_count; ++g)
+        ret |= boxyseq_ui_collect_grid_events(bs, g);
+
+    return ret;
+}
+
+
 evlist* boxyseq_ui_event_list(boxyseq* bs)
 {
     return bs->ui_eventlist;
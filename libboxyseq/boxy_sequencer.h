@@ -7,22 +7,37 @@ extern "C" {
 #endif
 
 
+#include "box_grid.h"
 #include "boxyseq_types.h"
 #include "common.h"
+#include "cycle_timing.h"
 #include "event_port_manager.h"
 #include "freespace_state.h"
 #include "grbound_manager.h"
 #include "jack_process.h"
+#include "journal.h"
 #include "moport_manager.h"
 #include "pattern_manager.h"
 #include "real_time_data.h"
+#include "worker_pool.h"
 
 
+#include <glib.h>
 #include <stdbool.h>
 #include <jack/jack.h>
 #include <jack/ringbuffer.h>
 
 
+/*  the most grids a boxyseq can host (no more than 32, the grids to
+    group together are kept as bits, see moport_rt_pull_ending)
+*/
+#define BOXYSEQ_MAX_GRIDS   16
+
+#if BOXYSEQ_MAX_GRIDS > 32
+#error BOXYSEQ_MAX_GRIDS must be no more than 32
+#endif
+
+
 #include "include/boxy_sequencer_data.h"
 
 
@@ -43,12 +58,65 @@ grbound_manager*    boxyseq_grbound_manager(boxyseq*);
 moport_manager*     boxyseq_moport_manager( boxyseq*);
 evport_manager*     boxyseq_pattern_port_manager(boxyseq*);
 
-
-jack_ringbuffer_t*  boxyseq_ui_note_on_buf( const boxyseq*);
-jack_ringbuffer_t*  boxyseq_ui_note_off_buf(const boxyseq*);
-jack_ringbuffer_t*  boxyseq_ui_unplace_buf( const boxyseq*);
+cytiming*           boxyseq_cycle_timing(boxyseq*);
+
+
+/*  journal
+ *-----------
+ *  boxyseq_set_journal attaches a journal recording what enters the RT
+ *  side (see journal.h), everything published by the boxyseq's managers
+ *  and what they manage included. it must be set before the session is
+ *  built and the jackdata started, and outlive it. boundaries should be
+ *  moved in the order through boxyseq_ui_grbound_order, in place of
+ *  grbound_manager_grbound_order, so it is journaled.
+ *
+ *  boxyseq_ui_input_event and boxyseq_ui_replay feed journaled UI input
+ *  and changes back in for replay, which builds the session in an
+ *  empty boxyseq (but for its grids). boxyseq_ui_replay_ports makes the
+ *  ports the journal lists beforehand, the changes publish them.
+ */
+void                boxyseq_set_journal(boxyseq*, jrnl*);
+jrnl*               boxyseq_journal(boxyseq*);
+
+void                boxyseq_ui_grbound_order(boxyseq*, grbound*, int dir);
+
+bool                boxyseq_ui_input_event(boxyseq*, const event*);
+bool                boxyseq_ui_replay_ports(boxyseq*, jrnl*);
+bool                boxyseq_ui_replay(boxyseq*, const jrnlrec*);
+
+
+/*  grids
+ *---------
+ *  a boxyseq starts with a single grid, grid 0, FSWIDTH x FSHEIGHT.
+ *  boxyseq_grid_new adds another, width x height and no larger, with
+ *  its own freespace, block events and intersort, and returns its
+ *  index, or -1 on failure. boundaries are placed within a grid by
+ *  grbound_grid_set, and a smaller grid searches faster.
+ *
+ *  each cycle the grids are processed in parallel by a pool of worker
+ *  threads, except grids whose boundaries output to the same midi out
+ *  port, which are processed together. so boundaries which have nothing
+ *  to do with each other should be given grids and midi out ports of
+ *  their own.
+ */
+int                 boxyseq_grid_new(boxyseq*, int width, int height);
+int                 boxyseq_grid_count(boxyseq*);
+grid*               boxyseq_grid(boxyseq*, int index);
+
+/*  boxyseq_ui_grbound_stats measures the space within the boundary in the
+ *  most recent copy of its grid (see grid_ui_stats). boxyseq_ui_stats_dump
+ *  prints the stats of every grid and every boundary within them.
+ */
+void                boxyseq_ui_grbound_stats(boxyseq*, grbound*, fsstats*);
+void                boxyseq_ui_stats_dump(boxyseq*);
+
+
+jack_ringbuffer_t*  boxyseq_ui_note_on_buf( const boxyseq*, int grid);
+jack_ringbuffer_t*  boxyseq_ui_note_off_buf(const boxyseq*, int grid);
+jack_ringbuffer_t*  boxyseq_ui_unplace_buf( const boxyseq*, int grid);
 
 void            boxyseq_ui_place_static_block(  const boxyseq*,
+                                                int grid,
                                                 int x,      int y,
                                                 int width,  int height);
 
@@ -61,7 +129,6 @@ void            boxyseq_rt_init_jack_cycle(boxyseq*, jack_nframes_t);
 
 void            boxyseq_rt_play(boxyseq*,
                                 jack_nframes_t,
-                                bool repositioned,
                                 bbt_t ph, bbt_t nph);
 
 
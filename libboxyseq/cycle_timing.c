@@ -0,0 +1,238 @@
+#include "cycle_timing.h"
+
+
+#include "debug.h"
+
+
+#include <glib.h>
+#include <jack/ringbuffer.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/* snapshots held by the ringbuffer */
+#define CYTIMING_RING_SIZE 4
+
+/* cycles between publishing snapshots */
+#define CYTIMING_PUBLISH_INTERVAL 8
+
+
+struct cycle_timing
+{
+    /* RT thread only */
+    cystats     rt_stats;
+    uint64_t    cycle_start_ns;
+    uint64_t    stage_start_ns;
+    int         publish_countdown;
+
+    gint        reset_request;
+
+    jack_ringbuffer_t*  ring;
+
+    /* UI only */
+    cystats     ui_stats;
+};
+
+
+static const char* stage_names[CYTIMING_STAGE_COUNT] =
+{
+    "pull ending",
+    "pattern play",
+    "pull starting",
+    "process grids",
+    "cycle"
+};
+
+
+static void cystats_init(cystats* stats)
+{
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+
+    for (i = 0; i < CYTIMING_STAGE_COUNT; ++i)
+        stats->stage[i].min_ns = UINT32_MAX;
+}
+
+
+cytiming* cytiming_new(void)
+{
+    cytiming* cyt = malloc(sizeof(*cyt));
+
+    if (!cyt)
+        goto fail0;
+
+    cyt->ring = jack_ringbuffer_create(CYTIMING_RING_SIZE
+                                                * sizeof(cystats));
+    if (!cyt->ring)
+        goto fail1;
+
+    cystats_init(&cyt->rt_stats);
+    cystats_init(&cyt->ui_stats);
+
+    cyt->cycle_start_ns = 0;
+    cyt->stage_start_ns = 0;
+    cyt->publish_countdown = CYTIMING_PUBLISH_INTERVAL;
+    cyt->reset_request = 0;
+
+    return cyt;
+
+fail1:  free(cyt);
+fail0:  WARNING("out of memory allocating cycle timing\n");
+    return 0;
+}
+
+
+void cytiming_free(cytiming* cyt)
+{
+    if (!cyt)
+        return;
+
+    jack_ringbuffer_free(cyt->ring);
+    free(cyt);
+}
+
+
+static inline uint64_t cytiming_rt_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static inline int cytiming_histogram_bin(uint32_t ns)
+{
+    return ns ? 31 - __builtin_clz(ns) : 0;
+}
+
+
+static void cytiming_rt_accumulate(cystage* st, uint64_t dt)
+{
+    uint32_t ns = (dt > UINT32_MAX) ? UINT32_MAX : (uint32_t)dt;
+
+    ++st->count;
+    st->total_ns += ns;
+
+    if (ns < st->min_ns)
+        st->min_ns = ns;
+
+    if (ns > st->max_ns)
+        st->max_ns = ns;
+
+    ++st->histogram[cytiming_histogram_bin(ns)];
+}
+
+
+void cytiming_rt_begin(cytiming* cyt)
+{
+    if (g_atomic_int_get(&cyt->reset_request))
+    {
+        cystats_init(&cyt->rt_stats);
+        g_atomic_int_set(&cyt->reset_request, 0);
+    }
+
+    cyt->cycle_start_ns = cyt->stage_start_ns = cytiming_rt_now();
+}
+
+
+void cytiming_rt_stage(cytiming* cyt, int stage)
+{
+    uint64_t now = cytiming_rt_now();
+
+    cytiming_rt_accumulate(&cyt->rt_stats.stage[stage],
+                            now - cyt->stage_start_ns);
+    cyt->stage_start_ns = now;
+}
+
+
+void cytiming_rt_end(cytiming* cyt)
+{
+    cytiming_rt_accumulate(&cyt->rt_stats.stage[CYTIMING_CYCLE],
+                            cyt->stage_start_ns - cyt->cycle_start_ns);
+    ++cyt->rt_stats.cycles;
+
+    if (--cyt->publish_countdown > 0)
+        return;
+
+    /* if the reader isn't keeping up, try again next cycle */
+    if (jack_ringbuffer_write_space(cyt->ring) < sizeof(cystats))
+        return;
+
+    jack_ringbuffer_write(cyt->ring, (const char*)&cyt->rt_stats,
+                                                sizeof(cystats));
+    cyt->publish_countdown = CYTIMING_PUBLISH_INTERVAL;
+}
+
+
+bool cytiming_ui_update(cytiming* cyt)
+{
+    bool ret = 0;
+
+    while (jack_ringbuffer_read_space(cyt->ring) >= sizeof(cystats))
+    {
+        jack_ringbuffer_read(cyt->ring, (char*)&cyt->ui_stats,
+                                                sizeof(cystats));
+        ret = 1;
+    }
+
+    return ret;
+}
+
+
+const cystats* cytiming_ui_stats(cytiming* cyt)
+{
+    return &cyt->ui_stats;
+}
+
+
+void cytiming_ui_reset(cytiming* cyt)
+{
+    g_atomic_int_set(&cyt->reset_request, 1);
+}
+
+
+const char* cytiming_stage_name(int stage)
+{
+    if (stage < 0 || stage >= CYTIMING_STAGE_COUNT)
+        return "unknown";
+
+    return stage_names[stage];
+}
+
+
+void cytiming_stats_dump(const cystats* stats)
+{
+    int i, n;
+
+    MESSAGE("cycle timing over %llu cycles (ns):\n",
+            (unsigned long long)stats->cycles);
+
+    for (i = 0; i < CYTIMING_STAGE_COUNT; ++i)
+    {
+        const cystage* st = &stats->stage[i];
+        char buf[CYTIMING_HISTOGRAM_BINS * 12];
+        int len = 0;
+
+        if (!st->count)
+            continue;
+
+        MESSAGE("%20s: min:%u mean:%llu max:%u\n",
+                cytiming_stage_name(i),
+                st->min_ns,
+                (unsigned long long)(st->total_ns / st->count),
+                st->max_ns);
+
+        buf[0] = '\0';
+
+        for (n = 0; n < CYTIMING_HISTOGRAM_BINS; ++n)
+        {
+            if (st->histogram[n])
+                len += snprintf(buf + len, sizeof(buf) - len, " 2^%d:%u",
+                                                    n, st->histogram[n]);
+        }
+
+        MESSAGE("%20s %s\n", "", buf);
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef CYCLE_TIMING_H
+#define CYCLE_TIMING_H
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/*  cycle timing
+ *----------------
+ *  measures how long each stage of boxyseq_rt_play takes. the RT
+ *  thread takes a timestamp (CLOCK_MONOTONIC) as each stage completes
+ *  and accumulates the time into per-stage min/mean/max and a log2
+ *  histogram. every so often the accumulated stats are copied into a
+ *  (lock-free) JACK ringbuffer for the UI side to pick up.
+ *
+ *  cytiming_rt_* functions are for the RT thread only, cytiming_ui_*
+ *  functions are for a single non-RT reader only.
+ */
+
+
+enum CYCLE_TIMING_STAGES
+{
+    CYTIMING_PULL_ENDING = 0,   /* moport_manager_rt_pull_ending      */
+    CYTIMING_PATTERN_PLAY,      /* clear pattern ports + pattern play */
+    CYTIMING_PULL_STARTING,     /* grbound_manager_rt_pull_starting   */
+    CYTIMING_PROCESS_GRIDS,     /* blocks and intersort of every grid */
+    CYTIMING_CYCLE,             /* all of the above                   */
+
+    CYTIMING_STAGE_COUNT
+};
+
+
+/* bin n counts durations of [2^n, 2^(n+1)) nanoseconds */
+#define CYTIMING_HISTOGRAM_BINS 32
+
+
+typedef struct cycle_timing_stage
+{
+    uint64_t    count;
+    uint64_t    total_ns;
+    uint32_t    min_ns;
+    uint32_t    max_ns;
+
+    uint32_t    histogram[CYTIMING_HISTOGRAM_BINS];
+
+} cystage;
+
+
+typedef struct cycle_timing_stats
+{
+    uint64_t    cycles;
+    cystage     stage[CYTIMING_STAGE_COUNT];
+
+} cystats;
+
+
+typedef struct cycle_timing cytiming;
+
+
+cytiming*   cytiming_new(void);
+void        cytiming_free(cytiming*);
+
+void        cytiming_rt_begin(cytiming*);
+void        cytiming_rt_stage(cytiming*, int stage);
+void        cytiming_rt_end(cytiming*);
+
+/*  cytiming_ui_update: reads the most recently published stats from the
+                        ringbuffer. returns true if there were any.
+*/
+bool            cytiming_ui_update(cytiming*);
+const cystats*  cytiming_ui_stats(cytiming*);
+
+/*  cytiming_ui_reset:  asks the RT thread to start accumulating afresh.
+*/
+void            cytiming_ui_reset(cytiming*);
+
+const char*     cytiming_stage_name(int stage);
+void            cytiming_stats_dump(const cystats*);
+
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+
+
+#endif
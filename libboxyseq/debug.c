@@ -8,25 +8,87 @@
 
 #include "debug.h"
 
-#include <string.h>
-#include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* messages held by the ring, a power of two */
+#define DEBUG_LOG_SIZE      512
+
+/* the most arguments kept, and bytes of strings copied, for a message */
+#define DEBUG_LOG_ARGS      16
+#define DEBUG_LOG_STRINGS   64
+
+
+typedef union debug_log_arg
+{
+    long long           i;
+    unsigned long long  u;
+    double              d;
+    const void*         p;
+    size_t              str;    /* offset of the copy in strings */
+
+} dbarg;
+
+
+typedef struct debug_log_record
+{
+    /*  the lap of the ring the record was last written or read in, plus
+        one while it holds a message. as the records start zeroed, the
+        ring starts empty without having to be initialized.
+    */
+    unsigned    seq;
+
+    warning_t   level;
+    const char* file;
+    const char* function;
+    size_t      line;
+    const char* fmt;
+
+    int         nargs;
+    dbarg       arg[DEBUG_LOG_ARGS];
+    char        strings[DEBUG_LOG_STRINGS];
+
+} dbrec;
+
+
+/* a conversion specification within a format */
+typedef struct debug_log_spec
+{
+    const char* start;      /* the '%' */
+    int         flags_len;  /* of the flags, width and precision */
+    int         len;        /* of the whole specification */
+    int         stars;      /* '*' width and precision arguments */
+    char        length;     /* 'H' hh, 'h', 'l', 'L' ll, 'D' L, 'z' ... */
+    char        conv;
+
+} dbspec;
+
 
 static size_t src_dir_len = 0;
 
-void
-warnf(  warning_t level,
-        const char *file,
-        const char *function, size_t line, const char *fmt, ... )
+static __thread int debug_is_rt = 0;
+
+static dbrec        debug_log[DEBUG_LOG_SIZE];
+static unsigned     debug_log_head = 0;
+static unsigned     debug_log_tail = 0;
+static int          debug_log_draining = 0;
+static unsigned long debug_log_drops = 0;
+static unsigned long debug_log_drops_told = 0;
+
+
+static void warn_begin( FILE* fp,   warning_t level,
+                        const char *file,
+                        const char *function, size_t line )
 {
-    va_list args;
     static const char *level_tab[] = {
         "message", "\033[1;32m",
         "warning", "\07\033[1;33m",
     };
 
-    FILE *fp = W_MESSAGE == level ? stdout : stderr;
-
     #ifndef NDEBUG
 
     if (!src_dir_len)
@@ -52,6 +114,368 @@ warnf(  warning_t level,
     {
         fprintf( fp, "%s", level_tab[( level << 1 ) + 1] );
     }
+}
+
+
+static void warn_end(FILE* fp)
+{
+    fprintf( fp, "\033[0m" );
+}
+
+
+/*  finds the next conversion specification in fmt. returns 0 if there
+    are no more, or the specification is not one the log understands
+    (which includes more than a width and a precision given by '*').
+*/
+static const char* debug_log_spec(const char* fmt, dbspec* sp)
+{
+    const char* p = strchr(fmt, '%');
+
+    if (!p)
+        return 0;
+
+    sp->start = p++;
+    sp->stars = 0;
+    sp->length = 0;
+
+    while (*p && strchr("-+ #0", *p))
+        ++p;
+
+    for (; *p == '*' || (*p >= '0' && *p <= '9') || *p == '.'; ++p)
+        if (*p == '*')
+            ++sp->stars;
+
+    if (sp->stars > 2)
+        return 0;
+
+    sp->flags_len = p - sp->start - 1;
+
+    switch (*p)
+    {
+    case 'h':   sp->length = (p[1] == 'h') ? (++p, 'H') : 'h';  ++p; break;
+    case 'l':   sp->length = (p[1] == 'l') ? (++p, 'L') : 'l';  ++p; break;
+    case 'L':   sp->length = 'D';   ++p; break;
+    case 'z': case 'j': case 't':
+                sp->length = *p++;  break;
+    }
+
+    if (!*p || !strchr("diuoxXcfFeEgGaAspn%", *p))
+        return 0;
+
+    sp->conv = *p++;
+    sp->len = p - sp->start;
+
+    return p;
+}
+
+
+static void debug_log_capture(dbrec* rec, const char* fmt, va_list args)
+{
+    size_t strings = 0;
+    dbspec sp;
+    int i;
+
+    rec->nargs = 0;
+
+    while (fmt && (fmt = debug_log_spec(fmt, &sp)))
+    {
+        dbarg* a = &rec->arg[rec->nargs];
+
+        if (sp.conv == '%')
+            continue;
+
+        if (rec->nargs + sp.stars + 1 > DEBUG_LOG_ARGS)
+            break;
+
+        for (i = 0; i < sp.stars; ++i)
+            (a++)->i = va_arg(args, int);
+
+        switch (sp.conv)
+        {
+        case 'd': case 'i':
+            switch (sp.length)
+            {
+            case 'H':   a->i = (signed char)va_arg(args, int);  break;
+            case 'h':   a->i = (short)va_arg(args, int);        break;
+            case 'l':   a->i = va_arg(args, long);              break;
+            case 'L':   a->i = va_arg(args, long long);         break;
+            case 'z':   a->i = (long long)va_arg(args, size_t); break;
+            case 'j':   a->i = va_arg(args, intmax_t);          break;
+            case 't':   a->i = va_arg(args, ptrdiff_t);         break;
+            default:    a->i = va_arg(args, int);               break;
+            }
+            break;
+
+        case 'u': case 'o': case 'x': case 'X':
+            switch (sp.length)
+            {
+            case 'H':   a->u = (unsigned char)va_arg(args, int);    break;
+            case 'h':   a->u = (unsigned short)va_arg(args, int);   break;
+            case 'l':   a->u = va_arg(args, unsigned long);         break;
+            case 'L':   a->u = va_arg(args, unsigned long long);    break;
+            case 'z':   a->u = va_arg(args, size_t);                break;
+            case 'j':   a->u = va_arg(args, uintmax_t);             break;
+            case 't':   a->u = va_arg(args, ptrdiff_t);             break;
+            default:    a->u = va_arg(args, unsigned);              break;
+            }
+            break;
+
+        case 'c':
+            a->i = va_arg(args, int);
+            break;
+
+        case 's':
+        {
+            const char* str = va_arg(args, const char*);
+            size_t len;
+
+            if (!str)
+                str = "(null)";
+
+            len = strlen(str);
+
+            if (len > DEBUG_LOG_STRINGS - 1 - strings)
+                len = DEBUG_LOG_STRINGS - 1 - strings;
+
+            memcpy(rec->strings + strings, str, len);
+            rec->strings[strings + len] = '\0';
+            a->str = strings;
+            strings += len + (strings + len < DEBUG_LOG_STRINGS - 1);
+            break;
+        }
+
+        case 'p': case 'n':
+            a->p = va_arg(args, void*);
+            break;
+
+        default: /* floating point */
+            if (sp.length == 'D')
+                a->d = va_arg(args, long double);
+            else
+                a->d = va_arg(args, double);
+            break;
+        }
+
+        rec->nargs += sp.stars + 1;
+    }
+}
+
+
+static void debug_log_rt(   warning_t level,
+                            const char *file,
+                            const char *function, size_t line,
+                            const char *fmt, va_list args )
+{
+    unsigned pos = __atomic_load_n(&debug_log_tail, __ATOMIC_RELAXED);
+    dbrec* rec;
+
+    /* claim the record at the tail, unless it is yet to be read */
+    for (;;)
+    {
+        unsigned lap = pos & ~(DEBUG_LOG_SIZE - 1);
+        int diff;
+
+        rec = &debug_log[pos & (DEBUG_LOG_SIZE - 1)];
+        diff = (int)(__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) - lap);
+
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&debug_log_tail, &pos, pos + 1,
+                                            1, __ATOMIC_RELAXED,
+                                               __ATOMIC_RELAXED))
+                break;
+        }
+        else if (diff < 0)
+        {
+            __atomic_add_fetch(&debug_log_drops, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+            pos = __atomic_load_n(&debug_log_tail, __ATOMIC_RELAXED);
+    }
+
+    rec->level = level;
+    rec->file = file;
+    rec->function = function;
+    rec->line = line;
+    rec->fmt = fmt;
+
+    debug_log_capture(rec, fmt, args);
+
+    __atomic_store_n(&rec->seq, (pos & ~(DEBUG_LOG_SIZE - 1)) + 1,
+                                                    __ATOMIC_RELEASE);
+}
+
+
+static void debug_log_print(FILE* fp, const dbrec* rec)
+{
+    const char* fmt = rec->fmt;
+    const char* p;
+    const dbarg* a = rec->arg;
+    const dbarg* end = rec->arg + rec->nargs;
+    dbspec sp;
+
+    while (fmt && (p = debug_log_spec(fmt, &sp)))
+    {
+        char spec[32];
+        int st[2] = { 0, 0 };
+        int i;
+
+        fwrite(fmt, 1, sp.start - fmt, fp);
+        fmt = p;
+
+        if (sp.conv == '%')
+        {
+            fputc('%', fp);
+            continue;
+        }
+
+        if (a + sp.stars + 1 > end || sp.flags_len > 16)
+        {
+            fmt = sp.start;
+            break;
+        }
+
+        for (i = 0; i < sp.stars; ++i)
+            st[i] = (int)(a++)->i;
+
+        /* the flags, width and precision as given, then the type kept */
+        memcpy(spec, sp.start, sp.flags_len + 1);
+        spec[sp.flags_len + 1] = '\0';
+
+        if (strchr("diuoxX", sp.conv))
+            strcat(spec, "ll");
+
+        spec[strlen(spec) + 1] = '\0';
+        spec[strlen(spec)] = sp.conv;
+
+        #define DEBUG_LOG_PRINT( v )                                    \
+            switch (sp.stars)                                           \
+            {                                                           \
+            case 0:     fprintf(fp, spec, v);                   break;  \
+            case 1:     fprintf(fp, spec, st[0], v);            break;  \
+            default:    fprintf(fp, spec, st[0], st[1], v);     break;  \
+            }
+
+        switch (sp.conv)
+        {
+        case 'd': case 'i':
+            DEBUG_LOG_PRINT( a->i );
+            break;
+
+        case 'u': case 'o': case 'x': case 'X':
+            DEBUG_LOG_PRINT( a->u );
+            break;
+
+        case 'c':
+            DEBUG_LOG_PRINT( (int)a->i );
+            break;
+
+        case 's':
+            DEBUG_LOG_PRINT( rec->strings + a->str );
+            break;
+
+        case 'p':
+            DEBUG_LOG_PRINT( a->p );
+            break;
+
+        case 'n':
+            break;
+
+        default:
+            DEBUG_LOG_PRINT( a->d );
+            break;
+        }
+
+        #undef DEBUG_LOG_PRINT
+
+        ++a;
+    }
+
+    if (fmt)
+        fputs(fmt, fp);
+}
+
+
+void debug_rt_thread(int is_rt)
+{
+    debug_is_rt = is_rt;
+}
+
+
+int debug_log_drain(FILE* fp)
+{
+    unsigned long drops;
+    int count = 0;
+
+    if (__atomic_exchange_n(&debug_log_draining, 1, __ATOMIC_ACQUIRE))
+        return 0;
+
+    for (;;)
+    {
+        unsigned pos = debug_log_head;
+        unsigned lap = pos & ~(DEBUG_LOG_SIZE - 1);
+        dbrec* rec = &debug_log[pos & (DEBUG_LOG_SIZE - 1)];
+        FILE* out = fp;
+
+        if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != lap + 1)
+            break;
+
+        if (!out)
+            out = (W_MESSAGE == rec->level) ? stdout : stderr;
+
+        warn_begin(out, rec->level, rec->file, rec->function, rec->line);
+        debug_log_print(out, rec);
+        warn_end(out);
+
+        __atomic_store_n(&rec->seq, lap + DEBUG_LOG_SIZE, __ATOMIC_RELEASE);
+        debug_log_head = pos + 1;
+        ++count;
+    }
+
+    drops = __atomic_load_n(&debug_log_drops, __ATOMIC_RELAXED);
+
+    if (drops != debug_log_drops_told)
+    {
+        FILE* out = fp ? fp : stderr;
+
+        warn_begin(out, W_WARNING, __FILE__, __FUNCTION__, __LINE__);
+        fprintf(out, "%lu real time messages dropped\n",
+                                        drops - debug_log_drops_told);
+        warn_end(out);
+
+        debug_log_drops_told = drops;
+    }
+
+    __atomic_store_n(&debug_log_draining, 0, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+
+unsigned long debug_log_dropped(void)
+{
+    return __atomic_load_n(&debug_log_drops, __ATOMIC_RELAXED);
+}
+
+
+void
+warnf(  warning_t level,
+        const char *file,
+        const char *function, size_t line, const char *fmt, ... )
+{
+    va_list args;
+    FILE *fp = W_MESSAGE == level ? stdout : stderr;
+
+    if (debug_is_rt)
+    {
+        va_start( args, fmt );
+        debug_log_rt( level, file, function, line, fmt, args );
+        va_end( args );
+        return;
+    }
+
+    warn_begin( fp, level, file, function, line );
 
     if ( fmt )
     {
@@ -60,5 +484,5 @@ warnf(  warning_t level,
         va_end( args );
     }
 
-    fprintf( fp, "\033[0m" );
+    warn_end( fp );
 }
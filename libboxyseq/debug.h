@@ -35,6 +35,25 @@ warnf ( warning_t level,
         const char *function, size_t line, const char *fmt, ... );
 
 
+/*  real time logging
+ *---------------------
+ *  printing from the JACK process thread (or the threads it shares work
+ *  with) risks blocking it on stdio locks. a thread marked by
+ *  debug_rt_thread instead has warnf keep each message in a preallocated
+ *  lock-free ring, as its format and arguments (strings are copied),
+ *  for debug_log_drain to format and print later from a non real time
+ *  thread. messages arriving when the ring is full are dropped and
+ *  counted.
+ *
+ *  debug_log_drain prints every message waiting, to fp or when fp is
+ *  NULL to stdout/stderr as warnf would have, and returns how many. it
+ *  should only be called from one thread at a time.
+ */
+void            debug_rt_thread(int is_rt);
+int             debug_log_drain(FILE* fp);
+unsigned long   debug_log_dropped(void);
+
+
 #ifndef NDEBUG
 #define DMESSAGE( fmt, args... ) \
     warnf( W_MESSAGE, __FILE__, __FUNCTION__, __LINE__, fmt, ## args )
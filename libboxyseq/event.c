@@ -43,6 +43,7 @@ void event_init(event* ev)
     ev->note_pitch =    -1;
     ev->note_velocity = -1;
     ev->box_release =   -1;
+    ev->grid =           0;
     ev->grb =            0;
 }
 
@@ -63,6 +64,7 @@ void event_copy(event* dest, const event* src)
     dest->note_pitch =      src->note_pitch;
     dest->note_velocity =   src->note_velocity;
     dest->box_release =     src->box_release;
+    dest->grid =            src->grid;
     dest->grb =             src->grb;
 }
 
@@ -60,6 +60,7 @@ typedef struct event_
 
     bbt_t   box_release;    /* duration of box after note off (ticks) */
 
+    int     grid;           /* index of the grid placed within */
     grbound* grb;
 
 } event;
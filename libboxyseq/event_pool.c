@@ -3,32 +3,12 @@
 
 #include "debug.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 
-typedef struct rt_event_link
-{
-    event ev;
-    struct rt_event_link* prev;
-    struct rt_event_link* next;
-
-} rt_evlink;
-
-
-struct event_pool
-{
-    int     count;
-    int     free_count;
-    rt_evlink*   mempool;
-    rt_evlink*   memfree;
-
-    char* name;
-
-    #ifdef EVPOOL_DEBUG
-    int min_free;
-    #endif
-};
+#include "include/event_pool_data.h"
 
 
 evpool* evpool_new(int count, const char* name)
@@ -110,40 +90,6 @@ void evpool_free(evpool* evp)
 }
 
 
-static inline rt_evlink* evpool_private_event_alloc(evpool* evp)
-{
-    rt_evlink* evlnk = evp->memfree;
-
-    if (!evlnk)
-        return 0;
-
-    evp->memfree = evp->memfree->next;
-
-    --evp->free_count;
-
-#ifdef EVPOOL_DEBUG
-    if (evp->free_count < evp->min_free)
-        evp->min_free = evp->free_count;
-    evlnk->ev.flags = 0;
-#endif
-
-    return evlnk;
-}
-
-
-static inline void evpool_private_event_free(   evpool* evp,
-                                                rt_evlink* evlnk )
-{
-#ifdef EVPOOL_DEBUG
-    evlnk->ev.flags = EV_IS_FREE_ERROR;
-#endif
-
-    evlnk->next = evp->memfree;
-    evp->memfree = evlnk;
-    ++evp->free_count;
-}
-
-
 event* evpool_event_alloc(evpool* evp)
 {
     return &(evpool_private_event_alloc(evp)->ev);
@@ -158,6 +104,19 @@ void evpool_event_free(evpool* evp, event* ev)
 
 
 
+/*  heap backend (RT_EVLIST_HEAP). the sort value is cached in the node
+    alongside an insertion sequence number which keeps events with equal
+    sort values in the order they were added.
+*/
+typedef struct rt_event_heap_node
+{
+    bbt_t       val;
+    uint64_t    seq;
+    rt_evlink*  lnk;
+
+} rt_evhnode;
+
+
 struct rt_event_list
 {
     rt_evlink* head;
@@ -167,6 +126,12 @@ struct rt_event_list
 
     int flags;
 
+    rt_evhnode* heap;       /* null unless RT_EVLIST_HEAP */
+    int         heap_head;  /* only non-zero while heap_sorted */
+    int         heap_cur;
+    bool        heap_sorted;
+    uint64_t    heap_seq;
+
     evpool* pool;
     bool pool_managed;
 
@@ -179,6 +144,46 @@ struct rt_event_list
 
 #ifdef EVPOOL_DEBUG
 
+static void rt_evheap_integrity_dump(rt_evlist* rtevl, const char* from)
+{
+    rt_evhnode* heap = rtevl->heap + rtevl->heap_head;
+    int i;
+
+    if (rtevl->heap_head && !rtevl->heap_sorted)
+    {
+        WARNING("heap head %d is not sorted\n", rtevl->heap_head);
+        goto fail;
+    }
+
+    for (i = 0; i < rtevl->count; ++i)
+    {
+        rt_evhnode* hn = &heap[i];
+
+        if (hn->lnk->ev.flags == EV_IS_FREE_ERROR)
+        {
+            WARNING("heap node %d: link %p is free\n", i, hn->lnk);
+            goto fail;
+        }
+
+        /* a sorted heap is checked against the previous node */
+        if (i && hn->val < (rtevl->heap_sorted
+                                ? &heap[i - 1]
+                                : &heap[(i - 1) / 2])->val)
+        {
+            WARNING("heap node %d out of order\n", i);
+            goto fail;
+        }
+    }
+
+    return;
+
+fail:
+    WARNING("***** integrity checks  for [%s] failed *****\n",
+                                            rtevl->name);
+    WARNING("CHECK ABORTED: called from %s\n", from);
+}
+
+
 void rt_evlist_integrity_dump(rt_evlist* rtevl, const char* from)
 {
     rt_evlink* fwd_track[500];
@@ -191,6 +196,12 @@ void rt_evlist_integrity_dump(rt_evlist* rtevl, const char* from)
     rt_evlink* fwd = rtevl->head;
     rt_evlink* rev = rtevl->tail;
 
+    if (rtevl->heap)
+    {
+        rt_evheap_integrity_dump(rtevl, from);
+        return;
+    }
+
     if (!fwd && !rev && !rtevl->cur)
         return;
 
@@ -362,10 +373,28 @@ rt_evlist*  rt_evlist_new(evpool* pool, int flags, const char* name)
     rtevl->flags = flags;
     rtevl->count = 0;
 
+    rtevl->heap = 0;
+    rtevl->heap_head = 0;
+    rtevl->heap_cur = 0;
+    rtevl->heap_sorted = 1;
+    rtevl->heap_seq = 0;
+
+    if (flags & RT_EVLIST_HEAP)
+    {
+        /* the list can never hold more events than the pool */
+        rtevl->heap = malloc(sizeof(*rtevl->heap)
+                                * (size_t)rtevl->pool->count);
+        if (!rtevl->heap)
+            goto fail2;
+    }
+
     rtevl->name = strdup(name);
 
     return rtevl;
 
+fail2:
+    if (rtevl->pool_managed)
+        evpool_free(rtevl->pool);
 fail1:
     free(rtevl);
 
@@ -386,6 +415,7 @@ void rt_evlist_free(rt_evlist* rtevl)
     if (rtevl->pool_managed)
         evpool_free(rtevl->pool);
 
+    free(rtevl->heap);
     free(rtevl->name);
     free(rtevl);
 }
@@ -397,6 +427,243 @@ int rt_evlist_count(rt_evlist* rtevl)
 }
 
 
+static inline bool rt_evhnode_less(const rt_evhnode* a,
+                                    const rt_evhnode* b)
+{
+    return a->val < b->val || (a->val == b->val && a->seq < b->seq);
+}
+
+
+static void rt_evheap_sift_down(rt_evhnode* heap, int count, int i)
+{
+    rt_evhnode hn = heap[i];
+
+    for (;;)
+    {
+        int child = i * 2 + 1;
+
+        if (child >= count)
+            break;
+
+        if (child + 1 < count && rt_evhnode_less(&heap[child + 1],
+                                                 &heap[child]))
+            ++child;
+
+        if (!rt_evhnode_less(&heap[child], &hn))
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = hn;
+}
+
+
+/*  while sorted, events read and removed from the head of the list
+    just move the head along. the events are moved back to the start
+    of the array when the list stops being sorted, or when there is no
+    room left after the last event.
+*/
+static void rt_evheap_compact(rt_evlist* rtevl)
+{
+    if (!rtevl->heap_head)
+        return;
+
+    memmove(&rtevl->heap[0], &rtevl->heap[rtevl->heap_head],
+                sizeof(*rtevl->heap) * (size_t)rtevl->count);
+    rtevl->heap_head = 0;
+}
+
+
+static int rt_evheap_event_add(rt_evlist* rtevl, rt_evlink* newlnk)
+{
+    rt_evhnode* heap;
+    rt_evhnode hn;
+    int i = rtevl->count++;
+
+    switch (rtevl->flags & RT_EVLIST_SORT_MASK)
+    {
+    case RT_EVLIST_SORT_POS:    hn.val = newlnk->ev.pos;
+        break;
+
+    case RT_EVLIST_SORT_DUR:
+        /* -1 goes at the tail */
+        if ((hn.val = newlnk->ev.note_dur) == -1)
+            hn.val = INT32_MAX;
+        break;
+
+    case RT_EVLIST_SORT_REL:    hn.val = newlnk->ev.box_release;
+        break;
+
+    default:                    WARNING("ERROR: insane flags\n");
+        --rtevl->count;
+        evpool_private_event_free(rtevl->pool, newlnk);
+        return 0;
+    }
+
+    hn.seq = rtevl->heap_seq++;
+    hn.lnk = newlnk;
+
+    /* appending to a sorted heap in order keeps it sorted */
+    if (i && rtevl->heap_sorted)
+        rtevl->heap_sorted = !rt_evhnode_less(&hn,
+                                &rtevl->heap[rtevl->heap_head + i - 1]);
+
+    if (!rtevl->heap_sorted
+     || rtevl->heap_head + i == rtevl->pool->count)
+        rt_evheap_compact(rtevl);
+
+    heap = rtevl->heap + rtevl->heap_head;
+
+    while (i)
+    {
+        int parent = (i - 1) / 2;
+
+        if (!rt_evhnode_less(&hn, &heap[parent]))
+            break;
+
+        heap[i] = heap[parent];
+        i = parent;
+    }
+
+    heap[i] = hn;
+
+    return 1;
+}
+
+
+/*  a sorted array is also a valid heap. heapsort leaves a min-heap
+    in descending order, so it's reversed afterward.
+*/
+static void rt_evheap_sort(rt_evlist* rtevl)
+{
+    rt_evhnode* heap = rtevl->heap + rtevl->heap_head;
+    int n, lo, hi;
+
+    if (rtevl->heap_sorted)
+        return;
+
+    for (n = rtevl->count - 1; n > 0; --n)
+    {
+        rt_evhnode tmp = heap[0];
+        heap[0] = heap[n];
+        heap[n] = tmp;
+        rt_evheap_sift_down(heap, n, 0);
+    }
+
+    for (lo = 0, hi = rtevl->count - 1; lo < hi; ++lo, --hi)
+    {
+        rt_evhnode tmp = heap[lo];
+        heap[lo] = heap[hi];
+        heap[hi] = tmp;
+    }
+
+    rtevl->heap_sorted = 1;
+}
+
+
+static void rt_evheap_clear_events(rt_evlist* rtevl)
+{
+    rt_evhnode* heap = rtevl->heap + rtevl->heap_head;
+    int i;
+
+    for (i = 0; i < rtevl->count; ++i)
+        evpool_private_event_free(rtevl->pool, heap[i].lnk);
+
+    rtevl->count = 0;
+    rtevl->heap_head = 0;
+    rtevl->heap_cur = 0;
+    rtevl->heap_sorted = 1;
+    rtevl->heap_seq = 0;
+}
+
+
+static event* rt_evheap_read_event(rt_evlist* rtevl)
+{
+    rt_evheap_sort(rtevl);
+
+    if (rtevl->heap_cur >= rtevl->count)
+        return 0;
+
+    return &rtevl->heap[rtevl->heap_head + rtevl->heap_cur++].lnk->ev;
+}
+
+
+static event* rt_evheap_read_and_remove_event(rt_evlist* rtevl,
+                                                    event* dest)
+{
+    rt_evhnode* heap = rtevl->heap + rtevl->heap_head;
+    rt_evlink* evlnk;
+
+    if (!rtevl->count)
+        return 0;
+
+    evlnk = heap[0].lnk;
+    event_copy(dest, &evlnk->ev);
+    evpool_private_event_free(rtevl->pool, evlnk);
+
+    if (--rtevl->count)
+    {
+        if (rtevl->heap_sorted)
+            ++rtevl->heap_head;
+        else
+        {
+            heap[0] = heap[rtevl->count];
+            rt_evheap_sift_down(heap, rtevl->count, 0);
+        }
+    }
+    else
+    {
+        rtevl->heap_head = 0;
+        rtevl->heap_sorted = 1;
+        rtevl->heap_seq = 0;
+    }
+
+    rtevl->heap_cur = 0;
+
+    return dest;
+}
+
+
+/*  removes the previously read event, the heap stays sorted. the events
+    on whichever side of it are fewer are moved to close the gap.
+*/
+static void rt_evheap_and_remove_event(rt_evlist* rtevl)
+{
+    rt_evhnode* heap = rtevl->heap + rtevl->heap_head;
+    int rem = rtevl->heap_cur - 1;
+
+    if (rem < 0 || rem >= rtevl->count)
+    {
+        WARNING("ERROR: rt_evlist %s no previously read event "
+                "to remove\n", rtevl->name);
+        return;
+    }
+
+    evpool_private_event_free(rtevl->pool, heap[rem].lnk);
+
+    --rtevl->count;
+
+    if (rem < rtevl->count - rem)
+    {
+        memmove(&heap[1], &heap[0], sizeof(*heap) * (size_t)rem);
+        ++rtevl->heap_head;
+    }
+    else
+        memmove(&heap[rem], &heap[rem + 1],
+                    sizeof(*heap) * (size_t)(rtevl->count - rem));
+
+    rtevl->heap_cur = rem;
+
+    if (!rtevl->count)
+    {
+        rtevl->heap_head = 0;
+        rtevl->heap_seq = 0;
+    }
+}
+
+
 int rt_evlist_event_add(rt_evlist* rtevl, const event* ev)
 {
     #ifdef EVPOOL_DEBUG999
@@ -423,6 +690,9 @@ int rt_evlist_event_add(rt_evlist* rtevl, const event* ev)
 
     event_copy(&newlnk->ev, ev);
 
+    if (rtevl->heap)
+        return rt_evheap_event_add(rtevl, newlnk);
+
     if (!cur) /* no head, list is empty */
     {
         rtevl->head = rtevl->tail = newlnk;
@@ -435,7 +705,7 @@ int rt_evlist_event_add(rt_evlist* rtevl, const event* ev)
         /* ---------------------------------- */
     }
 
-    switch (rtevl->flags)
+    switch (rtevl->flags & RT_EVLIST_SORT_MASK)
     {
     case RT_EVLIST_SORT_POS:    newval = ev->pos;
         break;
@@ -455,7 +725,7 @@ int rt_evlist_event_add(rt_evlist* rtevl, const event* ev)
 
     while(cur)
     {
-        switch (rtevl->flags)
+        switch (rtevl->flags & RT_EVLIST_SORT_MASK)
         {
         case RT_EVLIST_SORT_POS:    curval = ((event*)cur)->pos;
             break;
@@ -509,6 +779,12 @@ void rt_evlist_clear_events(rt_evlist* rtevl)
 
     rt_evlink* evlnk = rtevl->head;
 
+    if (rtevl->heap)
+    {
+        rt_evheap_clear_events(rtevl);
+        return;
+    }
+
     rtevl->head = rtevl->tail = 0;
     rtevl->count = 0;
 
@@ -527,6 +803,12 @@ event* rt_evlist_goto_first(rt_evlist* rtevl)
     rt_evlist_integrity_dump(rtevl, __FUNCTION__);
     #endif
 
+    if (rtevl->heap)
+    {
+        rtevl->heap_cur = 0;
+        return rt_evheap_read_event(rtevl);
+    }
+
     if (!(rtevl->cur = rtevl->head))
         return 0;
 
@@ -539,6 +821,9 @@ event* rt_evlist_goto_next(rt_evlist* rtevl)
     #ifdef EVPOOL_DEBUG999
     rt_evlist_integrity_dump(rtevl, __FUNCTION__);
     #endif
+    if (rtevl->heap)
+        return rt_evheap_read_event(rtevl);
+
     if (!rtevl->cur)
         return 0;
 
@@ -553,6 +838,7 @@ void rt_evlist_read_reset(rt_evlist* rtevl)
     #endif
 
     rtevl->cur = rtevl->head;
+    rtevl->heap_cur = 0;
 }
 
 
@@ -562,6 +848,9 @@ event* rt_evlist_read_event(rt_evlist* rtevl)
     rt_evlist_integrity_dump(rtevl, __FUNCTION__);
     #endif
 
+    if (rtevl->heap)
+        return rt_evheap_read_event(rtevl);
+
     if (!rtevl->cur)
         return 0;
 
@@ -577,6 +866,9 @@ event* rt_evlist_read_and_remove_event(rt_evlist* rtevl, event* dest)
     rt_evlist_integrity_dump(rtevl, __FUNCTION__);
     #endif
 
+    if (rtevl->heap)
+        return rt_evheap_read_and_remove_event(rtevl, dest);
+
     if (!rtevl->cur)
         return 0;
 
@@ -599,6 +891,15 @@ event* rt_evlist_read_and_remove_event(rt_evlist* rtevl, event* dest)
 }
 
 
+const event* rt_evlist_peek_event(rt_evlist* rtevl)
+{
+    if (rtevl->heap)
+        return rtevl->count ? &rtevl->heap[rtevl->heap_head].lnk->ev : 0;
+
+    return rtevl->cur ? &rtevl->cur->ev : 0;
+}
+
+
 /*
     remove the previous event in the list.
 
@@ -632,6 +933,12 @@ void rt_evlist_and_remove_event(rt_evlist* rtevl)
     #endif
 
     rt_evlink* rem = 0;
+
+    if (rtevl->heap)
+    {
+        rt_evheap_and_remove_event(rtevl);
+        return;
+    }
 /*
     WARNING("rtevl:%p head:%p tail:%p cur:%p\n",
             rtevl, rtevl->head, rtevl->tail, rtevl->cur);
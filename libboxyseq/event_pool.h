@@ -30,6 +30,24 @@ enum RT_EVLIST_SORT_FLAGS
     RT_EVLIST_SORT_POS = 0x0001,
     RT_EVLIST_SORT_DUR,
     RT_EVLIST_SORT_REL,
+
+    RT_EVLIST_SORT_MASK = 0x00ff,
+
+    /*  RT_EVLIST_HEAP: or'd with one of the above flags, the list
+        is kept as a binary heap rather than a linked list so that
+        adding an event is O(log n) rather than O(n). events with
+        equal sort values still come out in the order they were
+        added.
+
+        reading and removing from the head of the list is O(log n),
+        or O(1) while the events have all been added in order.
+        rt_evlist_read_event sorts the heap first if anything has
+        been added or removed from the head since it was last sorted
+        so is best kept to lists which are filled and then read.
+        a heap backed list should not be added to whilst being read
+        with rt_evlist_read_event.
+    */
+    RT_EVLIST_HEAP = 0x0100
 };
 
 
@@ -66,6 +84,11 @@ event*      rt_evlist_read_and_remove_event(rt_evlist* rtevl,
 
 void        rt_evlist_and_remove_event(rt_evlist* rtevl);
 
+/*  rt_evlist_peek_event returns the event the next call to
+    rt_evlist_read_and_remove_event would, without removing it.
+*/
+const event* rt_evlist_peek_event(rt_evlist* rtevl);
+
 
 #ifdef __cplusplus
 } /* closing brace for extern "C" */
@@ -93,6 +93,7 @@ evport* evport_new( evpool* pool,   const char* name,
 
     DMESSAGE("new event port \"%s\"\n",port->name);
 
+    port->flags = rt_evlist_sort_flags;
     port->data = rt_evlist_new(pool, rt_evlist_sort_flags, port->name);
 
     if (!port->data)
@@ -117,6 +118,12 @@ const char* evport_name(evport* ev)
 }
 
 
+int evport_flags(evport* ev)
+{
+    return ev->flags;
+}
+
+
 void evport_free(evport* port)
 {
     if (!port)
@@ -177,6 +184,18 @@ int evport_read_and_remove_event(evport* port, event* dest)
 }
 
 
+int evport_peek_event(evport* port, event* dest)
+{
+    const event* ev = rt_evlist_peek_event(port->data);
+
+    if (!ev)
+        return 0;
+
+    event_copy(dest, ev);
+    return 1;
+}
+
+
 void evport_and_remove_event(evport* port)
 {
     rt_evlist_and_remove_event(port->data);
@@ -58,6 +58,7 @@ evport*     evport_new( evpool* pool,   const char* name,
 void        evport_free(evport* port);
 
 const char* evport_name(evport*);
+int         evport_flags(evport*); /* rt_evlist_sort_flags */
 
 int         evport_write_event(evport*, const event*);
 
@@ -67,6 +68,9 @@ int         evport_read_event(evport*, event* dest);
 int         evport_read_and_remove_event(evport*, event* dest);
 void        evport_and_remove_event(evport*);
 
+/* copies the event evport_read_and_remove_event would next, into dest */
+int         evport_peek_event(evport*, event* dest);
+
 int         evport_count(evport*);
 
 void        evport_pre_flush_check(evport*);
@@ -140,6 +140,30 @@ evport* evport_manager_evport_next(evport_manager* portman)
 }
 
 
+evport* evport_manager_evport_nth(evport_manager* portman, int index)
+{
+    lnode* ln = llist_head(portman->portlist);
+
+    while (ln && index--)
+        ln = lnode_next(ln);
+
+    return ln ? lnode_data(ln) : 0;
+}
+
+
+int evport_manager_evport_index(evport_manager* portman, evport* port)
+{
+    lnode* ln = llist_head(portman->portlist);
+    int index = 0;
+
+    for (; ln; ln = lnode_next(ln), ++index)
+        if (lnode_data(ln) == port)
+            return index;
+
+    return -1;
+}
+
+
 static void* evport_manager_rtdata_get_cb(const void* data)
 {
     const evport_manager* portman = data;
@@ -159,6 +183,12 @@ void evport_manager_update_rt_data(const evport_manager* portman)
 }
 
 
+rtdata* evport_manager_rtdata(evport_manager* portman)
+{
+    return portman->rt;
+}
+
+
 void evport_manager_rt_clear_all(evport_manager* portman)
 {
     evport** ports = rtdata_data(portman->rt);
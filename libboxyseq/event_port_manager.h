@@ -8,6 +8,7 @@ extern "C" {
 
 
 #include "event_port.h"
+#include "real_time_data.h"
 
 
 typedef struct event_port_manager evport_manager;
@@ -22,6 +23,13 @@ evport*         evport_manager_evport_new(  evport_manager*,
 evport*         evport_manager_evport_first(evport_manager*);
 evport*         evport_manager_evport_next(evport_manager*);
 
+/*  evport_manager_evport_nth:      the port at index, or NULL.
+    evport_manager_evport_index:    the index of port, or -1.
+    neither disturbs first/next.
+*/
+evport*         evport_manager_evport_nth(evport_manager*, int index);
+int             evport_manager_evport_index(evport_manager*, evport*);
+
 
 /*  the first of these need only be called if the second ever is.
     furthermore, if the second of these is called, then the first
@@ -29,6 +37,7 @@ evport*         evport_manager_evport_next(evport_manager*);
 */
 
 void            evport_manager_update_rt_data(const evport_manager*);
+rtdata*         evport_manager_rtdata(evport_manager*);
 void            evport_manager_rt_clear_all(evport_manager*);
 
 
@@ -0,0 +1,410 @@
+#include "event_wheel.h"
+
+
+#include "debug.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "include/event_pool_data.h"
+
+
+#define EVWHEEL_LEVELS      4
+#define EVWHEEL_SLOT_BITS   6
+#define EVWHEEL_SLOTS       (1 << EVWHEEL_SLOT_BITS)
+#define EVWHEEL_SLOT_MASK   (EVWHEEL_SLOTS - 1)
+
+/* ticks spanned by a single slot at level n */
+#define EVWHEEL_SPAN(n)     ((int64_t)1 << (EVWHEEL_SLOT_BITS * (n)))
+
+
+/*  slots are singly linked FIFO lists using the rt_evlink next pointer,
+    events expiring together come out in the order they went in.
+*/
+typedef struct rt_event_wheel_slot
+{
+    rt_evlink* head;
+    rt_evlink* tail;
+
+} evwslot;
+
+
+struct rt_event_wheel
+{
+    evwslot     slot[EVWHEEL_LEVELS][EVWHEEL_SLOTS];
+    uint64_t    occupied[EVWHEEL_LEVELS];   /* bit per non-empty slot */
+
+    evwslot     overflow;   /* beyond the top level */
+    evwslot     due;        /* expired, waiting to be taken */
+
+    bbt_t       now;
+    int         count;
+
+    evpool*     pool;
+    bool        pool_managed;
+
+    char*       name;
+};
+
+
+static inline void evwslot_append(evwslot* sl, rt_evlink* lnk)
+{
+    lnk->next = 0;
+
+    if (sl->tail)
+        sl->tail->next = lnk;
+    else
+        sl->head = lnk;
+
+    sl->tail = lnk;
+}
+
+
+static inline void evwslot_append_slot(evwslot* sl, evwslot* from)
+{
+    if (!from->head)
+        return;
+
+    if (sl->tail)
+        sl->tail->next = from->head;
+    else
+        sl->head = from->head;
+
+    sl->tail = from->tail;
+    from->head = from->tail = 0;
+}
+
+
+static inline rt_evlink* evwslot_take(evwslot* sl)
+{
+    rt_evlink* lnk = sl->head;
+
+    if (lnk && !(sl->head = lnk->next))
+        sl->tail = 0;
+
+    return lnk;
+}
+
+
+rt_evwheel* rt_evwheel_new(evpool* pool, const char* name)
+{
+    rt_evwheel* whl = malloc(sizeof(*whl));
+
+    if (!whl)
+        goto fail0;
+
+    DMESSAGE("new RT event wheel \"%s\"\n", name);
+
+    if (!pool)
+    {
+        if (!(whl->pool = evpool_new(DEFAULT_EVPOOL_SIZE, name)))
+            goto fail1;
+
+        whl->pool_managed = 1;
+    }
+    else
+    {
+        whl->pool = pool;
+        whl->pool_managed = 0;
+    }
+
+    memset(whl->slot, 0, sizeof(whl->slot));
+    memset(whl->occupied, 0, sizeof(whl->occupied));
+
+    whl->overflow.head = whl->overflow.tail = 0;
+    whl->due.head = whl->due.tail = 0;
+
+    whl->now = 0;
+    whl->count = 0;
+
+    whl->name = strdup(name);
+
+    return whl;
+
+fail1:
+    free(whl);
+fail0:
+    WARNING("out of memory for new RT event wheel\n");
+    return 0;
+}
+
+
+void rt_evwheel_free(rt_evwheel* whl)
+{
+    if (!whl)
+        return;
+
+    rt_evwheel_clear_events(whl);
+
+    if (whl->pool_managed)
+        evpool_free(whl->pool);
+
+    free(whl->name);
+    free(whl);
+}
+
+
+int rt_evwheel_count(rt_evwheel* whl)
+{
+    return whl->count;
+}
+
+
+bbt_t rt_evwheel_now(rt_evwheel* whl)
+{
+    return whl->now;
+}
+
+
+static void evwheel_insert(rt_evwheel* whl, rt_evlink* lnk)
+{
+    int64_t delta = (int64_t)lnk->ev.pos - whl->now;
+    int lvl;
+
+    if (delta < 0)
+    {
+        evwslot_append(&whl->due, lnk);
+        return;
+    }
+
+    for (lvl = 0; lvl < EVWHEEL_LEVELS; ++lvl)
+    {
+        if (delta < EVWHEEL_SPAN(lvl + 1))
+        {
+            int idx = ((uint32_t)lnk->ev.pos >> (EVWHEEL_SLOT_BITS * lvl))
+                                                & EVWHEEL_SLOT_MASK;
+
+            evwslot_append(&whl->slot[lvl][idx], lnk);
+            whl->occupied[lvl] |= (uint64_t)1 << idx;
+            return;
+        }
+    }
+
+    evwslot_append(&whl->overflow, lnk);
+}
+
+
+/*  redistributes the events of a slot (or the overflow) relative to
+    now. they can only move down a level (or into due).
+*/
+static void evwheel_cascade(rt_evwheel* whl, evwslot* sl)
+{
+    rt_evlink* lnk = sl->head;
+
+    sl->head = sl->tail = 0;
+
+    while (lnk)
+    {
+        rt_evlink* next = lnk->next;
+        evwheel_insert(whl, lnk);
+        lnk = next;
+    }
+}
+
+
+static void evwheel_cascade_level(rt_evwheel* whl, int lvl, int idx)
+{
+    if (!(whl->occupied[lvl] & ((uint64_t)1 << idx)))
+        return;
+
+    whl->occupied[lvl] &= ~((uint64_t)1 << idx);
+    evwheel_cascade(whl, &whl->slot[lvl][idx]);
+}
+
+
+/* turns the wheel up to (not including) until, collecting into due */
+static void evwheel_turn(rt_evwheel* whl, bbt_t until)
+{
+    while (whl->now < until)
+    {
+        int64_t now = whl->now;
+        int64_t end;
+        int first, last;
+        uint64_t bits;
+
+        if (!(now & EVWHEEL_SLOT_MASK))
+        {
+            int lvl;
+
+            for (lvl = 1; lvl < EVWHEEL_LEVELS; ++lvl)
+            {
+                int idx = ((uint32_t)now >> (EVWHEEL_SLOT_BITS * lvl))
+                                                & EVWHEEL_SLOT_MASK;
+                evwheel_cascade_level(whl, lvl, idx);
+
+                if (idx)
+                    break;
+            }
+
+            if (lvl == EVWHEEL_LEVELS)
+                evwheel_cascade(whl, &whl->overflow);
+
+            if (!whl->occupied[0])
+            {
+                /*  nothing can expire before the next boundary of the
+                    lowest occupied level, so skip straight to it.
+                */
+                for (lvl = 1; lvl < EVWHEEL_LEVELS; ++lvl)
+                    if (whl->occupied[lvl])
+                        break;
+
+                end = (now | (EVWHEEL_SPAN(lvl) - 1)) + 1;
+                whl->now = (end < until) ? (bbt_t)end : until;
+                continue;
+            }
+        }
+
+        end = (now | EVWHEEL_SLOT_MASK) + 1;
+
+        if (end > until)
+            end = until;
+
+        first = now & EVWHEEL_SLOT_MASK;
+        last = (end - 1) & EVWHEEL_SLOT_MASK;
+
+        bits = whl->occupied[0]
+                & ((~(uint64_t)0 << first)
+                    & (~(uint64_t)0 >> (EVWHEEL_SLOTS - 1 - last)));
+
+        whl->occupied[0] &= ~bits;
+
+        while (bits)
+        {
+            int idx = __builtin_ctzll(bits);
+            bits &= bits - 1;
+            evwslot_append_slot(&whl->due, &whl->slot[0][idx]);
+        }
+
+        whl->now = (bbt_t)end;
+    }
+}
+
+
+void rt_evwheel_reset(rt_evwheel* whl, bbt_t now)
+{
+    evwslot all = { 0, 0 };
+    int lvl, idx;
+
+    whl->now = now;
+
+    if (!whl->count)
+        return;
+
+    evwslot_append_slot(&all, &whl->due);
+
+    for (lvl = 0; lvl < EVWHEEL_LEVELS; ++lvl)
+    {
+        for (idx = 0; idx < EVWHEEL_SLOTS; ++idx)
+            evwslot_append_slot(&all, &whl->slot[lvl][idx]);
+
+        whl->occupied[lvl] = 0;
+    }
+
+    evwslot_append_slot(&all, &whl->overflow);
+    evwheel_cascade(whl, &all);
+}
+
+
+int rt_evwheel_event_add(rt_evwheel* whl, const event* ev)
+{
+    rt_evlink* lnk = evpool_private_event_alloc(whl->pool);
+
+    if (!lnk)
+    {
+        WARNING("rt_evwheel %p '%s', pool %p '%s', "
+                "short of memory for event\n",
+                whl,        whl->name,
+                whl->pool,  whl->pool->name );
+        return 0;
+    }
+
+    event_copy(&lnk->ev, ev);
+    evwheel_insert(whl, lnk);
+    ++whl->count;
+
+    return 1;
+}
+
+
+static event* evwheel_take_due(rt_evwheel* whl, event* dest)
+{
+    rt_evlink* lnk = evwslot_take(&whl->due);
+
+    if (!lnk)
+        return 0;
+
+    event_copy(dest, &lnk->ev);
+    evpool_private_event_free(whl->pool, lnk);
+    --whl->count;
+
+    return dest;
+}
+
+
+event* rt_evwheel_expire_event(rt_evwheel* whl, bbt_t until, event* dest)
+{
+    if (!whl->due.head && whl->count)
+        evwheel_turn(whl, until);
+
+    return evwheel_take_due(whl, dest);
+}
+
+
+event* rt_evwheel_remove_event(rt_evwheel* whl, event* dest)
+{
+    int lvl;
+
+    if (whl->due.head)
+        return evwheel_take_due(whl, dest);
+
+    for (lvl = 0; lvl < EVWHEEL_LEVELS; ++lvl)
+    {
+        if (whl->occupied[lvl])
+        {
+            int idx = __builtin_ctzll(whl->occupied[lvl]);
+
+            whl->occupied[lvl] &= ~((uint64_t)1 << idx);
+            evwslot_append_slot(&whl->due, &whl->slot[lvl][idx]);
+
+            return evwheel_take_due(whl, dest);
+        }
+    }
+
+    evwslot_append_slot(&whl->due, &whl->overflow);
+
+    return evwheel_take_due(whl, dest);
+}
+
+
+void rt_evwheel_clear_events(rt_evwheel* whl)
+{
+    event ev;
+
+    while (rt_evwheel_remove_event(whl, &ev))
+        ;
+}
+
+
+static void evwslot_for_each(evwslot* sl, rt_evlist_cb cb)
+{
+    rt_evlink* lnk;
+
+    for (lnk = sl->head; lnk; lnk = lnk->next)
+        cb(&lnk->ev);
+}
+
+
+void rt_evwheel_for_each(rt_evwheel* whl, rt_evlist_cb cb)
+{
+    int lvl, idx;
+
+    evwslot_for_each(&whl->due, cb);
+
+    for (lvl = 0; lvl < EVWHEEL_LEVELS; ++lvl)
+        for (idx = 0; idx < EVWHEEL_SLOTS; ++idx)
+            evwslot_for_each(&whl->slot[lvl][idx], cb);
+
+    evwslot_for_each(&whl->overflow, cb);
+}
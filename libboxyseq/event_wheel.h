@@ -0,0 +1,82 @@
+#ifndef EVENT_WHEEL_H
+#define EVENT_WHEEL_H
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "event_pool.h"
+
+
+/*  rt_event_wheel
+ *------------------
+ *  a hierarchical timing wheel of events keyed on event pos, for events
+ *  which sit around for a long time and only need to be found again
+ *  once they expire (ie blocks in the grid waiting for box_release).
+ *
+ *  unlike rt_evlist, which must be scanned in full to find the events
+ *  within a cycle, the wheel hands back only the events which expire,
+ *  at a cost proportional to the number that do.
+ *
+ *  there are four levels of 64 slots. level n slots are 64^n ticks
+ *  wide. events too far in the future for the top level wait in an
+ *  overflow list. as the wheel turns, each slot of a higher level is
+ *  redistributed (cascaded) into the levels below it before its
+ *  events are due.
+ *
+ *  the wheel keeps a 'now' position: events are expired up to, but
+ *  not including, the position passed to rt_evwheel_expire_event.
+ *  events added with a pos earlier than now are due straight away.
+ *
+ *  like the rt_evlist, the wheel uses an evpool for memory management,
+ *  and likewise if no pool is passed to rt_evwheel_new it creates and
+ *  manages its own.
+ */
+
+
+typedef struct rt_event_wheel rt_evwheel;
+
+
+rt_evwheel* rt_evwheel_new(evpool*, const char* name);
+void        rt_evwheel_free(rt_evwheel*);
+int         rt_evwheel_count(rt_evwheel*);
+
+/*  rt_evwheel_now:     ticks before now have been expired.
+    rt_evwheel_reset:   moves now to 'now', redistributing any events
+                        still in the wheel. when the wheel is empty
+                        this is cheap.
+*/
+bbt_t       rt_evwheel_now(rt_evwheel*);
+void        rt_evwheel_reset(rt_evwheel*, bbt_t now);
+
+/* adding events copies them */
+int         rt_evwheel_event_add(rt_evwheel*, const event*);
+
+/*  rt_evwheel_expire_event:    turns the wheel up to 'until' and copies
+                                the next event whose pos is before
+                                'until' into dest, removing it from the
+                                wheel. returns null when there are no
+                                more such events.
+*/
+event*      rt_evwheel_expire_event(rt_evwheel*, bbt_t until, event* dest);
+
+/*  rt_evwheel_remove_event:    copies any event into dest, removing it
+                                from the wheel regardless of its pos.
+                                used to empty the wheel.
+*/
+event*      rt_evwheel_remove_event(rt_evwheel*, event* dest);
+
+void        rt_evwheel_clear_events(rt_evwheel*);
+
+/* calls cb for every event within the wheel, in no particular order */
+void        rt_evwheel_for_each(rt_evwheel*, rt_evlist_cb cb);
+
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+
+
+#endif
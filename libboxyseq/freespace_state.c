@@ -24,19 +24,35 @@
 #include <string.h>     /* memset */
 
 
+#if     (FSWIDTH != 128 && FSWIDTH != 256) \
+     || (FSHEIGHT != 128 && FSHEIGHT != 256)
+    #error "FSWIDTH and FSHEIGHT must each be 128 or 256"
+#endif
+
+/* the summed-area table counts in 16 bits */
+#if FSWIDTH * FSHEIGHT > 65535
+    #error "FSWIDTH x FSHEIGHT must be less than 65536 cells"
+#endif
+
+
+/*  the bit arrays are square, sized for the larger of FSWIDTH and
+    FSHEIGHT, so that col_buf (see below) has the same shape as row_buf.
+    the cells outside of FSWIDTH x FSHEIGHT are kept used.
+*/
+#define FSBUFSIZE ((FSWIDTH > FSHEIGHT) ? FSWIDTH : FSHEIGHT)
+
+
 #ifdef USE_64BIT_ARRAY
-    #error  use of USE_64BIT_ARRAY is broken.
-    #error  use USE_32BIT_ARRAY instead.
     #define FSBUFBITS 64
-    #define FSBUFWIDTH 2
+    #define FSBUFWIDTH (FSBUFSIZE / 64)
     #define FSDIVSHIFT 6
     typedef uint64_t fsbuf_type;
-    #define TRAILING_ZEROS( v ) __builtin_ctzl( ( v ))
-    #define LEADING_ZEROS( v )  __builtin_clzl( ( v ))
+    #define TRAILING_ZEROS( v ) __builtin_ctzll( ( v ))
+    #define LEADING_ZEROS( v )  __builtin_clzll( ( v ))
 #else
 #ifdef USE_32BIT_ARRAY
     #define FSBUFBITS 32
-    #define FSBUFWIDTH 4
+    #define FSBUFWIDTH (FSBUFSIZE / 32)
     #define FSDIVSHIFT 5
     typedef uint32_t fsbuf_type;
     #define TRAILING_ZEROS( v ) __builtin_ctz( ( v ) )
@@ -44,7 +60,7 @@
 #else
 #ifdef USE_16BIT_ARRAY
     #define FSBUFBITS 16
-    #define FSBUFWIDTH 8
+    #define FSBUFWIDTH (FSBUFSIZE / 16)
     #define FSDIVSHIFT 4
     typedef uint16_t fsbuf_type;
     #define TRAILING_ZEROS( v ) __builtin_ctz(  0xffff0000 | ( v ))
@@ -52,7 +68,7 @@
 #else
 #ifdef USE_8BIT_ARRAY
     #define FSBUFBITS 8
-    #define FSBUFWIDTH 16
+    #define FSBUFWIDTH (FSBUFSIZE / 8)
     #define FSDIVSHIFT 3
     typedef uint8_t fsbuf_type;
     #define TRAILING_ZEROS( v ) __builtin_ctz(  0xffffff00 | ( v ))
@@ -60,7 +76,7 @@
 #else
     /* Sloooowwwwww */
     #define FSBUFBITS 1
-    #define FSBUFWIDTH 128
+    #define FSBUFWIDTH FSBUFSIZE
     #define FSDIVSHIFT 0
     typedef unsigned char fsbuf_type;
     #define TRAILING_ZEROS( v ) (( v ) ? 0 : 1)
@@ -71,10 +87,41 @@
 #endif
 
 
+/*  with 64 bit words a row of the grid is a few words, which lets
+    freespace_find work on a whole row at a time (see row_smart_band)
+    rather than word by word. #define FREESPACE_NO_BAND_SEARCH to use
+    the word by word search regardless.
+*/
+#if FSBUFBITS == 64 && !defined(FREESPACE_NO_BAND_SEARCH)
+    #define FS_BAND_SEARCH
+    #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        #define FS_BAND_X86
+        #include <immintrin.h>
+    #endif
+#endif
+
+
 static const fsbuf_type fsbuf_max =   ~(fsbuf_type)0;
 static const fsbuf_type fsbuf_high =  (fsbuf_type)1 << (FSBUFBITS - 1);
 
 
+#if defined(__GNUC__) && defined(__SSE2__)
+    #define FS_REFS_SSE2
+    #include <emmintrin.h>
+#endif
+
+
+#ifdef FS_BAND_SEARCH
+static void band_search_init(void);
+#endif
+
+#if FSBUFBITS >= 8
+static void sat_init(void);
+#endif
+
+static void mark_outside(freespace*);
+
+
 static void binary_dump(const char* msg, fsbuf_type val)
 {
     fsbuf_type i = FSBUFBITS;
@@ -94,57 +141,116 @@ static void binary_dump(const char* msg, fsbuf_type val)
 
 struct freespace_state
 {
+    /*  the grid in use is width x height, at most FSWIDTH x FSHEIGHT.
+        the arrays are always sized for the largest grid, with the space
+        outside of the grid in use marked as used so that it is never
+        found.
+    */
+    int width;
+    int height;
+
     /*  the freespace state is primarily stored in a pair of arrays. only a
         single array is required, but by optimizing with the usage of bits
         we are optimizing only for row-smart searches. the second array
         is a 90deg clockwise rotation of the first and is used for
         performing column smart searchs.
+
+        only row_buf is kept up to date as space is used and freed. the
+        8x8 tiles of row_buf changed since col_buf was last rotated from
+        it are rotated across, by transposing, when a column smart search
+        next needs col_buf. so grids which are only ever searched row
+        smart never pay for col_buf. col_dirty has a bit for each tile
+        in a row of tiles (the msb for the left-most).
     */
-    fsbuf_type row_buf[FSHEIGHT][FSBUFWIDTH];
-    fsbuf_type col_buf[FSHEIGHT][FSBUFWIDTH];
+    fsbuf_type row_buf[FSBUFSIZE][FSBUFWIDTH];
+    fsbuf_type col_buf[FSBUFSIZE][FSBUFWIDTH];
+    uint32_t col_dirty[FSBUFSIZE / 8];
+    bool col_clean;
 
     /*  so two arrays are sufficient until you realize that there are some
         cases where overlap is very definitely required (think user
         interaction via a gui). the block-areas must be allowed to overlap
-        existing used space when they are put down. so two more arrays are
-        needed for masking between the two types of used space:
-        block-areas and "natural" areas. and with the added rotation, that
-        extra two arrays becomes four.
+        existing used space, and each other, when they are put down, and
+        removing one must not wipe out any of the others. so each cell
+        has a count of the areas using it: removing space adds one to the
+        count of each cell in the area, adding space takes one away, and
+        a cell is used while its count is non-zero. the counts saturate
+        at UINT8_MAX, which is also how the cells outside of the grid are
+        kept used.
     */
-    fsbuf_type blk_row_buf[FSHEIGHT][FSBUFWIDTH];
-    fsbuf_type blk_col_buf[FSHEIGHT][FSBUFWIDTH];
+    uint8_t refs[FSHEIGHT][FSWIDTH];
 
-    fsbuf_type nat_row_buf[FSHEIGHT][FSBUFWIDTH];
-    fsbuf_type nat_col_buf[FSHEIGHT][FSBUFWIDTH];
+    /*  summed-area table of row_buf: sat[y][x] is the number of used
+        cells above and to the left of x, y. it lets the used space
+        within any area be counted from four entries. it is brought up
+        to date lazily, from the first row of row_buf changed since it
+        was last brought up to date (sat_dirty).
+    */
+    uint16_t sat[FSHEIGHT + 1][FSWIDTH + 1];
+    int sat_dirty;
+
+    /*  the number of free cells in each row of row_buf and col_buf,
+        which no run of free cells within the row can be longer than.
+        a row with fewer free cells than the width of an area (none at
+        all if it is full) can't be part of a band which fits it, so
+        the bands containing it can be skipped without being looked at.
+        row_free is kept up to date by mark_used and mark_unused, and
+        col_free along with col_buf.
+    */
+    uint16_t row_free[FSBUFSIZE];
+    uint16_t col_free[FSBUFSIZE];
 
-    /*  and we don't want removal of a block from a pair of intersecting
-        blocks to damage the remaining block so we store the coordinates.
-        because this must all be real-time safe we limit the number of
-        block areas - the user can realistically manage only so many anyway.
+    /*  the point FSPLACE_NEAREST places areas nearest to (-1 for the
+        corner of the boundary the placement flags start from), and the
+        state of the generator FSPLACE_RANDOM_FIT picks positions with.
     */
-    struct blk
-    {
-        int x, y, w, h;
-        struct blk* n;
-    } blklist[MAX_BLOCK_AREAS];
+    int target_x;
+    int target_y;
+    uint32_t seed;
 };
 
 
 freespace* freespace_new(void)
 {
-    freespace* fs = malloc(sizeof(*fs));
+    return freespace_new_size(FSWIDTH, FSHEIGHT);
+}
 
-    if (!fs)
+
+freespace* freespace_new_size(int width, int height)
+{
+    freespace* fs;
+
+    if (width < 1 || width > FSWIDTH || height < 1 || height > FSHEIGHT)
+    {
+        WARNING("invalid freespace grid size %d x %d\n", width, height);
+        return 0;
+    }
+
+    if (!(fs = malloc(sizeof(*fs))))
         return 0;
 
+    fs->width = width;
+    fs->height = height;
+    fs->target_x = fs->target_y = -1;
+    fs->seed = 1;
+
     if (FSBUFBITS == 1)
         WARNING("bit-size of freespace state array not defined!\n"
                 "things won't work properly!\n");
 
-    DMESSAGE("creating freespace grid using %d %d bit integers\n",
-                                      FSBUFWIDTH, FSBUFBITS);
+    DMESSAGE("creating %d x %d freespace grid using %d %d bit integers\n",
+                            width, height, FSBUFWIDTH, FSBUFBITS);
+
+    #if FSBUFBITS >= 8
+    sat_init();
+    #endif
+
+    memset(fs->sat, 0, sizeof(fs->sat));
+
+    #ifdef FS_BAND_SEARCH
+    band_search_init();
+    #endif
     freespace_clear(fs);
-    freespace_block_clear(fs);
 
     DMESSAGE("sizeof(freespace_state):%d\n", sizeof(*fs));
 
@@ -165,11 +271,47 @@ void freespace_clear(freespace* fs)
 {
     int y;
 
-    for (y = 0; y < FSHEIGHT; ++y)
+    for (y = 0; y < FSBUFSIZE; ++y)
     {
         memset(&fs->row_buf[y][0], 0, sizeof(fsbuf_type) * FSBUFWIDTH);
-        memset(&fs->col_buf[y][0], 0, sizeof(fsbuf_type) * FSBUFWIDTH);
+        fs->row_free[y] = FSBUFSIZE;
     }
+
+    fs->sat_dirty = 0;
+
+    for (y = 0; y < FSBUFSIZE / 8; ++y)
+        fs->col_dirty[y] = ~(UINT32_MAX >> 1 >> (FSBUFSIZE / 8 - 1));
+
+    fs->col_clean = false;
+
+    memset(fs->refs, 0, sizeof(fs->refs));
+
+    mark_outside(fs);
+}
+
+
+int freespace_width(freespace* fs)
+{
+    return fs->width;
+}
+
+
+int freespace_height(freespace* fs)
+{
+    return fs->height;
+}
+
+
+void freespace_target_set(freespace* fs, int x, int y)
+{
+    fs->target_x = x;
+    fs->target_y = y;
+}
+
+
+void freespace_seed(freespace* fs, uint32_t seed)
+{
+    fs->seed = seed ? seed : 1;
 }
 
 
@@ -181,7 +323,229 @@ static inline int x_to_index_offset(int x, int* offset)
 }
 
 
-static int row_smart_l2r(fsbuf_type buf[FSHEIGHT][FSBUFWIDTH],
+static inline void free_update(fsbuf_type buf[FSBUFSIZE][FSBUFWIDTH],
+                                uint16_t nfree[FSBUFSIZE],
+                                int y0, int height)
+{
+    int y, i;
+
+    for (y = y0; y < y0 + height; ++y)
+    {
+        int used = 0;
+
+        for (i = 0; i < FSBUFWIDTH; ++i)
+            used += __builtin_popcountll(buf[y][i]);
+
+        nfree[y] = FSBUFSIZE - used;
+    }
+}
+
+
+static inline void sat_dirty(freespace* fs, int y)
+{
+    if (y < fs->sat_dirty)
+        fs->sat_dirty = (y < 0) ? 0 : y;
+}
+
+
+/* the area x0, y0, width, height of row_buf is about to change */
+static inline void area_dirty(freespace* fs, int x0, int y0,
+                                            int width, int height)
+{
+    const int tx0 = x0 >> 3;
+    const int tx1 = (x0 + width - 1) >> 3;
+    const uint32_t tiles = (UINT32_MAX >> tx0)
+                         & ~(UINT32_MAX >> 1 >> tx1);
+    int ty;
+
+    sat_dirty(fs, y0);
+
+    for (ty = y0 >> 3; ty <= (y0 + height - 1) >> 3; ++ty)
+        fs->col_dirty[ty] |= tiles;
+
+    fs->col_clean = false;
+}
+
+
+#if FSBUFBITS >= 8
+
+/* the eight cells from 8 * tx of a row, the left-most in the msb */
+static inline unsigned tile_get(const fsbuf_type row[FSBUFWIDTH], int tx)
+{
+    int x = tx << 3;
+
+    return (row[x >> FSDIVSHIFT]
+                >> (FSBUFBITS - 8 - (x & (FSBUFBITS - 1)))) & 0xff;
+}
+
+
+static inline void tile_set(fsbuf_type row[FSBUFWIDTH], int tx, unsigned v)
+{
+    int x = tx << 3;
+    int shift = FSBUFBITS - 8 - (x & (FSBUFBITS - 1));
+    fsbuf_type* w = &row[x >> FSDIVSHIFT];
+
+    *w = (*w & ~((fsbuf_type)0xff << shift)) | ((fsbuf_type)v << shift);
+}
+
+
+/*  transposes an 8x8 block of bits, the top row in the most significant
+    byte (hacker's delight 7-3).
+*/
+static inline uint64_t tile_transpose(uint64_t x)
+{
+    uint64_t t;
+
+    t = (x ^ (x >> 7))  & 0x00AA00AA00AA00AAULL;    x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;    x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;    x ^= t ^ (t << 28);
+
+    return x;
+}
+
+#endif
+
+
+/*  rotates the changed tiles of row_buf into col_buf: cell x, y of
+    row_buf is cell FSBUFSIZE - 1 - y, x of col_buf. taking the rows of
+    a tile bottom up, the transpose of the tile is the rotation.
+*/
+static void col_update(freespace* fs)
+{
+    uint32_t cols = 0;
+    int ty, tx;
+
+    for (ty = 0; ty < FSBUFSIZE / 8; ++ty)
+    {
+        uint32_t tiles = fs->col_dirty[ty];
+
+        cols |= tiles;
+        fs->col_dirty[ty] = 0;
+
+        while (tiles)
+        {
+            int i;
+
+            tx = __builtin_clz(tiles);
+            tiles &= ~(UINT32_C(0x80000000) >> tx);
+
+            #if FSBUFBITS >= 8
+            uint64_t t = 0;
+
+            for (i = 0; i < 8; ++i)
+                t = (t << 8) | tile_get(fs->row_buf[ty * 8 + 7 - i], tx);
+
+            t = tile_transpose(t);
+
+            for (i = 0; i < 8; ++i)
+                tile_set(fs->col_buf[tx * 8 + i], FSBUFSIZE / 8 - 1 - ty,
+                                    (unsigned)(t >> (56 - i * 8)) & 0xff);
+            #else
+            int j;
+
+            for (i = 0; i < 8; ++i)
+                for (j = 0; j < 8; ++j)
+                    fs->col_buf[tx * 8 + j][FSBUFSIZE - 1 - (ty * 8 + i)]
+                                    = fs->row_buf[ty * 8 + i][tx * 8 + j];
+            #endif
+        }
+    }
+
+    while (cols)
+    {
+        tx = __builtin_clz(cols);
+        cols &= ~(UINT32_C(0x80000000) >> tx);
+        free_update(fs->col_buf, fs->col_free, tx * 8, 8);
+    }
+
+    fs->col_clean = true;
+}
+
+
+#if FSBUFBITS >= 8
+/*  byte_prefix[b][i] is the number of bits set in the i + 1 most
+    significant bits of the byte b.
+*/
+static uint16_t byte_prefix[256][8];
+
+/* eight sat entries */
+typedef uint16_t sat_vec __attribute__((vector_size(16)));
+
+
+static void sat_init(void)
+{
+    int b, i;
+
+    for (b = 0; b < 256; ++b)
+        for (i = 0; i < 8; ++i)
+            byte_prefix[b][i] = (i ? byte_prefix[b][i - 1] : 0)
+                                + ((b >> (7 - i)) & 1);
+}
+#endif
+
+
+static void sat_update(freespace* fs)
+{
+    /* the sat is only ever read within the grid in use */
+    const int words = (fs->width + FSBUFBITS - 1) >> FSDIVSHIFT;
+    int y;
+
+    for (y = fs->sat_dirty; y < fs->height; ++y)
+    {
+        const uint16_t* restrict above = fs->sat[y] + 1;
+        uint16_t* restrict sat = fs->sat[y + 1] + 1;
+        uint16_t used = 0;
+        int index;
+
+        for (index = 0; index < words; ++index)
+        {
+            fsbuf_type b = fs->row_buf[y][index];
+
+            #if FSBUFBITS >= 8
+            int shift;
+
+            /* eight cells at a time */
+            for (shift = FSBUFBITS - 8; shift >= 0; shift -= 8)
+            {
+                const uint16_t* prefix = byte_prefix[(b >> shift) & 0xff];
+                sat_vec v, p;
+
+                memcpy(&v, above, sizeof(v));
+                memcpy(&p, prefix, sizeof(p));
+                v += p + used;
+                memcpy(sat, &v, sizeof(v));
+
+                used += prefix[7];
+                sat += 8;
+                above += 8;
+            }
+            #else
+            int offset;
+
+            for (offset = FSBUFBITS - 1; offset >= 0; --offset)
+            {
+                used += (b >> offset) & 1;
+                *sat++ = *above++ + used;
+            }
+            #endif
+        }
+    }
+
+    fs->sat_dirty = FSHEIGHT;
+}
+
+
+/* the sat must be up to date */
+static inline int sat_used(freespace* fs, int x, int y, int w, int h)
+{
+    return    fs->sat[y + h][x + w] - fs->sat[y][x + w]
+            - fs->sat[y + h][x]     + fs->sat[y][x];
+}
+
+
+#ifndef FS_BAND_SEARCH
+
+static int row_smart_l2r(fsbuf_type buf[FSBUFSIZE][FSBUFWIDTH],
                         int bx, int by, int bw, int bh, int flags,
                         int width, int height, int *resultx, int *resulty)
 {
@@ -306,7 +670,7 @@ retry:
 
             for (h = 0; h < height; ++h)
             {
-                int v = buf[y + h * ydir][index] & mask;
+                fsbuf_type v = buf[y + h * ydir][index] & mask;
 
                 if (v)
                 {
@@ -373,7 +737,7 @@ retry:
 }
 
 
-static int row_smart_r2l(fsbuf_type buf[FSHEIGHT][FSBUFWIDTH],
+static int row_smart_r2l(fsbuf_type buf[FSBUFSIZE][FSBUFWIDTH],
                         int bx, int by, int bw, int bh, int flags,
                         int width, int height, int *resultx, int *resulty)
 {
@@ -496,7 +860,7 @@ retry:
 
             for (h = 0; h < height; ++h)
             {
-                int v = buf[y + h * ydir][index] & mask;
+                fsbuf_type v = buf[y + h * ydir][index] & mask;
 
                 if (v)
                 {
@@ -555,385 +919,1288 @@ retry:
 }
 
 
-bool freespace_find( freespace* fs,  basebox* boundary,
-                        int flags,
-                        int width,      int height,
-                        int* resultx,   int* resulty    )
+static bool row_smart(freespace* fs, bool rotated,
+                        fsbuf_type buf[FSBUFSIZE][FSBUFWIDTH],
+                        int bx, int by, int bw, int bh, int flags, int from,
+                        int width, int height, int *resultx, int *resulty)
 {
-    *resultx = *resulty = -1;
+    const uint16_t* nfree = rotated ? fs->col_free : fs->row_free;
+    int y;
+    int rows = 0;
 
-    #ifdef FSDEBUG
-    char* pstr = freespace_placement_to_str(flags);
-    DMESSAGE("\n---------------------------\n"
-             "flags:%s\tarea w:%d, h:%d\n"
-             "boundary x:%d,y:%d, w:%d, h:%d\n", pstr, width, height,
-             boundary->x, boundary->y, boundary->w, boundary->h);
-    #endif
+    (void)from;
 
-    if (width  < 1 || width  > boundary->w
-     || height < 1 || height > boundary->h)
-    {
-        #ifdef FSDEBUG
-        DWARNING("\ninvalid area or area does not fit in boundary\n");
-        #endif
+    /*  reject outright unless height rows in succession have enough
+        free cells for width.
+    */
+    for (y = by; y < by + bh && rows < height; ++y)
+        rows = (nfree[y] < width) ? 0 : rows + 1;
+
+    if (rows < height)
         return false;
-    }
 
-    if (flags & FSPLACE_ROW_SMART)
-    {
-        if (flags & FSPLACE_LEFT_TO_RIGHT)
-        {
-            return row_smart_l2r(fs->row_buf,
-                                    boundary->x, boundary->y,
-                                    boundary->w, boundary->h,
-                                    flags,
-                                    width, height, resultx, resulty);
-        }
-        else
-        {
-            return row_smart_r2l(fs->row_buf,
-                                    boundary->x, boundary->y,
-                                    boundary->w, boundary->h,
-                                    flags,
+    return (flags & FSPLACE_LEFT_TO_RIGHT)
+            ? row_smart_l2r(buf, bx, by, bw, bh, flags,
+                                    width, height, resultx, resulty)
+            : row_smart_r2l(buf, bx, by, bw, bh, flags,
                                     width, height, resultx, resulty);
-        }
-    }
-    else
-    {
-        /*  the row smart algorithm can be used for column-smart by
-            rotating 90 degrees clockwise...
-        */
-        bool ret;
+}
 
-        int rx = FSWIDTH - boundary->y - boundary->h;
-        int ry = boundary->x;
+#else /* FS_BAND_SEARCH */
+
+/*  band search
+ *---------------
+ *  the rows y to y + height - 1 are or'd together into a band. a free
+ *  area of width x height exists in the band wherever there is a run of
+ *  width zero bits. the runs are found by repeatedly and-ing the free
+ *  bits with themselves shifted by the length of run found so far,
+ *  doubling the run length each time, so a run of any width takes at
+ *  most 8 steps.
+ *
+ *  the or-ing of rows is where the time goes so it is done with SSE2
+ *  (two words per register) or AVX2 (four words per register, or two
+ *  rows of a 128 wide grid) when the CPU has them.
+ *
+ *  a band is a row of words, w[0] holds x 0 to 63, w[1] x 64 to 127 and
+ *  so on, and like the rest of the freespace state, x increases toward
+ *  the least significant bit. only the pairs of words covering the
+ *  boundary, words lo to hi - 1, are worked on.
+ */
 
-        int rflags = (flags & FSPLACE_LEFT_TO_RIGHT)
-                            ? FSPLACE_TOP_TO_BOTTOM
-                            : 0;
+typedef void (*fs_band_or_fn)(fsbuf_type buf[FSBUFSIZE][FSBUFWIDTH],
+                                int y, int height, int lo, int hi,
+                                fsbuf_type band[FSBUFWIDTH]);
 
-        rflags |= (flags & FSPLACE_TOP_TO_BOTTOM)
-                            ? 0
-                            : FSPLACE_LEFT_TO_RIGHT;
 
-        #ifdef FSDEBUG
-        pstr = freespace_placement_to_str(rflags);
-        DMESSAGE("\n---------------------------\n"
-             "rflags:%s\tarea w:%d, h:%d\n"
-             "boundary rx:%d, ry:%d, w:%d, h:%d\n", pstr, width, height,
-             rx, ry, boundary->w, boundary->h);
-        #endif
+static void band_or_scalar(fsbuf_type buf[FSBUFSIZE][FSBUFWIDTH],
+                                int y, int height, int lo, int hi,
+                                fsbuf_type band[FSBUFWIDTH])
+{
+    int i;
 
+    for (i = lo; i < hi; i += 2)
+    {
+        fsbuf_type w0 = 0;
+        fsbuf_type w1 = 0;
+        int n;
 
-        if (rflags & FSPLACE_LEFT_TO_RIGHT)
-        {
-            ret = row_smart_l2r(fs->col_buf,
-                                    rx,     ry,
-                                    boundary->h, boundary->w,
-                                    rflags,
-                                    height, width, resultx, resulty);
-        }
-        else
+        for (n = y; n < y + height; ++n)
         {
-            ret = row_smart_r2l(fs->col_buf,
-                                    rx,     ry,
-                                    boundary->h, boundary->w,
-                                    rflags,
-                                    height, width, resultx, resulty);
+            w0 |= buf[n][i];
+            w1 |= buf[n][i + 1];
         }
 
-        if (!ret)
-            return false;
+        band[i] = w0;
+        band[i + 1] = w1;
+    }
+}
 
-        /* translate result back by 'rotation' 90 anti-clockwise */
 
-        rx = *resultx;
-        *resultx = *resulty;
-        *resulty = FSWIDTH - rx - height;
+#ifdef FS_BAND_X86
 
-        return true;
-    }
+__attribute__((target("sse2")))
+static void band_or_sse2(fsbuf_type buf[FSBUFSIZE][FSBUFWIDTH],
+                                int y, int height, int lo, int hi,
+                                fsbuf_type band[FSBUFWIDTH])
+{
+    int i;
 
-    WARNING("unrecognized placement flags:%d\n", flags);
-    return false;
+    for (i = lo; i < hi; i += 2)
+    {
+        __m128i acc = _mm_setzero_si128();
+        int n;
+
+        for (n = y; n < y + height; ++n)
+            acc = _mm_or_si128(acc, _mm_loadu_si128((__m128i*)&buf[n][i]));
+
+        _mm_storeu_si128((__m128i*)&band[i], acc);
+    }
 }
 
 
-/*  mark_used marks an area in the freespace grid as used space. it must
-    operate on two or three arrays.
- */
-static void mark_used(  fsbuf_type buf_row[FSHEIGHT][FSBUFWIDTH],
-                        fsbuf_type buf_col[FSHEIGHT][FSBUFWIDTH],
-                        fsbuf_type aux_row[FSHEIGHT][FSBUFWIDTH],
-                        fsbuf_type aux_col[FSHEIGHT][FSBUFWIDTH],
-                        int x0, int y0, int w0, int h0 )
+__attribute__((target("avx2")))
+static void band_or_avx2(fsbuf_type buf[FSBUFSIZE][FSBUFWIDTH],
+                                int y, int height, int lo, int hi,
+                                fsbuf_type band[FSBUFWIDTH])
 {
-    int rx, ry;
-    int width = w0;
-    int height = h0;
-    int offset = 0;
-    int index = x_to_index_offset(x0, &offset);
+    #if FSBUFWIDTH == 2
+    __m256i acc2 = _mm256_setzero_si256();
+    __m128i acc;
 
-    #ifdef FSDEBUG
-    DMESSAGE("x:%d y:%d, width:%d, height:%d\n",x0,y0,width,height);
-    DMESSAGE("index:%d offset:%d\n",index,offset);
-    #endif
+    (void)lo;
+    (void)hi;
 
-    for (; width > 0 && index < FSBUFWIDTH; ++index)
+    /* rows are contiguous, so two rows per load */
+    for (; height > 1; height -= 2, y += 2)
+        acc2 = _mm256_or_si256(acc2,
+                                _mm256_loadu_si256((__m256i*)buf[y]));
+
+    acc = _mm_or_si128(_mm256_castsi256_si128(acc2),
+                        _mm256_extracti128_si256(acc2, 1));
+
+    if (height)
+        acc = _mm_or_si128(acc, _mm_loadu_si128((__m128i*)buf[y]));
+
+    _mm_storeu_si128((__m128i*)band, acc);
+    #else
+    int i;
+
+    for (i = lo; i + 4 <= hi; i += 4)
+    {
+        __m256i acc = _mm256_setzero_si256();
+        int n;
+
+        for (n = y; n < y + height; ++n)
+            acc = _mm256_or_si256(acc,
+                                _mm256_loadu_si256((__m256i*)&buf[n][i]));
+
+        _mm256_storeu_si256((__m256i*)&band[i], acc);
+    }
+
+    if (i < hi)
+    {
+        __m128i acc = _mm_setzero_si128();
+        int n;
+
+        for (n = y; n < y + height; ++n)
+            acc = _mm_or_si128(acc, _mm_loadu_si128((__m128i*)&buf[n][i]));
+
+        _mm_storeu_si128((__m128i*)&band[i], acc);
+    }
+    #endif
+}
+
+#endif
+
+
+static fs_band_or_fn band_or = band_or_scalar;
+
+
+static void band_search_init(void)
+{
+    #ifndef NDEBUG
+    const char* name = "scalar";
+    #endif
+
+    #ifdef FS_BAND_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        band_or = band_or_avx2;
+        #ifndef NDEBUG
+        name = "AVX2";
+        #endif
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        band_or = band_or_sse2;
+        #ifndef NDEBUG
+        name = "SSE2";
+        #endif
+    }
+    #endif
+
+    DMESSAGE("freespace band search using %s\n", name);
+}
+
+
+/* bits of x0 to x1 inclusive, within words lo to hi - 1 */
+static inline void band_range(int x0, int x1, int lo, int hi,
+                                            fsbuf_type band[FSBUFWIDTH])
+{
+    int n;
+
+    for (n = lo; n < hi; ++n)
+    {
+        int l = x0 - n * FSBUFBITS;
+        int h = x1 - n * FSBUFBITS;
+
+        if (l < 0)
+            l = 0;
+
+        if (h > FSBUFBITS - 1)
+            h = FSBUFBITS - 1;
+
+        band[n] = (l > h) ? 0
+                : (fsbuf_max >> l) & (fsbuf_max << (FSBUFBITS - 1 - h));
+    }
+}
+
+
+/*  bit for x of the result is set if the bit for x + shift is set, the
+    words from hi on being taken as clear.
+*/
+static inline void band_shift(const fsbuf_type band[FSBUFWIDTH],
+                                int shift, int lo, int hi,
+                                fsbuf_type result[FSBUFWIDTH])
+{
+    const int q = shift >> FSDIVSHIFT;
+    const int r = shift & (FSBUFBITS - 1);
+    int n;
+
+    for (n = lo; n < hi; ++n)
+    {
+        fsbuf_type w0 = (n + q < hi) ? band[n + q] : 0;
+        fsbuf_type w1 = (n + q + 1 < hi) ? band[n + q + 1] : 0;
+
+        result[n] = r ? (w0 << r) | (w1 >> (FSBUFBITS - r)) : w0;
+    }
+}
+
+
+/*  rotated: buf is col_buf, in which case the area x, y, w, h of buf
+    is the area y, FSBUFSIZE - x - w, h, w of row_buf (and the sat).
+*/
+static bool row_smart(freespace* fs, bool rotated,
+                        fsbuf_type buf[FSBUFSIZE][FSBUFWIDTH],
+                        int bx, int by, int bw, int bh, int flags, int from,
+                        int width, int height, int *resultx, int *resulty)
+{
+    /* y is the top row of the band */
+    bool t2b = (flags & FSPLACE_TOP_TO_BOTTOM);
+    int y0 =        t2b ? by : by + bh - height;
+    const int y1 =  t2b ? by + bh - height : by;
+    const int ydir = t2b ? 1 : -1;
+
+    const uint16_t* nfree = rotated ? fs->col_free : fs->row_free;
+
+    /* the pairs of words covering the boundary, all of them if one */
+    const int lo = (FSBUFWIDTH == 2) ? 0 : (bx >> FSDIVSHIFT) & ~1;
+    const int hi = (FSBUFWIDTH == 2) ? 2
+                 : (((bx + bw - 1) >> FSDIVSHIFT) | 1) + 1;
+
+    fsbuf_type bound[FSBUFWIDTH];
+    int y;
+
+    /*  rows from y to good (or from good to the bottom of the
+        band when searching bottom to top) are known to have enough
+        free cells. as the band moves along only the rows entering it
+        are checked, and when one has too few, every band containing it
+        is skipped.
+    */
+    int good;
+
+    /* bands before from are already known not to fit (see find_many) */
+    if (from >= 0 && (t2b ? from > y0 : from < y0))
+        y0 = from;
+
+    good = t2b ? y0 - 1 : y0 + height;
+
+    /* more used space than this and the band can't fit the area */
+    const int max_used = (bw - width) * height;
+
+    /*  only bring the sat up to date if doing so is likely to cost
+        less than or-ing together the rows of every band would. a row
+        of the sat costs about the same as or-ing 64 rows.
+    */
+    bool use_sat = (fs->sat_dirty == FSHEIGHT);
+
+    if (!use_sat && (bh - height + 1) * height
+                        > (FSHEIGHT - fs->sat_dirty) * 64)
+    {
+        sat_update(fs);
+        use_sat = true;
+    }
+
+    band_range(bx, bx + bw - 1, lo, hi, bound);
+
+    for (y = y0; t2b ? y <= y1 : y >= y1; y += ydir)
+    {
+        fsbuf_type run[FSBUFWIDTH];
+        fsbuf_type any = 0;
+        int len, n;
+
+        if (t2b)
+        {
+            if (good < y - 1)
+                good = y - 1;
+
+            while (good < y + height - 1 && nfree[good + 1] >= width)
+                ++good;
+
+            if (good < y + height - 1)
+            {
+                y = ++good; /* the next band starts past the row */
+                continue;
+            }
+        }
+        else
+        {
+            if (good > y + height)
+                good = y + height;
+
+            while (good > y && nfree[good - 1] >= width)
+                --good;
+
+            if (good > y)
+            {
+                y = --good - height + 1;
+                continue;
+            }
+        }
+
+        if (use_sat && (rotated
+                        ? sat_used(fs, y, FSBUFSIZE - bx - bw, height, bw)
+                        : sat_used(fs, bx, y, bw, height)) > max_used)
+        {
+            continue;
+        }
+
+        band_or(buf, y, height, lo, hi, run);
+
+        for (n = lo; n < hi; ++n)
+            any |= run[n] = ~run[n] & bound[n];
+
+        /* leaves the bit for x set if width bits from x are free */
+        for (len = 1; len < width && any; )
+        {
+            fsbuf_type shifted[FSBUFWIDTH];
+            int shift = (len < width - len) ? len : width - len;
+
+            band_shift(run, shift, lo, hi, shifted);
+
+            for (any = 0, n = lo; n < hi; ++n)
+                any |= run[n] &= shifted[n];
+
+            len += shift;
+        }
+
+        if (!any)
+            continue;
+
+        if (flags & FSPLACE_LEFT_TO_RIGHT)
+        {
+            for (n = lo; !run[n]; ++n)
+                ;
+
+            *resultx = n * FSBUFBITS + LEADING_ZEROS(run[n]);
+        }
+        else
+        {
+            for (n = hi - 1; !run[n]; --n)
+                ;
+
+            *resultx = n * FSBUFBITS + FSBUFBITS - 1
+                                     - TRAILING_ZEROS(run[n]);
+        }
+
+        *resulty = y;
+        return true;
+    }
+
+    return false;
+}
+
+#endif /* FS_BAND_SEARCH */
+
+
+/*  placement strategies other than first-fit
+    ---------------------------------------------
+    these don't scan for the first position an area fits at but choose
+    amongst every position it fits at within the boundary. the positions
+    are found a whole row at a time: each row of the grid is taken as
+    FSFITWORDS 64 bit masks of its free cells (the left-most cell in the
+    msb of the first), and ANDing a mask with itself shifted left by doubling
+    amounts leaves set only the cells which start a run of free cells as
+    wide as the area. ANDing each of those rows with the rows beneath it,
+    again by doubling amounts, leaves set only the positions at which the
+    whole area is free.
+*/
+
+#define FSFITWORDS (FSWIDTH / 64)
+
+
+/* n is at least 1 */
+static inline void fit_shl(uint64_t m[FSFITWORDS], int n)
+{
+    int i;
+
+    for (; n >= 64; n -= 64)
+    {
+        for (i = 0; i < FSFITWORDS - 1; ++i)
+            m[i] = m[i + 1];
+
+        m[i] = 0;
+    }
+
+    if (!n)
+        return;
+
+    for (i = 0; i < FSFITWORDS - 1; ++i)
+        m[i] = (m[i] << n) | (m[i + 1] >> (64 - n));
+
+    m[i] <<= n;
+}
+
+
+/* sets m to the cells x0 to x1 - 1 */
+static inline void fit_range(uint64_t m[FSFITWORDS], int x0, int x1)
+{
+    int i;
+
+    for (i = 0; i < FSFITWORDS; ++i, x0 -= 64, x1 -= 64)
+    {
+        uint64_t lo = (x0 <= 0) ? UINT64_MAX
+                    : (x0 >= 64) ? 0 : UINT64_MAX >> x0;
+        uint64_t hi = (x1 <= 0) ? UINT64_MAX
+                    : (x1 >= 64) ? 0 : UINT64_MAX >> x1;
+        m[i] = lo & ~hi;
+    }
+}
+
+
+/* the first set cell at or after x, or -1 */
+static inline int fit_next(const uint64_t m[FSFITWORDS], int x)
+{
+    uint64_t r[FSFITWORDS];
+    int i;
+
+    fit_range(r, x, FSWIDTH);
+
+    for (i = 0; i < FSFITWORDS; ++i)
+        if (m[i] & r[i])
+            return i * 64 + __builtin_clzll(m[i] & r[i]);
+
+    return -1;
+}
+
+
+/* the last set cell at or before x, or -1 */
+static inline int fit_prev(const uint64_t m[FSFITWORDS], int x)
+{
+    uint64_t r[FSFITWORDS];
+    int i;
+
+    fit_range(r, 0, x + 1);
+
+    for (i = FSFITWORDS - 1; i >= 0; --i)
+        if (m[i] & r[i])
+            return i * 64 + 63 - __builtin_ctzll(m[i] & r[i]);
+
+    return -1;
+}
+
+
+static inline bool fit_test(const uint64_t m[FSFITWORDS], int x)
+{
+    return (m[x >> 6] >> (63 - (x & 63))) & 1;
+}
+
+
+/* sets m to the free cells of row y */
+static inline void fit_row(freespace* fs, int y, uint64_t m[FSFITWORDS])
+{
+    const fsbuf_type* row = fs->row_buf[y];
+    int j;
+
+    #if FSBUFBITS == 64
+    for (j = 0; j < FSFITWORDS; ++j)
+        m[j] = ~row[j];
+    #else
+    for (j = 0; j < FSFITWORDS; ++j)
+        m[j] = 0;
+
+    for (j = 0; j < FSWIDTH / FSBUFBITS; ++j)
+    {
+        int x = j << FSDIVSHIFT;
+        uint64_t v = (fsbuf_type)~row[j] & fsbuf_max;
+
+        #if FSBUFBITS == 1
+        v &= 1;
+        #endif
+
+        m[x >> 6] |= v << (64 - FSBUFBITS - (x & 63));
+    }
+    #endif
+}
+
+
+static inline void fit_and(uint64_t m[FSFITWORDS],
+                            const uint64_t t[FSFITWORDS])
+{
+    int i;
+
+    for (i = 0; i < FSFITWORDS; ++i)
+        m[i] &= t[i];
+}
+
+
+/* and's m with itself shifted left by n */
+static inline void fit_and_shl(uint64_t m[FSFITWORDS], int n)
+{
+    uint64_t t[FSFITWORDS];
+
+    memcpy(t, m, sizeof(t));
+    fit_shl(t, n);
+    fit_and(m, t);
+}
+
+
+/*  sets pos[i] to the positions within the boundary the area can be
+    placed at on row by + i, and returns the number of such rows.
+*/
+static int fit_positions(freespace* fs, int bx, int by, int bw, int bh,
+                                        int width, int height,
+                                        uint64_t pos[FSHEIGHT][FSFITWORDS])
+{
+    uint64_t bound[FSFITWORDS];
+    int i, len;
+
+    fit_range(bound, bx, bx + bw);
+
+    for (i = 0; i < bh; ++i)
+    {
+        uint64_t* m = pos[i];
+
+        fit_row(fs, by + i, m);
+        fit_and(m, bound);
+
+        for (len = 1; len * 2 <= width; len *= 2)
+            fit_and_shl(m, len);
+
+        if (len < width)
+            fit_and_shl(m, width - len);
+    }
+
+    for (len = 1; len * 2 <= height; len *= 2)
+        for (i = 0; i + len * 2 <= bh; ++i)
+            fit_and(pos[i], pos[i + len]);
+
+    if (len < height)
+        for (i = 0; i + height <= bh; ++i)
+            fit_and(pos[i], pos[i + height - len]);
+
+    return bh - height + 1;
+}
+
+
+/*  the position nearest to the target, or to the corner of the boundary
+    the placement flags start from. rows are taken in order outwards
+    from the target until no nearer position can be in them.
+*/
+static bool fit_nearest(freespace* fs, uint64_t pos[FSHEIGHT][FSFITWORDS],
+                                    int rows,
+                                    int bx, int by, int bw, int bh,
+                                    int flags, int width, int height,
+                                    int* resultx, int* resulty)
+{
+    int tx = fs->target_x;
+    int ty = fs->target_y;
+    int best = INT32_MAX;
+    int d, dmax;
+
+    if (tx < 0)
+        tx = (flags & FSPLACE_LEFT_TO_RIGHT) ? bx : bx + bw - width;
+
+    if (ty < 0)
+        ty = (flags & FSPLACE_TOP_TO_BOTTOM) ? by : by + bh - height;
+
+    /* the furthest row from the target */
+    dmax = (ty - by > by + rows - 1 - ty) ? ty - by : by + rows - 1 - ty;
+
+    for (d = 0; d <= dmax && d * d < best; ++d)
+    {
+        int k;
+
+        for (k = 0; k < 2; ++k)
+        {
+            /* the row the flags start from first when equally near */
+            int y = ((k == 0) == !!(flags & FSPLACE_TOP_TO_BOTTOM))
+                                        ? ty - d : ty + d;
+            int i = y - by;
+            int c, x;
+
+            if ((k && !d) || i < 0 || i >= rows)
+                continue;
+
+            for (c = 0; c < 2; ++c)
+            {
+                if ((c == 0) == !!(flags & FSPLACE_LEFT_TO_RIGHT))
+                    x = fit_prev(pos[i], tx);
+                else
+                    x = fit_next(pos[i], tx);
+
+                if (x >= 0 && (x - tx) * (x - tx) + d * d < best)
+                {
+                    best = (x - tx) * (x - tx) + d * d;
+                    *resultx = x;
+                    *resulty = y;
+                }
+            }
+        }
+    }
+
+    return best != INT32_MAX;
+}
+
+
+/*  the position which leaves the smallest gap about the area: the
+    fewest other positions it could slide to across and down. each run
+    of positions across is tried at the end the placement flags start
+    from.
+*/
+static bool fit_best(uint64_t pos[FSHEIGHT][FSFITWORDS], int rows, int by,
+                                    int flags, int* resultx, int* resulty)
+{
+    int best = INT32_MAX;
+    int n;
+
+    for (n = 0; n < rows && best; ++n)
+    {
+        int i = (flags & FSPLACE_TOP_TO_BOTTOM) ? n : rows - 1 - n;
+        int x0 = fit_next(pos[i], 0);
+
+        while (x0 >= 0 && best)
+        {
+            uint64_t clear[FSFITWORDS];
+            int x1, x, gap, j;
+
+            for (j = 0; j < FSFITWORDS; ++j)
+                clear[j] = ~pos[i][j];
+
+            x1 = fit_next(clear, x0);
+            x = (flags & FSPLACE_LEFT_TO_RIGHT)
+                            ? x0 : ((x1 < 0) ? FSWIDTH : x1) - 1;
+            gap = ((x1 < 0) ? FSWIDTH : x1) - x0 - 1;
+
+            for (j = i - 1; j >= 0 && gap < best
+                                   && fit_test(pos[j], x); --j)
+                ++gap;
+
+            for (j = i + 1; j < rows && gap < best
+                                     && fit_test(pos[j], x); ++j)
+                ++gap;
+
+            if (gap < best)
+            {
+                best = gap;
+                *resultx = x;
+                *resulty = by + i;
+            }
+
+            x0 = (x1 < 0) ? -1 : fit_next(pos[i], x1);
+        }
+    }
+
+    return best != INT32_MAX;
+}
+
+
+/*  any one of the positions, chosen by the freespace's own generator
+    so that placements can be reproduced by seeding it.
+*/
+static bool fit_random(freespace* fs, uint64_t pos[FSHEIGHT][FSFITWORDS],
+                                    int rows, int by,
+                                    int* resultx, int* resulty)
+{
+    uint32_t r;
+    int i, w, k, total = 0;
+
+    for (i = 0; i < rows; ++i)
+        for (w = 0; w < FSFITWORDS; ++w)
+            total += __builtin_popcountll(pos[i][w]);
+
+    if (!total)
+        return false;
+
+    /* xorshift32 */
+    r = fs->seed;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    fs->seed = r;
+
+    k = (int)(r % (uint32_t)total);
+
+    /* the words of each row in turn, the rows one after another */
+    for (i = 0, w = 0; ; ++w)
+    {
+        int c;
+        uint64_t m;
+
+        if (w == FSFITWORDS)
+        {
+            w = 0;
+            ++i;
+        }
+
+        c = __builtin_popcountll(pos[i][w]);
+
+        if (k >= c)
+        {
+            k -= c;
+            continue;
+        }
+
+        for (m = pos[i][w]; k; --k)
+            m &= ~((uint64_t)1 << (63 - __builtin_clzll(m)));
+
+        *resultx = w * 64 + __builtin_clzll(m);
+        *resulty = by + i;
+
+        return true;
+    }
+}
+
+
+static bool fit(freespace* fs, basebox* boundary, int flags,
+                        int width,      int height,
+                        int* resultx,   int* resulty    )
+{
+    uint64_t pos[FSHEIGHT][FSFITWORDS];
+    int rows;
+
+    rows = fit_positions(fs, boundary->x, boundary->y,
+                             boundary->w, boundary->h,
+                             width, height, pos);
+
+    switch (flags & FSPLACE_STRATEGY_MASK)
+    {
+    case FSPLACE_NEAREST:
+        return fit_nearest(fs, pos, rows,
+                                boundary->x, boundary->y,
+                                boundary->w, boundary->h,
+                                flags, width, height, resultx, resulty);
+    case FSPLACE_BEST_FIT:
+        return fit_best(pos, rows, boundary->y, flags, resultx, resulty);
+
+    case FSPLACE_RANDOM_FIT:
+        return fit_random(fs, pos, rows, boundary->y, resultx, resulty);
+    }
+
+    return false;
+}
+
+
+/*  from is the band (row, or column when column smart) to start the
+    search at, or -1 to search the whole boundary.
+*/
+static bool find(freespace* fs, basebox* boundary, int flags, int from,
+                        int width,      int height,
+                        int* resultx,   int* resulty    )
+{
+    basebox clipped;
+
+    *resultx = *resulty = -1;
+
+    #ifdef FSDEBUG
+    char* pstr = freespace_placement_to_str(flags);
+    DMESSAGE("\n---------------------------\n"
+             "flags:%s\tarea w:%d, h:%d\n"
+             "boundary x:%d,y:%d, w:%d, h:%d\n", pstr, width, height,
+             boundary->x, boundary->y, boundary->w, boundary->h);
+    #endif
+
+    if (boundary->x + boundary->w > fs->width
+     || boundary->y + boundary->h > fs->height)
     {
-        int y;
-        fsbuf_type v;
+        /* clip the boundary to the grid in use */
+        clipped = *boundary;
 
-        if (width < offset + 1)
-            v = (((fsbuf_type)1 << width) - 1) << (offset - width + 1);
-        else
-            v = (((fsbuf_type)1 << offset) - 1) << 1 | 1;
+        if (clipped.x + clipped.w > fs->width)
+            clipped.w = fs->width - clipped.x;
 
-        for (y = y0; y < y0 + height; ++y)
+        if (clipped.y + clipped.h > fs->height)
+            clipped.h = fs->height - clipped.y;
+
+        boundary = &clipped;
+    }
+
+    if (width  < 1 || width  > boundary->w
+     || height < 1 || height > boundary->h)
+    {
+        #ifdef FSDEBUG
+        DWARNING("\ninvalid area or area does not fit in boundary\n");
+        #endif
+        return false;
+    }
+
+    if (flags & FSPLACE_STRATEGY_MASK)
+    {
+        if (!fit(fs, boundary, flags, width, height, resultx, resulty))
         {
-            buf_row[y][index] |= v;
-            aux_row[y][index] |= v;
+            *resultx = *resulty = -1;
+            return false;
         }
 
-        width -= offset + 1;
-        offset = FSBUFBITS - 1;
+        return true;
     }
 
-    width = h0;
-    height = w0;
-    offset = 0;
-    rx = FSWIDTH - y0 - h0;
-    ry = x0;
-    index = x_to_index_offset(rx, &offset);
+    if (flags & FSPLACE_ROW_SMART)
+    {
+        return row_smart(fs, false, fs->row_buf,
+                                boundary->x, boundary->y,
+                                boundary->w, boundary->h,
+                                flags, from,
+                                width, height, resultx, resulty);
+    }
+    else
+    {
+        /*  the row smart algorithm can be used for column-smart by
+            rotating 90 degrees clockwise...
+        */
+        bool ret;
 
-    #ifdef FSDEBUG
-    DMESSAGE("rx:%d ry:%d, width:%d, height:%d\n",rx,ry,width,height);
-    DMESSAGE("index:%d offset:%d\n",index,offset);
-    #endif
+        int rx = FSBUFSIZE - boundary->y - boundary->h;
+        int ry = boundary->x;
 
-    for (; width > 0 && index < FSBUFWIDTH; ++index)
-    {
-        int y;
-        fsbuf_type v;
+        int rflags = (flags & FSPLACE_LEFT_TO_RIGHT)
+                            ? FSPLACE_TOP_TO_BOTTOM
+                            : 0;
 
-        if (width < offset + 1)
-            v = (((fsbuf_type)1 << width) - 1) << (offset - width + 1);
-        else
-            v = (((fsbuf_type)1 << offset) - 1) << 1 | 1;
+        rflags |= (flags & FSPLACE_TOP_TO_BOTTOM)
+                            ? 0
+                            : FSPLACE_LEFT_TO_RIGHT;
+
+        #ifdef FSDEBUG
+        pstr = freespace_placement_to_str(rflags);
+        DMESSAGE("\n---------------------------\n"
+             "rflags:%s\tarea w:%d, h:%d\n"
+             "boundary rx:%d, ry:%d, w:%d, h:%d\n", pstr, width, height,
+             rx, ry, boundary->w, boundary->h);
+        #endif
+
+
+        if (!fs->col_clean)
+            col_update(fs);
+
+        ret = row_smart(fs, true, fs->col_buf,
+                                rx,     ry,
+                                boundary->h, boundary->w,
+                                rflags, from,
+                                height, width, resultx, resulty);
+
+        if (!ret)
+            return false;
+
+        /* translate result back by 'rotation' 90 anti-clockwise */
+
+        rx = *resultx;
+        *resultx = *resulty;
+        *resulty = FSBUFSIZE - rx - height;
+
+        return true;
+    }
+
+    WARNING("unrecognized placement flags:%d\n", flags);
+    return false;
+}
 
-        for (y = ry; y < ry + height; ++y)
+
+bool freespace_find( freespace* fs,  basebox* boundary,
+                        int flags,
+                        int width,      int height,
+                        int* resultx,   int* resulty    )
+{
+    return find(fs, boundary, flags, -1, width, height, resultx, resulty);
+}
+
+
+int freespace_find_many(freespace* fs,  basebox* boundary,
+                        int flags,
+                        basebox* areas, int count)
+{
+    int i;
+    int placed = 0;
+
+    /*  the band the previous area was found in, and its size. the bands
+        searched before it could not fit it, and can fit nothing at least
+        as large now it has been removed.
+    */
+    int from = -1;
+    int fw = 0;
+    int fh = 0;
+
+    /*  the smallest area not found. no area at least as large in both
+        dimensions can be found either.
+    */
+    int nw = FSWIDTH + 1;
+    int nh = FSHEIGHT + 1;
+
+    for (i = 0; i < count; ++i)
+    {
+        basebox* a = &areas[i];
+        int start = (a->w >= fw && a->h >= fh) ? from : -1;
+
+        if ((a->w >= nw && a->h >= nh)
+         || !find(fs, boundary, flags, start, a->w, a->h, &a->x, &a->y))
         {
-            buf_col[y][index] |= v;
-            aux_col[y][index] |= v;
+            a->x = a->y = -1;
+
+            if (a->w > 0 && a->h > 0 && a->w <= nw && a->h <= nh)
+            {
+                nw = a->w;
+                nh = a->h;
+            }
+
+            continue;
         }
 
-        width -= offset + 1;
-        offset = FSBUFBITS - 1;
+        freespace_remove(fs, a->x, a->y, a->w, a->h);
+
+        from = (flags & FSPLACE_ROW_SMART) ? a->y : a->x;
+        fw = a->w;
+        fh = a->h;
+        ++placed;
     }
+
+    return placed;
 }
 
 
-static void mark_unused(fsbuf_type buf_row[FSHEIGHT][FSBUFWIDTH],
-                        fsbuf_type buf_col[FSHEIGHT][FSBUFWIDTH],
-                        fsbuf_type aux_row[FSHEIGHT][FSBUFWIDTH],
-                        fsbuf_type aux_col[FSHEIGHT][FSBUFWIDTH],
-                        fsbuf_type msk_row[FSHEIGHT][FSBUFWIDTH],
-                        fsbuf_type msk_col[FSHEIGHT][FSBUFWIDTH],
+/*  mark_used marks an area in the freespace grid as used space. it must
+    operate on two arrays. the caller marks the area dirty (area_dirty).
+ */
+static void mark_used(  fsbuf_type buf_row[FSBUFSIZE][FSBUFWIDTH],
+                        uint16_t free_row[FSBUFSIZE],
                         int x0, int y0, int w0, int h0 )
 {
-    int rx, ry;
     int width = w0;
     int height = h0;
     int offset = 0;
     int index = x_to_index_offset(x0, &offset);
 
+    #ifdef FSDEBUG
+    DMESSAGE("x:%d y:%d, width:%d, height:%d\n",x0,y0,width,height);
+    DMESSAGE("index:%d offset:%d\n",index,offset);
+    #endif
+
     for (; width > 0 && index < FSBUFWIDTH; ++index)
     {
         int y;
         fsbuf_type v;
 
-        if (width <= offset + 1)
-            v = ~((((fsbuf_type)1 << width) - 1) << (offset - width + 1));
+        if (width < offset + 1)
+            v = (((fsbuf_type)1 << width) - 1) << (offset - width + 1);
         else
-            v = ~((((fsbuf_type)1 << offset) - 1) << 1 | 1);
+            v = (((fsbuf_type)1 << offset) - 1) << 1 | 1;
 
         for (y = y0; y < y0 + height; ++y)
-        {
-            buf_row[y][index] = (buf_row[y][index] & v) | msk_row[y][index];
-            aux_row[y][index] &= v;
-        }
+            buf_row[y][index] |= v;
 
         width -= offset + 1;
         offset = FSBUFBITS - 1;
     }
 
-    width = h0;
-    height = w0;
-    offset = 0;
-    rx = FSWIDTH - y0 - h0;
-    ry = x0;
+    free_update(buf_row, free_row, y0, h0);
+}
 
-    index = x_to_index_offset(rx, &offset);
 
-    for (; width > 0 && index < FSBUFWIDTH; ++index)
-    {
-        int y;
-        fsbuf_type v;
+/*  the sixteen cells from r as bits, the first in the msb, set where
+    the count of areas using the cell is non-zero.
+*/
+static inline unsigned refs_used16(const uint8_t* r)
+{
+    unsigned m;
+
+    #ifdef FS_REFS_SSE2
+    m = ~_mm_movemask_epi8(_mm_cmpeq_epi8(
+                            _mm_loadu_si128((const __m128i*)r),
+                            _mm_setzero_si128())) & 0xffff;
+
+    /* movemask puts the first cell in the lsb */
+    m = ((m >> 1) & 0x5555) | ((m & 0x5555) << 1);
+    m = ((m >> 2) & 0x3333) | ((m & 0x3333) << 2);
+    m = ((m >> 4) & 0x0f0f) | ((m & 0x0f0f) << 4);
+    m = ((m >> 8) & 0x00ff) | ((m & 0x00ff) << 8);
+    #else
+    int i;
 
-        if (width <= offset + 1)
-            v = ~((((fsbuf_type)1 << width) - 1) << (offset - width + 1));
-        else
-            v = ~((((fsbuf_type)1 << offset) - 1) << 1 | 1);
+    for (m = 0, i = 0; i < 16; ++i)
+        m = (m << 1) | (r[i] != 0);
+    #endif
+
+    return m;
+}
+
+
+/*  marks the words of buf_row covering the area as used only where
+    the count of areas using a cell is non-zero.
+*/
+static void mark_unused(fsbuf_type buf_row[FSBUFSIZE][FSBUFWIDTH],
+                        uint8_t refs[FSHEIGHT][FSWIDTH],
+                        uint16_t free_row[FSBUFSIZE],
+                        int x0, int y0, int w0, int h0 )
+{
+    const int i0 = x0 >> FSDIVSHIFT;
+    const int i1 = (x0 + w0 - 1) >> FSDIVSHIFT;
+    int y, i, b;
 
-        for (y = ry; y < ry + height; ++y)
+    for (y = y0; y < y0 + h0; ++y)
+    {
+        for (i = i0; i <= i1; ++i)
         {
-            buf_col[y][index] = (buf_col[y][index] & v) | msk_col[y][index];
-            aux_col[y][index] &= v;
-        }
+            const uint8_t* r = &refs[y][i << FSDIVSHIFT];
+            fsbuf_type v = 0;
+
+            #if FSBUFBITS >= 16
+            for (b = 0; b < FSBUFBITS; b += 16)
+                v = (fsbuf_type)(v << 16) | refs_used16(r + b);
+            #else
+            for (b = 0; b < FSBUFBITS; ++b)
+                v = (fsbuf_type)(v << 1) | (r[b] != 0);
+            #endif
 
-        width -= offset + 1;
-        offset = FSBUFBITS - 1;
+            buf_row[y][i] = v;
+        }
     }
+
+    free_update(buf_row, free_row, y0, h0);
 }
 
 
-void freespace_remove(freespace* fs, int x0, int y0, int w0, int h0)
+/* saturating add of one to, and subtract of one from, n counts */
+static void refs_inc(uint8_t* r, int n)
 {
-    mark_used(  fs->row_buf,        fs->col_buf,
-                fs->nat_row_buf,    fs->nat_col_buf,
-                x0,     y0,     w0,     h0);
+    #ifdef FS_REFS_SSE2
+    const __m128i one = _mm_set1_epi8(1);
+
+    for (; n >= 16; n -= 16, r += 16)
+        _mm_storeu_si128((__m128i*)r,
+                    _mm_adds_epu8(_mm_loadu_si128((const __m128i*)r), one));
+    #endif
+
+    for (; n > 0; --n, ++r)
+        *r += (*r != UINT8_MAX);
 }
 
 
-void freespace_add(freespace* fs, int x0, int y0, int w0, int h0 )
+static void refs_dec(uint8_t* r, int n)
 {
-    mark_unused(fs->row_buf,        fs->col_buf,
-                fs->nat_row_buf,    fs->nat_col_buf,
-                fs->blk_row_buf,    fs->blk_col_buf,
-                x0,     y0,     w0,     h0);
+    #ifdef FS_REFS_SSE2
+    const __m128i one = _mm_set1_epi8(1);
+
+    for (; n >= 16; n -= 16, r += 16)
+        _mm_storeu_si128((__m128i*)r,
+                    _mm_subs_epu8(_mm_loadu_si128((const __m128i*)r), one));
+    #endif
+
+    for (; n > 0; --n, ++r)
+        *r -= (*r != 0);
 }
 
 
-void freespace_block_clear(freespace* fs)
+/*  marks the space outside of the grid in use, the columns to the
+    right of it and the rows beneath it, as used.
+*/
+static void mark_outside(freespace* fs)
 {
     int y;
 
-    for (y = 0; y < FSHEIGHT; ++y)
-    {
-        memset(&fs->blk_row_buf[y][0], 0, sizeof(fsbuf_type) * FSBUFWIDTH);
-        memset(&fs->blk_col_buf[y][0], 0, sizeof(fsbuf_type) * FSBUFWIDTH);
-        memset(&fs->nat_row_buf[y][0], 0, sizeof(fsbuf_type) * FSBUFWIDTH);
-        memset(&fs->nat_col_buf[y][0], 0, sizeof(fsbuf_type) * FSBUFWIDTH);
-    }
+    if (fs->width < FSWIDTH)
+        for (y = 0; y < fs->height; ++y)
+            memset(&fs->refs[y][fs->width], UINT8_MAX,
+                                            FSWIDTH - fs->width);
+
+    if (fs->height < FSHEIGHT)
+        memset(&fs->refs[fs->height][0], UINT8_MAX,
+                                    FSWIDTH * (FSHEIGHT - fs->height));
+
+    /* and the rest of the square bit arrays */
+    if (fs->width < FSBUFSIZE)
+        mark_used(  fs->row_buf,    fs->row_free,
+                    fs->width,  0,  FSBUFSIZE - fs->width,  fs->height);
+
+    if (fs->height < FSBUFSIZE)
+        mark_used(  fs->row_buf,    fs->row_free,
+                    0,  fs->height, FSBUFSIZE,  FSBUFSIZE - fs->height);
+}
+
+
+void freespace_remove(freespace* fs, int x0, int y0, int w0, int h0)
+{
+    int y;
+
+    area_dirty(fs, x0, y0, w0, h0);
+
+    for (y = y0; y < y0 + h0; ++y)
+        refs_inc(&fs->refs[y][x0], w0);
+
+    mark_used(fs->row_buf, fs->row_free, x0, y0, w0, h0);
+}
+
+
+void freespace_add(freespace* fs, int x0, int y0, int w0, int h0 )
+{
+    int y;
+
+    /* the space outside of the grid is never returned */
+    if (x0 + w0 > fs->width)
+        w0 = fs->width - x0;
+
+    if (y0 + h0 > fs->height)
+        h0 = fs->height - y0;
+
+    if (w0 < 1 || h0 < 1)
+        return;
+
+    area_dirty(fs, x0, y0, w0, h0);
 
-    for (y = 0; y < MAX_BLOCK_AREAS; ++y)
-        fs->blklist[y].w = 0;
+    for (y = y0; y < y0 + h0; ++y)
+        refs_dec(&fs->refs[y][x0], w0);
+
+    mark_unused(fs->row_buf, fs->refs, fs->row_free, x0, y0, w0, h0);
 }
 
 
 bool freespace_block_remove(freespace* fs, int x0, int y0, int w0, int h0)
 {
-    int i;
+    freespace_remove(fs, x0, y0, w0, h0);
+    return true;
+}
 
-    for (i = 0; i < MAX_BLOCK_AREAS; ++i)
-    {
-        if (fs->blklist[i].w == 0)
-        {
-            fs->blklist[i].x = x0;
-            fs->blklist[i].y = y0;
-            fs->blklist[i].w = w0;
-            fs->blklist[i].h = h0;
 
-            mark_used(  fs->row_buf,        fs->col_buf,
-                        fs->blk_row_buf,    fs->blk_col_buf,
-                        x0,     y0,     w0,     h0);
+void freespace_block_add(freespace* fs, int x0, int y0, int w0, int h0 )
+{
+    freespace_add(fs, x0, y0, w0, h0);
+}
+
 
-            return true;
-        }
+bool freespace_test(freespace* fs, int x, int y, int width, int height)
+{
+    if (x < 0 || y < 0 || width < 1 || height < 1
+     || x + width > fs->width || y + height > fs->height)
+    {
+        return false;
     }
 
-    return false;
+    if (fs->sat_dirty < FSHEIGHT)
+        sat_update(fs);
+
+    return !sat_used(fs, x, y, width, height);
 }
 
-#ifndef MIN
-#define MIN(a, b)  (((a) < (b)) ? (a) : (b))
-#define FSMINUNDEFINED
-#endif
 
-#ifndef MAX
-#define MAX(a, b)  (((a) > (b)) ? (a) : (b))
-#define FSMAXUNDEFINED
-#endif
+int freespace_used(freespace* fs)
+{
+    int y, used = fs->width * fs->height;
 
-void freespace_block_add(freespace* fs, int x0, int y0, int w0, int h0 )
+    for (y = 0; y < fs->height; ++y)
+        used -= fs->row_free[y];
+
+    return used;
+}
+
+
+void freespace_stats(freespace* fs, const basebox* boundary, fsstats* st)
 {
-    int i;
+    basebox b = *boundary;
+    uint16_t heights[FSWIDTH];
+    int stack[FSWIDTH + 1];
+    uint64_t bound[FSFITWORDS];
+    int i, x, y;
+
+    memset(st, 0, sizeof(*st));
+
+    if (b.x + b.w > fs->width)
+        b.w = fs->width - b.x;
+
+    if (b.y + b.h > fs->height)
+        b.h = fs->height - b.y;
+
+    if (b.x < 0 || b.y < 0 || b.w < 1 || b.h < 1)
+        return;
+
+    if (fs->sat_dirty < FSHEIGHT)
+        sat_update(fs);
 
-    for (i = 0; i < MAX_BLOCK_AREAS; ++i)
+    st->area = b.w * b.h;
+    st->used = sat_used(fs, b.x, b.y, b.w, b.h);
+
+    fit_range(bound, b.x, b.x + b.w);
+    memset(heights, 0, sizeof(heights));
+
+    for (y = b.y; y < b.y + b.h; ++y)
     {
-        /* search for existing block which matches */
+        uint64_t m[FSFITWORDS];
+        int runs = 0, top = 0;
 
-        if (fs->blklist[i].w
-         && fs->blklist[i].x == x0
-         && fs->blklist[i].y == y0
-         && fs->blklist[i].w == w0
-         && fs->blklist[i].h == h0)
-        {
-            int j;
+        fit_row(fs, y, m);
+        fit_and(m, bound);
 
-            fs->blklist[i].w = 0;
+        /* a run starts at each free cell following a used one */
+        for (i = 0; i < FSFITWORDS; ++i)
+            runs += __builtin_popcountll(m[i] & ~((m[i] >> 1)
+                                        | (i ? m[i - 1] << 63 : 0)));
 
-            /* set the area to unused space */
+        st->runs += runs;
 
-            mark_unused(fs->row_buf,        fs->col_buf,
-                        fs->blk_row_buf,    fs->blk_col_buf,
-                        fs->nat_row_buf,    fs->nat_col_buf,
-                        x0,     y0,     w0,     h0);
+        if (runs > st->max_runs)
+            st->max_runs = runs;
 
-            /* check for intersections with other blocks */
+        /*  the largest rectangle of free cells with its bottom in this
+            row, from the heights of free cells above each cell in it.
+            the stack holds the cells of increasing height.
+        */
+        for (x = b.x; x <= b.x + b.w; ++x)
+        {
+            int h = 0;
 
-            for (j = 0; j < MAX_BLOCK_AREAS; ++j)
+            if (x < b.x + b.w)
+                h = heights[x] = fit_test(m, x) ? heights[x] + 1 : 0;
+
+            while (top && heights[stack[top - 1]] >= h)
             {
-                if (fs->blklist[j].w == 0)
-                    continue;
+                int th = heights[stack[--top]];
+                int left = top ? stack[top - 1] + 1 : b.x;
 
-                if (j == i)
-                    continue; /* __ */
+                if (th * (x - left) > st->largest_w * st->largest_h)
                 {
-                    int ix0 = MAX(fs->blklist[j].x, x0);
-                    int iy0 = MAX(fs->blklist[j].y, y0);
-                    int ix1 = MIN(x0 + w0,  fs->blklist[j].x
-                                          + fs->blklist[j].w);
-                    int iy1 = MIN(y0 + h0,  fs->blklist[j].y
-                                          + fs->blklist[j].h);
-
-                    if (ix1 > ix0 && iy1 > iy0)
-                    {
-                        mark_used(  fs->row_buf,        fs->col_buf,
-                                    fs->blk_row_buf,    fs->blk_col_buf,
-                                    ix0,    iy0,    ix1 - ix0,  iy1 - iy0);
-                    }
+                    st->largest_x = left;
+                    st->largest_y = y - th + 1;
+                    st->largest_w = x - left;
+                    st->largest_h = th;
                 }
             }
+
+            stack[top++] = x;
         }
     }
+
+    if (st->area > st->used)
+        st->fragmentation = 1.0f - (float)(st->largest_w * st->largest_h)
+                                        / (float)(st->area - st->used);
 }
 
-#ifdef FSMINUNDEFINED
-#undef MIN
-#undef FSMINUNDEFINED
-#endif
 
-#ifdef FSMAXUNDEFINED
-#undef MAX
-#undef FSMAXUNDEFINED
-#endif
+size_t freespace_rows_size(void)
+{
+    return sizeof(((freespace*)0)->row_buf);
+}
+
+
+void freespace_rows_copy(freespace* fs, void* dest)
+{
+    memcpy(dest, fs->row_buf, sizeof(fs->row_buf));
+}
+
+
+void freespace_rows_load(freespace* fs, const void* src)
+{
+    memcpy(fs->row_buf, src, sizeof(fs->row_buf));
+    free_update(fs->row_buf, fs->row_free, 0, FSBUFSIZE);
+    area_dirty(fs, 0, 0, FSBUFSIZE, FSBUFSIZE);
+}
+
+
+void freespace_stats_dump(const fsstats* st)
+{
+    MESSAGE("freespace: %d of %d cells used, %d runs free (at most %d "
+            "in a row)\n", st->used, st->area, st->runs, st->max_runs);
+    MESSAGE("freespace: largest free %d x %d at %d, %d, "
+            "fragmentation %.2f\n", st->largest_w, st->largest_h,
+            st->largest_x, st->largest_y, st->fragmentation);
+}
 
 
 void freespace_dump(freespace* fs, int buf)
 {
     int x, y;
 
+    if (buf == 1 && !fs->col_clean)
+        col_update(fs);
+
     for (x = 0; x < FSBUFWIDTH; ++x)
     {
         if (FSBUFBITS > 8)
@@ -947,7 +2214,7 @@ void freespace_dump(freespace* fs, int buf)
         printf("76543210%c", x < FSBUFWIDTH - 1 ? '_' : '\n');
     }
 
-    for (y = 0; y < FSHEIGHT; ++y)
+    for (y = 0; y < FSBUFSIZE; ++y)
     {
         for (x = 0; x < FSBUFWIDTH; ++x)
         {
@@ -957,10 +2224,6 @@ void freespace_dump(freespace* fs, int buf)
             switch(buf)
             {
             case 1:     b = fs->col_buf[y][x];      break;
-            case 2:     b = fs->blk_row_buf[y][x];  break;
-            case 3:     b = fs->blk_col_buf[y][x];  break;
-            case 4:     b = fs->nat_row_buf[y][x];  break;
-            case 5:     b = fs->nat_col_buf[y][x];  break;
             default:    b = fs->row_buf[y][x];      break;
             }
 
@@ -987,9 +2250,19 @@ char* freespace_placement_to_str(int flags)
     char* vert = (flags & FSPLACE_TOP_TO_BOTTOM)
                     ? "top-to-bottom" : "bottom-to-top";
 
+    char* strategy;
+
     char buf[80];
 
-    snprintf(buf, 79, "%s, %s, %s",   org, horiz, vert);
+    switch (flags & FSPLACE_STRATEGY_MASK)
+    {
+    case FSPLACE_NEAREST:       strategy = "nearest";       break;
+    case FSPLACE_BEST_FIT:      strategy = "best-fit";      break;
+    case FSPLACE_RANDOM_FIT:    strategy = "random-fit";    break;
+    default:                    strategy = "first-fit";     break;
+    }
+
+    snprintf(buf, 79, "%s, %s, %s, %s", strategy, org, horiz, vert);
 
     return strdup(buf);
 }
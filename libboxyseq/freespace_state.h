@@ -11,12 +11,25 @@ extern "C" {
 
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 
-#define FSWIDTH  128 /* YOU CHANGE YOU BREAK! */
+/*  the largest grid size. grids of any size up to this can be created
+    with freespace_new_size. each may be defined as 128 or 256 when
+    building, for grids such as 256 x 128, so long as the grid has fewer
+    than 65536 cells. the searches cost the same for a grid of a given
+    size whatever the largest size is, but the space taken by each grid
+    is that of the largest.
+*/
+#ifndef FSWIDTH
+#define FSWIDTH  128
+#endif
+
+#ifndef FSHEIGHT
 #define FSHEIGHT 128
+#endif
 
-#define MAX_BLOCK_AREAS 32 /* max block areas which can be used */
 
 
 enum FREESPACE_PLACEMENT_FLAGS
@@ -24,17 +37,49 @@ enum FREESPACE_PLACEMENT_FLAGS
     FSPLACE_ROW_SMART =         0x0001,     /* else COL_SMART       */
     FSPLACE_LEFT_TO_RIGHT =     0x0002,     /* else RIGHT_TO_LEFT   */
     FSPLACE_TOP_TO_BOTTOM =     0x0004,     /* else BOTTOM_TO_TOP   */
+
+    /*  the placement strategy. first-fit takes the first position found
+        scanning in the order given above. the others choose amongst all
+        the positions the area fits at, using the directions only to
+        break ties (ROW_SMART/COL_SMART make no difference to them):
+            nearest -       nearest to the target (freespace_target_set)
+            best-fit -      leaving the smallest gap about the area
+            random-fit -    at random, reproducibly (freespace_seed)
+    */
+    FSPLACE_FIRST_FIT =         0x0000,
+    FSPLACE_NEAREST =           0x1000,
+    FSPLACE_BEST_FIT =          0x2000,
+    FSPLACE_RANDOM_FIT =        0x3000,
+    FSPLACE_STRATEGY_MASK =     0x3000
 };
 
 
 typedef struct freespace_state freespace;
 
 
+/*  freespace_new creates an FSWIDTH x FSHEIGHT grid. freespace_new_size
+    creates a smaller one, searches of which cost less. areas passed to
+    freespace_find are clipped to the grid, but any other areas must lie
+    within it.
+*/
 freespace*  freespace_new(void);
+freespace*  freespace_new_size(int width, int height);
 void        freespace_free(freespace*);
 
+int         freespace_width(freespace*);
+int         freespace_height(freespace*);
+
 void        freespace_clear(freespace*);
 
+/*  freespace_target_set sets the position FSPLACE_NEAREST places areas
+    nearest to. -1 for either uses the corner of the boundary searched
+    which the placement flags start from, as it is initially.
+    freespace_seed seeds the choices made by FSPLACE_RANDOM_FIT: the
+    same seed and the same sequence of calls place areas the same.
+*/
+void        freespace_target_set(freespace*, int x, int y);
+void        freespace_seed(freespace*, uint32_t seed);
+
 
 /*  the freespace state
  *-----------------------
@@ -52,21 +97,21 @@ void        freespace_clear(freespace*);
  *  additionally, tracking of the individual areas removed is not the
  *  responsibility of the freespace state.
  *
- *  except: freespace_block_[clear|add|remove]. these functions do provide
- *  some form of tracking for block-areas. block-areas are areas which when
- *  placed might overlap existing areas of used space in the grid, but when
- *  those areas are removed they should not wipe out the block-areas.
- *  likewise, when the block-areas are removed, they should not wipe out
- *  each other or any areas removed that were pre-existing.
- *
- *  the number of block-areas that can be tracked is limited to
- *  MAX_BLOCK_AREAS.
+ *  except: block-areas. block-areas are areas which when placed might
+ *  overlap existing areas of used space in the grid, but when those areas
+ *  are removed they should not wipe out the block-areas. likewise, when the
+ *  block-areas are removed, they should not wipe out each other or any
+ *  areas removed that were pre-existing. so the freespace state counts
+ *  the areas using each cell, and space only becomes free again once
+ *  every area using it has been added back, in any order. the count
+ *  saturates at 255 overlapping areas.
  *
  *  all freespace_* functions without exception should not be shared amongst
  *  threads.
  *
- *  with the exception of freespace_new, freespace_free, and freespace_dump
- *  all the freespace_* functions are real time safe.
+ *  with the exception of freespace_new, freespace_new_size, freespace_free,
+ *  freespace_stats_dump and freespace_dump all the freespace_* functions
+ *  are real time safe.
  *
  */
 
@@ -90,6 +135,45 @@ bool        freespace_find(     freespace*,
                                 int* resultx,   int* resulty    );
 
 
+/*  freespace_find_many: finds and removes each of count areas in turn
+                        within the same boundary, using the same placement
+                        flags. the results are identical to calling
+                        freespace_find then freespace_remove for each area,
+                        but the search for each area carries on from where
+                        the search for the previous one left off when the
+                        area is at least as large, and areas at least as
+                        large as one which could not be found are not
+                        searched for at all.
+
+                        the w and h of each area are the size to find.
+                        x and y are set to the area found, or both to -1
+                        if it could not be.
+
+                        returns the number of areas found.
+*/
+int         freespace_find_many(freespace*,
+                                basebox* boundary,
+                                int placement_flags,
+                                basebox* areas, int count );
+
+
+/*  freespace_test:     tests if the area at x, y of width, height is
+                        entirely unused space. the used space within the
+                        area is counted from a summed-area table, which
+                        is brought up to date (from the first row changed)
+                        when space has been removed or added since the
+                        last call to freespace_test or freespace_find.
+                        after that, the test costs the same for an area
+                        of any size.
+
+                        returns false if any of the area is used or lies
+                        outside of the grid.
+*/
+bool        freespace_test(     freespace*,
+                                int x,      int y,
+                                int width,  int height );
+
+
 /*  freespace_remove:   removes free space. meaning, the area at x, y
                         of width, height is no longer available as free
                         unused space. in 99% of situations the area of
@@ -102,49 +186,97 @@ void        freespace_remove(   freespace*,
 
 /*  freespace_add:      returns the area at x, y, of width, height to
                         the state of being free unsused space once more
-                        available for use by the placement algorithm.
+                        available for use by the placement algorithm. cells
+                        still used by other removed areas remain used.
 */
 void        freespace_add(      freespace*,
                                 int x,      int y,
                                 int width,  int height );
 
 
-/*  freespace_block_clear clears areas affected by freespace_block_*
-                        functions and erases the tracking of them.
-*/
-void        freespace_block_clear(freespace*);
-
-
-/*  freespace_block_remove is somewhat like freespace_remove but
-                        additionally operates on a secondary layer. the area
+/*  freespace_block_remove is freespace_remove for block-areas. the area
                         removed will be treated by freespace_find like any
                         other area of used space, but when freespace_add is
                         called on an area which intersects, the common area
-                        remains as used space.
+                        remains as used space. it always succeeds.
 */
 bool        freespace_block_remove(freespace*,
                                 int x,      int y,
                                 int width,  int height );
 
 
-/*  freespace_block_add is somewhat like freespace_add but is the companion
-                        to freespace_block_remove. it operates on a 
-                        secondary layer so that only space removed by
+/*  freespace_block_add is freespace_add for block-areas, the companion
+                        to freespace_block_remove. only space removed by
                         freespace_block_remove that DOES NOT intersect with
-                        space removed by freespace_remove is returned.
+                        other space still removed is returned.
  */
 void        freespace_block_add(freespace*,
                                 int x,      int y,
                                 int width,  int height );
 
 
-/*  freespace_dump:     dumps one of the 4 freespace state bufs as text.
+/*  freespace_used:     returns the number of cells of the grid in use,
+                        counted from the free cells kept for each row.
+*/
+int         freespace_used(freespace*);
+
+
+/*  freespace_stats:    measures the use of space within the boundary, for
+                        warning of placements about to fail before they
+                        do. runs are spans of free cells across a row, the
+                        largest is the largest rectangle of free cells, and
+                        fragmentation is the share of the free cells lying
+                        outside of it: 0 when the free space is all one
+                        rectangle, nearing 1 the more it is scattered.
+
+                        the used space comes from the summed-area table
+                        and the runs from the rows a word at a time, while
+                        finding the largest rectangle visits each cell of
+                        the boundary once, so this costs about as much as a
+                        first-fit search which fails. too much to do from
+                        the real time thread as a matter of course: measure
+                        a copy of the grid elsewhere instead (see below).
+*/
+typedef struct freespace_stats
+{
+    int     area;       /* cells within the boundary                    */
+    int     used;
+    int     runs;       /* runs of free cells, and the most in any row  */
+    int     max_runs;
+
+    int     largest_x,  largest_y;
+    int     largest_w,  largest_h;
+
+    float   fragmentation;
+
+} fsstats;
+
+void        freespace_stats(    freespace*,
+                                const basebox* boundary,
+                                fsstats* );
+
+void        freespace_stats_dump(const fsstats*);
+
+
+/*  freespace_rows_copy:    copies which of the cells of the grid are in use
+                            into dest, freespace_rows_size() bytes, with a
+                            single memcpy.
+    freespace_rows_load:    makes fs the grid copied, which must be the same
+                            size as fs. the loaded grid is fit for searching
+                            and measuring but space must not be added to or
+                            removed from it.
+
+    so the real time thread can hand the grid to another thread to measure.
+*/
+size_t      freespace_rows_size(void);
+void        freespace_rows_copy(freespace*, void* dest);
+void        freespace_rows_load(freespace*, const void* src);
+
+
+/*  freespace_dump:     dumps one of the 2 freespace state bufs as text.
                         the arrays are as follows:
                             0 - buf - the actual freespace state
                             1 - col - used only for column smart searching
-                            2 - blk - space used by blocks
-                            3 - nat - space not used by blocks
-                            
 */
 void        freespace_dump(freespace*, int buf);
 
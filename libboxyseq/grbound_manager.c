@@ -103,7 +103,9 @@ grbound* grbound_manager_grbound_new(grbound_manager* grbman)
 
 grbound* grbound_manager_grbound_first(grbound_manager* grbman)
 {
-    return lnode_data(grbman->cur = llist_head(grbman->grblist));
+    grbman->cur = llist_head(grbman->grblist);
+
+    return (grbman->cur) ? lnode_data(grbman->cur) : 0;
 }
 
 
@@ -118,6 +120,19 @@ grbound* grbound_manager_grbound_next(grbound_manager* grbman)
 }
 
 
+grbound* grbound_manager_grbound_by_rtdata(grbound_manager* grbman,
+                                                        rtdata* rt)
+{
+    lnode* ln = llist_head(grbman->grblist);
+
+    for (; ln; ln = lnode_next(ln))
+        if (grbound_rtdata(lnode_data(ln)) == rt)
+            return lnode_data(ln);
+
+    return 0;
+}
+
+
 void grbound_manager_grbound_order(grbound_manager* grbman,
                                                 grbound* grb,
                                                 int dir)
@@ -153,16 +168,100 @@ void grbound_manager_update_rt_data(const grbound_manager* grbman)
 }
 
 
+rtdata* grbound_manager_rtdata(grbound_manager* grbman)
+{
+    return grbman->rt;
+}
+
+
 void grbound_manager_rt_pull_starting(grbound_manager* grbman,
-                                            evport* grid_intersort)
+                                            evport** grid_intersorts,
+                                            int grid_count)
 {
     grbound** grb = rtdata_data(grbman->rt);
 
     if (!grb)
         return;
 
-    while(*grb)
-        grbound_rt_pull_starting(*grb++, grid_intersort);
+    for (; *grb; ++grb)
+    {
+        int g = grbound_rt_grid(*grb);
+
+        if (g < 0 || g >= grid_count)
+            g = 0;
+
+        grbound_rt_pull_starting(*grb, grid_intersorts[g]);
+    }
+}
+
+
+static int group_find(int* group, int g)
+{
+    while (group[g] != g)
+        g = group[g];
+
+    return g;
+}
+
+
+/* joins the groups of grids a and b, the lower grid leading */
+static void group_join(int* group, int a, int b)
+{
+    a = group_find(group, a);
+    b = group_find(group, b);
+
+    if (a < b)
+        group[b] = a;
+    else
+        group[a] = b;
+}
+
+
+/* the grid the boundary places within, grid 0 should it be out of range */
+static int group_grid(const grbound* rtgrb, int grid_count)
+{
+    return (rtgrb->grid < 0 || rtgrb->grid >= grid_count) ? 0
+                                                          : rtgrb->grid;
+}
+
+
+void grbound_manager_rt_group_grids(grbound_manager* grbman,
+                                            int* group,
+                                            const uint32_t* joins,
+                                            int grid_count)
+{
+    grbound** grb = rtdata_data(grbman->rt);
+    grbound** other;
+    int g, h;
+
+    for (g = 0; g < grid_count; ++g)
+        group[g] = g;
+
+    /* events ending in another grid than their boundary's */
+    for (g = 0; g < grid_count; ++g)
+        for (h = 0; h < grid_count; ++h)
+            if (joins[g] & ((uint32_t)1 << h))
+                group_join(group, g, h);
+
+    for (; grb && *grb; ++grb)
+    {
+        grbound* rtgrb = rtdata_data((*grb)->rt);
+
+        if (!rtgrb)
+            continue;
+
+        for (other = grb + 1; *other; ++other)
+        {
+            grbound* rtother = rtdata_data((*other)->rt);
+
+            if (rtother && rtother->midiout == rtgrb->midiout)
+                group_join(group,   group_grid(rtgrb, grid_count),
+                                    group_grid(rtother, grid_count));
+        }
+    }
+
+    for (g = 0; g < grid_count; ++g)
+        group[g] = group_find(group, g);
 }
 
 #ifndef NDEBUG
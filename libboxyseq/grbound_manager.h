@@ -22,14 +22,37 @@ void        grbound_manager_grbound_free(grbound_manager*, grbound*);
 grbound*    grbound_manager_grbound_first(grbound_manager*);
 grbound*    grbound_manager_grbound_next(grbound_manager*);
 
+/*  grbound_manager_grbound_by_rtdata: the boundary rt publishes, or NULL.
+                        does not disturb first/next.
+*/
+grbound*    grbound_manager_grbound_by_rtdata(grbound_manager*, rtdata*);
+
 void        grbound_manager_grbound_order(grbound_manager*,
                                             grbound*,
                                             int dir);
 
 void    grbound_manager_update_rt_data(const grbound_manager*);
+rtdata* grbound_manager_rtdata(grbound_manager*);
 
+/*  grbound_manager_rt_pull_starting: moves the events starting this cycle
+                        from each boundary into the intersort of its grid.
+*/
 void    grbound_manager_rt_pull_starting(grbound_manager*,
-                                            evport* grid_intersort);
+                                            evport** grid_intersorts,
+                                            int grid_count);
+
+/*  grbound_manager_rt_group_grids: sets group[g] to the lowest index of
+                        the grids which must be processed together with
+                        grid g, those whose boundaries output to the same
+                        midi out port, directly or through other grids.
+                        grid g is also joined with each grid h set in
+                        joins[g] (see moport_rt_pull_ending). grids in
+                        different groups share nothing.
+*/
+void    grbound_manager_rt_group_grids(grbound_manager*,
+                                            int* group,
+                                            const uint32_t* joins,
+                                            int grid_count);
 #ifndef NDEBUG
 void    grbound_manager_rt_check_incoming(grbound_manager*, bbt_t ph,
                                                             bbt_t nph);
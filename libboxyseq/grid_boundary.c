@@ -3,9 +3,11 @@
 #include "common.h"
 #include "debug.h"
 #include "freespace_state.h"
+#include "musical_scale.h"
 #include "real_time_data.h"
 
 
+#include <stdint.h>
 #include <stdlib.h>
 
 
@@ -22,7 +24,26 @@ static void     grbound_rtdata_free_cb(void* grb);
 
 grbound* grbound_new(void)
 {
-    return grbound_private_new(1);
+    grbound* grb = grbound_private_new(1);
+
+    if (!grb)
+        return 0;
+
+    /*  only a new boundary is randomized, so that copies made for the
+        RT thread leave the random number generators alone.
+    */
+    if (rand() % 2)
+        grb->flags |= FSPLACE_ROW_SMART;
+
+    if (rand() % 2)
+        grb->flags |= FSPLACE_LEFT_TO_RIGHT;
+
+    if (rand() % 2)
+        grb->flags |= FSPLACE_TOP_TO_BOTTOM;
+
+    random_rgb(&grb->box.r, &grb->box.g, &grb->box.b);
+
+    return grb;
 }
 
 
@@ -113,7 +134,9 @@ int grbound_event_toggle_play(grbound* grb)
 
 int grbound_scale_key_set(grbound* grb, int scale_key)
 {
-    return (grb->scale_key = scale_key);
+    grb->scale_key = scale_key;
+    scale_note_mask(grb->scale_bin, grb->scale_key, grb->scale_mask);
+    return scale_key;
 }
 
 
@@ -125,7 +148,9 @@ int grbound_scale_key(grbound* grb)
 
 int grbound_scale_binary_set(grbound* grb, int scale_bin)
 {
-    return (grb->scale_bin = scale_bin);
+    grb->scale_bin = scale_bin;
+    scale_note_mask(grb->scale_bin, grb->scale_key, grb->scale_mask);
+    return scale_bin;
 }
 
 
@@ -190,12 +215,99 @@ void grbound_fsbound_get(grbound* grb, int* x, int* y, int* w, int* h)
 }
 
 
+void grbound_target_set(grbound* grb, int x, int y)
+{
+    grb->target_x = x;
+    grb->target_y = y;
+}
+
+
+void grbound_target_get(grbound* grb, int* x, int* y)
+{
+    if (x) *x = grb->target_x;
+    if (y) *y = grb->target_y;
+}
+
+
+void grbound_grid_set(grbound* grb, int grid)
+{
+    grb->grid = grid;
+}
+
+
+int grbound_grid(grbound* grb)
+{
+    return grb->grid;
+}
+
+
+int grbound_rt_grid(grbound* grb)
+{
+    grbound* rtgrb = rtdata_data(grb->rt);
+
+    return rtgrb ? rtgrb->grid : 0;
+}
+
+
 void grbound_set_input_port(grbound* grb, evport* port)
 {
     grb->evinput = port;
 }
 
 
+evport* grbound_input_port(grbound* grb)
+{
+    return grb->evinput;
+}
+
+
+void grbound_state_get(grbound* grb, grbstate* st)
+{
+    st->x = grb->box.x;
+    st->y = grb->box.y;
+    st->w = grb->box.w;
+    st->h = grb->box.h;
+    st->r = grb->box.r;
+    st->g = grb->box.g;
+    st->b = grb->box.b;
+    st->flags =     grb->flags;
+    st->target_x =  grb->target_x;
+    st->target_y =  grb->target_y;
+    st->grid =      grb->grid;
+    st->channel =   grb->channel;
+    st->scale_bin = grb->scale_bin;
+    st->scale_key = grb->scale_key;
+}
+
+
+void grbound_state_set(grbound* grb, const grbstate* st)
+{
+    box_set_coords(&grb->box, st->x, st->y, st->w, st->h);
+    grb->box.r = st->r;
+    grb->box.g = st->g;
+    grb->box.b = st->b;
+    grb->flags =    st->flags;
+    grb->target_x = st->target_x;
+    grb->target_y = st->target_y;
+    grb->grid =     st->grid;
+    grb->channel =  st->channel;
+    grbound_scale_key_set(grb, st->scale_key);
+    grbound_scale_binary_set(grb, st->scale_bin);
+}
+
+
+unsigned grbound_id(grbound* grb)
+{
+    return rtdata_id(grb->rt);
+}
+
+
+rtdata* grbound_rtdata(grbound* grb)
+{
+    return grb->rt;
+}
+
+
 void grbound_update_rt_data(const grbound* grb)
 {
     rtdata_update(grb->rt);
@@ -215,25 +327,25 @@ void grbound_rt_pull_starting(grbound* grb, evport* grid_intersort)
 
     evport_read_reset(rtgrb->evinput);
 
-    if (grb->flags & GRBOUND_EVENT_PROCESS)
+    if (rtgrb->flags & GRBOUND_EVENT_PROCESS)
     {
-        if (grb->flags & GRBOUND_EVENT_PLAY)
+        if (rtgrb->flags & GRBOUND_EVENT_PLAY)
         {
             while (evport_read_event(rtgrb->evinput, &ev))
             {
                 ev.grb = grb;
 
                 if ((!ev.box.r && !ev.box.g && !ev.box.b)
-                 || (grb->flags & GRBOUND_OVERRIDE_NOTE_CH))
+                 || (rtgrb->flags & GRBOUND_OVERRIDE_NOTE_CH))
                 {
-                    ev.box.r = grb->box.r;
-                    ev.box.g = grb->box.g;
-                    ev.box.b = grb->box.b;
+                    ev.box.r = rtgrb->box.r;
+                    ev.box.g = rtgrb->box.g;
+                    ev.box.b = rtgrb->box.b;
                 }
 
                 EVENT_SET_STATUS_ON( &ev );
 
-                if (grb->flags & GRBOUND_OVERRIDE_NOTE_CH)
+                if (rtgrb->flags & GRBOUND_OVERRIDE_NOTE_CH)
                     EVENT_SET_CHANNEL( &ev, rtgrb->channel );
 
                 if (!evport_write_event(grid_intersort, &ev))
@@ -247,11 +359,11 @@ void grbound_rt_pull_starting(grbound* grb, evport* grid_intersort)
                 ev.grb = grb;
 
                 if ((!ev.box.r && !ev.box.g && !ev.box.b)
-                 || (grb->flags & GRBOUND_OVERRIDE_NOTE_CH))
+                 || (rtgrb->flags & GRBOUND_OVERRIDE_NOTE_CH))
                 {
-                    ev.box.r = grb->box.r;
-                    ev.box.g = grb->box.g;
-                    ev.box.b = grb->box.b;
+                    ev.box.r = rtgrb->box.r;
+                    ev.box.g = rtgrb->box.g;
+                    ev.box.b = rtgrb->box.b;
                 }
 
                 EVENT_SET_STATUS_ON( &ev );
@@ -360,20 +472,13 @@ static grbound* grbound_private_new(bool with_rtdata)
                 | GRBOUND_EVENT_PROCESS
                 | GRBOUND_EVENT_PLAY;
 
-    if (rand() % 2)
-        grb->flags |= FSPLACE_ROW_SMART;
-
-    if (rand() % 2)
-        grb->flags |= FSPLACE_LEFT_TO_RIGHT;
-
-    if (rand() % 2)
-        grb->flags |= FSPLACE_TOP_TO_BOTTOM;
+    grb->target_x = grb->target_y = -1;
+    grb->grid = 0;
 
     grb->channel = 0;
     grb->scale_bin = binary_string_to_int("111111111111");
     grb->scale_key = 0;
-
-    random_rgb(&grb->box.r, &grb->box.g, &grb->box.b);
+    scale_note_mask(grb->scale_bin, grb->scale_key, grb->scale_mask);
 
     grb->evinput = 0;
     grb->midiout = 0;
@@ -399,9 +504,14 @@ static grbound* grbound_private_dup(const void* data, bool with_rtdata)
         return 0;
 
     dest->flags =       grb->flags;
+    dest->target_x =    grb->target_x;
+    dest->target_y =    grb->target_y;
+    dest->grid =        grb->grid;
     dest->channel =     grb->channel;
     dest->scale_bin =   grb->scale_bin;
     dest->scale_key =   grb->scale_key;
+    dest->scale_mask[0] = grb->scale_mask[0];
+    dest->scale_mask[1] = grb->scale_mask[1];
 
     box_copy(&dest->box, &grb->box);
 
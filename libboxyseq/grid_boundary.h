@@ -9,6 +9,10 @@ extern "C" {
 
 #include "boxyseq_types.h"
 #include "event_port.h"
+#include "real_time_data.h"
+
+
+#include <stdint.h>
 
 
 enum GRID_BOUNDARY_FLAGS
@@ -71,7 +75,50 @@ void        grbound_channel_set(grbound*, int);
 bool        grbound_fsbound_set(grbound*, int x, int y, int w, int h);
 void        grbound_fsbound_get(grbound*, int* x, int* y, int* w, int* h);
 
+/*  the pitch (x) and velocity (y) position FSPLACE_NEAREST places the
+    events of the boundary nearest to. see freespace_target_set.
+*/
+void        grbound_target_set(grbound*, int x, int y);
+void        grbound_target_get(grbound*, int* x, int* y);
+
+/*  the index of the grid the events of the boundary are placed within
+    (see boxyseq_grid_new). boundaries in different grids never compete
+    for space. events already placed end in the grid they were placed
+    within (see event.grid), so the boundary may be moved to another grid
+    while playing. grbound_rt_grid is the grid as the RT thread sees it.
+*/
+void        grbound_grid_set(grbound*, int grid);
+int         grbound_grid(grbound*);
+int         grbound_rt_grid(grbound*);
+
 void        grbound_set_input_port(grbound*, evport*);
+evport*     grbound_input_port(grbound*);
+
+
+/*  the settings of a boundary the UI may change while the sequencer
+    runs (everything but its ports), as kept by the journal so a replay
+    can make the same changes. grbound_id identifies the boundary within
+    a session (see rtdata_id) and grbound_rtdata is what publishes it to
+    the RT thread.
+*/
+typedef struct grid_boundary_state
+{
+    int32_t x, y, w, h;
+    uint8_t r, g, b;
+    int32_t flags;
+    int32_t target_x, target_y;
+    int32_t grid;
+    int32_t channel;
+    int32_t scale_bin;
+    int32_t scale_key;
+
+} grbstate;
+
+void        grbound_state_get(grbound*, grbstate*);
+void        grbound_state_set(grbound*, const grbstate*);
+
+unsigned    grbound_id(grbound*);
+rtdata*     grbound_rtdata(grbound*);
 
 /*  although the grbound has it's own input port, we need to place the
     data coming in from that port into another port which contains the
@@ -20,17 +20,44 @@ struct boxy_sequencer
 
     evport_manager* ports_pattern;
 
-    grid*       gr;
+    /*  grids are only ever added, by the UI, which publishes each to the
+        RT thread by incrementing grid_count.
+    */
+    grid*       grids[BOXYSEQ_MAX_GRIDS];
+    evport*     intersorts[BOXYSEQ_MAX_GRIDS];
+    int         grid_count;
 
-    jack_ringbuffer_t*  ui_note_on_buf;
-    jack_ringbuffer_t*  ui_note_off_buf;
-    jack_ringbuffer_t*  ui_unplace_buf;
+    jack_ringbuffer_t*  ui_note_on_buf[BOXYSEQ_MAX_GRIDS];
+    jack_ringbuffer_t*  ui_note_off_buf[BOXYSEQ_MAX_GRIDS];
+    jack_ringbuffer_t*  ui_unplace_buf[BOXYSEQ_MAX_GRIDS];
     jack_ringbuffer_t*  ui_input_buf;
 
+    /*  the grids sharing midi out ports are processed together as one
+        job by the worker pool. set by the RT thread each cycle.
+    */
+    wkpool*     workers;
+
+    int         rt_grid_count;
+    uint32_t    rt_joins[BOXYSEQ_MAX_GRIDS];
+    int         rt_group[BOXYSEQ_MAX_GRIDS];
+    int         rt_jobs[BOXYSEQ_MAX_GRIDS];
+
+    bbt_t       rt_ph;
+    bbt_t       rt_nph;
+    jack_nframes_t  rt_nframes;
+    double      rt_frames_per_tick;
+
     evlist*     ui_eventlist; /* stores collect events from buffers */
 
+    jrnl*       journal;
+
+    /* by journaled id, the boundaries and patterns made for a replay */
+    GHashTable* replayed;
+
     jackdata*   jd;
 
+    cytiming*   timing;
+
     _Bool rt_quitting;
 };
 
@@ -11,6 +11,32 @@
 */
 
 
+/*  the events of an rt_pattern are held in chunks, one for each beat of
+    the pattern (NULL where the beat is empty), which the RT thread only
+    reads. the dimensions events are played with, drawn for those which
+    do not specify them, are in a table alongside. an update shares the
+    chunks it leaves unchanged with the rt_pattern it replaces. the
+    reference counts are only touched by the UI thread: when updating,
+    and when the replaced rt_pattern is reclaimed.
+*/
+typedef struct rt_event_dims
+{
+    int     w;
+    int     h;
+
+} rt_evdims;
+
+
+typedef struct rt_event_chunk
+{
+    int         refs;
+    int         count;
+    rt_evdims*  dims;
+    event       events[];   /* as copied from the evlist */
+
+} rt_evchunk;
+
+
 struct event_pattern
 {
     char*   name;
@@ -27,13 +53,21 @@ struct event_pattern
     float   beat_type;
     double  beat_ratio;
 
-/*    seed_type   seedtype;
-    int         seed;*/
+/*    seed_type   seedtype;*/
+    uint32_t    seed;
 
     evlist*     events;
 
     rtdata*     rt;
 
+    /* the chunks of the latest rt_pattern */
+    rt_evchunk**    chunks;
+    int             chunk_count;
+
+    /* draws the dimensions for new chunks */
+    GRand*      rnd;
+    uint32_t    rnd_seed;
+
     evport*     evout;
 };
 
@@ -51,20 +85,13 @@ typedef struct rt_event_pattern
 /*    seed_type   seedtype;
     int         seed;*/
 
-    event*  events;
+    rt_evchunk**    chunks;
+    int             chunk_count;
+    bbt_t           chunk_ticks;
 
     evport* evout;
 
-    _Bool   playing;
-    _Bool   triggered;
-
-    GRand*  rnd;
-
     bbt_t   start_tick;
-    bbt_t   end_tick;
-    bbt_t   index;
-
-    event*  evlast;
 
 } rt_pattern;
 
@@ -0,0 +1,72 @@
+#ifndef INCLUDE_EVENT_POOL_DATA_H
+#define INCLUDE_EVENT_POOL_DATA_H
+
+
+/*
+
+******************* THIS INCLUDE IS IMPLEMENTATION ONLy. *****************
+** DO NOT MAKE THIS DATA STRUCTURE ACCESSIBLE OUTSIDE OF IMPLEMENTATION **
+************************* THANKYOU FOR LISTENING *************************
+
+*/
+
+
+typedef struct rt_event_link
+{
+    event ev;
+    struct rt_event_link* prev;
+    struct rt_event_link* next;
+
+} rt_evlink;
+
+
+struct event_pool
+{
+    int     count;
+    int     free_count;
+    rt_evlink*   mempool;
+    rt_evlink*   memfree;
+
+    char* name;
+
+    #ifdef EVPOOL_DEBUG
+    int min_free;
+    #endif
+};
+
+
+static inline rt_evlink* evpool_private_event_alloc(evpool* evp)
+{
+    rt_evlink* evlnk = evp->memfree;
+
+    if (!evlnk)
+        return 0;
+
+    evp->memfree = evp->memfree->next;
+
+    --evp->free_count;
+
+#ifdef EVPOOL_DEBUG
+    if (evp->free_count < evp->min_free)
+        evp->min_free = evp->free_count;
+    evlnk->ev.flags = 0;
+#endif
+
+    return evlnk;
+}
+
+
+static inline void evpool_private_event_free(   evpool* evp,
+                                                rt_evlink* evlnk )
+{
+#ifdef EVPOOL_DEBUG
+    evlnk->ev.flags = EV_IS_FREE_ERROR;
+#endif
+
+    evlnk->next = evp->memfree;
+    evp->memfree = evlnk;
+    ++evp->free_count;
+}
+
+
+#endif
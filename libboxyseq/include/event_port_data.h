@@ -14,6 +14,7 @@
 struct event_port
 {
     char* name;
+    int   flags;
     rt_evlist*  data;
 };
 
@@ -14,9 +14,13 @@ struct grid_boundary
 {
     basebox     box;
     int         flags;
+    int         target_x;       /* for FSPLACE_NEAREST */
+    int         target_y;
+    int         grid;           /* index of the grid placed within */
     int         channel;
     int         scale_bin;
     int         scale_key;
+    uint64_t    scale_mask[2];  /* scale_bin and scale_key expanded */
 
     evport*     evinput;
 
@@ -29,6 +29,14 @@ struct jack_process_data
     bbt_t   oph;
     bbt_t   onph;
 
+    /*  offline: no JACK client. the transport is simulated and
+        driven by jackdata_offline_process instead of JACK.
+    */
+    _Bool   offline;
+    _Bool   offline_new_pos;
+    jack_transport_state_t  offline_state;
+    jack_position_t         offline_pos;
+
     _Bool is_master;
     _Bool is_rolling;
     _Bool is_valid;
@@ -10,15 +10,38 @@
 */
 
 
+/*  an entry in the heap of playing notes, ordered by note_dur and then
+    by note (channel * 128 + pitch) so notes ending together come out in
+    the same order as a scan through the play table would find them.
+*/
+typedef struct midi_out_port_active_note
+{
+    bbt_t       note_dur;
+    uint16_t    note;
+
+} moactive;
+
+
 struct midi_out_port
 {
     event  play[16][128];
 
+    /*  index of the notes playing in the play table: a bit per pitch
+        per channel, and a min-heap on note_dur.
+    */
+    uint64_t    active[16][2];
+    moactive    heap[16 * 128];
+    int         heap_count;
+
     char* name;
 
     jack_port_t*    jack_out_port;
     void*           jport_buf;
 
+    /* used in place of jport_buf when there is no jack_out_port */
+    momidi  capture[MOPORT_CAPTURE_SIZE];
+    int     capture_count;
+
 };
 
 
@@ -4,6 +4,7 @@
 #include "common.h"
 #include "debug.h"
 #include "pattern.h"
+#include "real_time_data.h"
 
 #include <math.h>
 #include <stdio.h>
@@ -25,8 +26,13 @@ static int  jack_process_callback(  jack_nframes_t nframes, void* arg);
 
 static void jackdata_jack_shutdown( void *arg );
 
+static void jackdata_thread_init( void *arg );
+
 static void jd_rt_poll(jackdata* jd, jack_nframes_t nframes);
 
+static jack_transport_state_t
+            jd_rt_transport_query(jackdata* jd, jack_position_t* pos);
+
 
 jackdata* jackdata_new(void)
 {
@@ -51,6 +57,11 @@ jackdata* jackdata_new(void)
     jd->oph = -1;
     jd->onph = 0;
 
+    jd->offline = 0;
+    jd->offline_new_pos = 0;
+    jd->offline_state = JackTransportStopped;
+    memset(&jd->offline_pos, 0, sizeof(jd->offline_pos));
+
     jd->is_master = 0;
     jd->is_rolling = 0;
     jd->is_valid = 0;
@@ -163,6 +174,13 @@ bool jackdata_startup(jackdata* jd, boxyseq* bs)
         return 0;
     }
 
+    if (jack_set_thread_init_callback(  jd->client,
+                                        jackdata_thread_init, jd) != 0)
+    {
+        WARNING("failed to init jack thread init callback\n");
+        return 0;
+    }
+
     jack_on_shutdown(jd->client, jackdata_jack_shutdown, jd);
 
     if (jack_activate(jd->client))
@@ -176,8 +194,126 @@ bool jackdata_startup(jackdata* jd, boxyseq* bs)
 }
 
 
+bool jackdata_startup_offline(jackdata* jd, boxyseq* bs,
+                                            jack_nframes_t frame_rate)
+{
+    if (!frame_rate)
+    {
+        WARNING("invalid frame rate for offline transport\n");
+        return 0;
+    }
+
+    jd->client = 0;
+    jd->client_name = "BoxySeq-offline";
+
+    jd->offline = 1;
+    jd->offline_new_pos = 1;
+    jd->offline_state = JackTransportStopped;
+
+    memset(&jd->offline_pos, 0, sizeof(jd->offline_pos));
+    jd->offline_pos.frame_rate = frame_rate;
+
+    /* there is nobody else to be master */
+    jd->is_master = 1;
+
+    boxyseq_set_jackdata(bs, jd);
+    jd->bs = bs;
+
+    return 1;
+}
+
+
+void jackdata_offline_process(jackdata* jd, jack_nframes_t nframes)
+{
+    if (!jd->offline)
+    {
+        WARNING("jackdata is not running offline\n");
+        return;
+    }
+
+    /*  jack only calls the timebase master while rolling or when
+        the transport has been relocated, the position it hands
+        the callback is the one the callback left behind last time.
+    */
+    if (jd->offline_state == JackTransportRolling || jd->offline_new_pos)
+    {
+        jack_timebase_callback( jd->offline_state, nframes,
+                                &jd->offline_pos,
+                                jd->offline_new_pos, jd);
+        jd->offline_new_pos = 0;
+    }
+
+    /* log as the JACK process thread would, for the caller to drain */
+    debug_rt_thread(1);
+    jack_process_callback(nframes, jd);
+    debug_rt_thread(0);
+
+    if (jd->offline_state == JackTransportRolling)
+        jd->offline_pos.frame += nframes;
+}
+
+
+bool jackdata_is_offline(jackdata* jd)
+{
+    return jd->offline;
+}
+
+
+void jackdata_replay(jackdata* jd, const jrnlrec* rec)
+{
+    jack_position_t pos;
+
+    if (!jd->offline)
+    {
+        WARNING("jackdata is not running offline\n");
+        return;
+    }
+
+    switch (rec->type)
+    {
+    case JRNL_TIMEBASE:
+        /* the UI may have changed these */
+        jd->master_beats_per_minute = rec->master_bpm;
+        jd->recalc_timebase = rec->recalc;
+
+        pos = rec->pos;
+        jack_timebase_callback(rec->state, rec->nframes, &pos,
+                                            rec->new_pos, jd);
+        break;
+
+    case JRNL_CYCLE:
+        jd->offline_state = rec->state;
+        jd->offline_pos = rec->pos;
+
+        debug_rt_thread(1);
+        jack_process_callback(rec->nframes, jd);
+        debug_rt_thread(0);
+        break;
+
+    default:
+        WARNING("not a journaled transport record\n");
+    }
+}
+
+
+double jackdata_master_beats_per_minute(jackdata* jd)
+{
+    return jd->master_beats_per_minute;
+}
+
+
+void jackdata_master_set_beats_per_minute(jackdata* jd, double bpm)
+{
+    jd->master_beats_per_minute = bpm;
+    jd->recalc_timebase = 1;
+}
+
+
 void jackdata_shutdown(jackdata* jd)
 {
+    if (jd->offline)
+        return;
+
     if (jd->is_master && jack_release_timebase(jd->client) != 0)
         WARNING("error occurred releasing timebase\n");
 
@@ -199,6 +335,13 @@ const char* jackdata_client_name(jackdata* jd)
 
 void jackdata_transport_rewind(jackdata* jd)
 {
+    if (jd->offline)
+    {
+        jd->offline_pos.frame = 0;
+        jd->offline_new_pos = 1;
+        return;
+    }
+
     #ifndef NO_REAL_TIME
     jack_transport_locate(jd->client, 0);
     #endif
@@ -206,6 +349,12 @@ void jackdata_transport_rewind(jackdata* jd)
 
 void jackdata_transport_play(jackdata* jd)
 {
+    if (jd->offline)
+    {
+        jd->offline_state = JackTransportRolling;
+        return;
+    }
+
     #ifdef NO_REAL_TIME
     jd->is_rolling = 1;
     #else
@@ -215,6 +364,12 @@ void jackdata_transport_play(jackdata* jd)
 
 void jackdata_transport_stop(jackdata* jd)
 {
+    if (jd->offline)
+    {
+        jd->offline_state = JackTransportStopped;
+        return;
+    }
+
     #ifdef NO_REAL_TIME
     jd->is_rolling = 0;
     #else
@@ -226,6 +381,9 @@ void jackdata_transport_stop(jackdata* jd)
 jack_transport_state_t
 jackdata_transport_state(jackdata* jd, jack_position_t* pos)
 {
+    if (jd->offline)
+        return jd_rt_transport_query(jd, pos);
+
     #ifdef NO_REAL_TIME
     if (pos)
         memset(pos, 0, sizeof(*pos));
@@ -253,6 +411,9 @@ static void jack_timebase_callback( jack_transport_state_t  state,
 {
     jackdata* jd = (jackdata*)arg;
 
+    jrnl_rt_timebase(boxyseq_journal(jd->bs), state, nframes, pos, new_pos,
+                        jd->recalc_timebase, jd->master_beats_per_minute);
+
     if (pos->frame_rate != jd->frame_rate)
         jd->recalc_timebase = 1;
 
@@ -319,6 +480,19 @@ static void jack_timebase_callback( jack_transport_state_t  state,
 }
 
 
+static jack_transport_state_t
+            jd_rt_transport_query(jackdata* jd, jack_position_t* pos)
+{
+    if (!jd->offline)
+        return jack_transport_query(jd->client, pos);
+
+    if (pos)
+        *pos = jd->offline_pos;
+
+    return jd->offline_state;
+}
+
+
 static void jd_rt_poll(jackdata* jd, jack_nframes_t nframes)
 {
     jack_position_t         pos;
@@ -326,7 +500,9 @@ static void jd_rt_poll(jackdata* jd, jack_nframes_t nframes)
 
     bool meter_change, bpm_change, frame_rate_change;
 
-    jstate = jack_transport_query(jd->client, &pos);
+    jstate = jd_rt_transport_query(jd, &pos);
+
+    jrnl_rt_cycle(boxyseq_journal(jd->bs), jstate, nframes, &pos);
 
     jd->is_rolling = (jstate == JackTransportRolling);
 
@@ -402,17 +578,16 @@ static void jd_rt_poll(jackdata* jd, jack_nframes_t nframes)
 }
 
 
-static int jack_process_callback(jack_nframes_t nframes, void* arg)
+static void jack_process_cycle(jackdata* jd, jack_nframes_t nframes)
 {
     bbt_t ph;
     bbt_t nph;
     bool repositioned = 0;
-    jackdata* jd = (jackdata*)arg;
 
     jd_rt_poll(jd, nframes);
 
     if (!jd->is_valid)
-        return 0;
+        return;
 
     boxyseq_rt_init_jack_cycle(jd->bs, nframes);
 
@@ -433,7 +608,7 @@ static int jack_process_callback(jack_nframes_t nframes, void* arg)
             jd->was_stopped = 1;
             boxyseq_rt_clear(jd->bs, ph, nph, nframes);
         }
-        return 0;
+        return;
     }
 
     if (jd->repositioned && !jd->was_stopped)
@@ -447,7 +622,7 @@ static int jack_process_callback(jack_nframes_t nframes, void* arg)
     if (ph && ph == jd->oph)
     {
         jd->was_stopped = 0;
-        return 0;
+        return;
     }
 
     if (ph != jd->onph && !repositioned)
@@ -472,12 +647,21 @@ static int jack_process_callback(jack_nframes_t nframes, void* arg)
 
     jd->onph = nph;
 
-    boxyseq_rt_play(jd->bs, nframes, repositioned, ph, nph);
+    boxyseq_rt_play(jd->bs, nframes, ph, nph);
 
     jd->oph = ph;
+}
 
-    return 0;
 
+/*  the RT thread holds no rtdata outside rtdata_rt_cycle_begin/end
+*/
+static int jack_process_callback(jack_nframes_t nframes, void* arg)
+{
+    rtdata_rt_cycle_begin();
+    jack_process_cycle((jackdata*)arg, nframes);
+    rtdata_rt_cycle_end();
+
+    return 0;
 }
 
 
@@ -487,6 +671,15 @@ static void jackdata_jack_shutdown( void *arg )
     exit(1);
 }
 
+
+static void jackdata_thread_init( void *arg )
+{
+    (void)arg;
+
+    /* the process thread must not block in stdio */
+    debug_rt_thread(1);
+}
+
 #ifndef NDEBUG
 void jackdata_rt_get_playhead(jackdata* jd, bbt_t* ph, bbt_t* nph)
 {
@@ -9,6 +9,7 @@ extern "C" {
 
 #include "boxyseq_types.h"
 #include "event.h"
+#include "journal.h"
 
 
 #include <jack/jack.h>
@@ -24,6 +25,31 @@ void            jackdata_free(jackdata*);
 bool            jackdata_startup(jackdata*, boxyseq*);
 void            jackdata_shutdown(jackdata*);
 
+
+/*  offline operation
+ *---------------------
+ *  jackdata_startup_offline is the alternative to jackdata_startup for
+ *  when there is no JACK server. no client is opened, instead the
+ *  transport is simulated (with jackdata as timebase master) and each
+ *  call to jackdata_offline_process runs one process cycle of nframes
+ *  in the calling thread. the jackdata_transport_* functions work on
+ *  the simulated transport.
+ */
+bool            jackdata_startup_offline(jackdata*, boxyseq*,
+                                            jack_nframes_t frame_rate);
+void            jackdata_offline_process(jackdata*, jack_nframes_t nframes);
+bool            jackdata_is_offline(jackdata*);
+
+/*  jackdata_replay:    replays a JRNL_TIMEBASE or JRNL_CYCLE record into
+                        an offline jackdata, in place of the transport
+                        it simulates. a cycle record runs a process
+                        cycle.
+*/
+void            jackdata_replay(jackdata*, const jrnlrec*);
+
+double          jackdata_master_beats_per_minute(jackdata*);
+void            jackdata_master_set_beats_per_minute(jackdata*, double);
+
 jack_client_t * jackdata_client(jackdata*);
 const char*     jackdata_client_name(jackdata*);
 
@@ -0,0 +1,772 @@
+#include "journal.h"
+
+
+#include "debug.h"
+#include "real_time_data.h"
+
+
+#include <glib.h>
+#include <jack/ringbuffer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define JRNL_MAGIC      "BSQJ"
+#define JRNL_VERSION    2
+
+/* bytes held by the ringbuffer between drains */
+#define JRNL_RING_SIZE  (1 << 16)
+
+
+/*  the fields of jack_position_t the sequencer uses. all journal data
+    is in the byte order of the machine which recorded it.
+*/
+typedef struct journal_position
+{
+    uint32_t    frame;
+    uint32_t    frame_rate;
+    uint32_t    valid;
+    int32_t     bar;
+    int32_t     beat;
+    int32_t     tick;
+    float       beats_per_bar;
+    float       beat_type;
+    double      bar_start_tick;
+    double      ticks_per_beat;
+    double      beats_per_minute;
+
+} jrnlpos;
+
+
+typedef struct journal_timebase
+{
+    uint8_t     state;
+    uint8_t     new_pos;
+    uint8_t     recalc;
+    uint32_t    nframes;
+    double      master_bpm;
+    jrnlpos     pos;
+
+} jrnltb;
+
+
+typedef struct journal_cycle
+{
+    uint32_t    cycle;
+    uint32_t    nframes;
+    uint8_t     state;
+    jrnlpos     pos;
+
+} jrnlcyc;
+
+
+/* each record stamped with a cycle has it first */
+typedef struct journal_grbound
+{
+    uint32_t    cycle;
+    uint32_t    id;
+    grbstate    grb;
+    int32_t     port;
+    int32_t     moport;
+
+} jrnlgrb;
+
+
+typedef struct journal_grbound_order
+{
+    uint32_t    cycle;
+    uint32_t    id;
+    int32_t     dir;
+
+} jrnlord;
+
+
+typedef struct journal_pattern
+{
+    uint32_t    cycle;
+    uint32_t    id;
+    patstate    pat;
+    int32_t     port;
+    uint32_t    event_count;
+
+} jrnlpat;
+
+
+typedef struct journal_list
+{
+    uint32_t    cycle;
+    int32_t     index;
+    int32_t     flags;
+
+} jrnllist;
+
+
+typedef struct journal_header
+{
+    char        magic[4];
+    uint32_t    version;
+    uint32_t    event_size;
+    jrnlsession session;
+
+} jrnlhead;
+
+
+/* a change waiting to be used by the RT thread */
+typedef struct journal_pending
+{
+    int         type;
+    rtdata*     rt;
+    unsigned    gen;
+    event*      events;     /* PATTERN */
+
+    union
+    {
+        uint32_t    cycle;
+        jrnlgrb     grb;
+        jrnlord     ord;
+        jrnlpat     pat;
+        jrnllist    list;
+    } rec;
+
+} jrnlpend;
+
+
+struct journal
+{
+    FILE*       fp;
+    jrnlsession session;
+
+    jack_ringbuffer_t*  ring;
+    gint        overflows;
+    int         overflows_told;
+
+    jrnlpend*   pend;
+    int         pend_count;
+    int         pend_alloc;
+
+    /* loaded */
+    jrnlrec*    recs;
+    size_t      rec_count;
+    size_t      rec_alloc;
+    size_t      events_left;
+};
+
+
+static size_t jrnl_record_size(int type)
+{
+    switch (type)
+    {
+    case JRNL_TIMEBASE:         return sizeof(jrnltb);
+    case JRNL_CYCLE:            return sizeof(jrnlcyc);
+    case JRNL_INPUT:            return sizeof(event);
+    case JRNL_GRBOUND:          return sizeof(jrnlgrb);
+    case JRNL_GRBOUND_ORDER:    return sizeof(jrnlord);
+    case JRNL_PATTERN:          return sizeof(jrnlpat);
+    case JRNL_PATTERN_EVENT:    return sizeof(event);
+    case JRNL_GRBOUNDS:
+    case JRNL_PATTERNS:
+    case JRNL_EVPORTS:
+    case JRNL_MOPORTS:          return sizeof(jrnllist);
+    default:                    return 0;
+    }
+}
+
+
+static jrnl* jrnl_private_new(void)
+{
+    jrnl* jr = malloc(sizeof(*jr));
+
+    if (!jr)
+        return 0;
+
+    jr->fp = 0;
+    memset(&jr->session, 0, sizeof(jr->session));
+
+    jr->ring = 0;
+    jr->overflows = 0;
+    jr->overflows_told = 0;
+
+    jr->pend = 0;
+    jr->pend_count = 0;
+    jr->pend_alloc = 0;
+
+    jr->recs = 0;
+    jr->rec_count = 0;
+    jr->rec_alloc = 0;
+    jr->events_left = 0;
+
+    return jr;
+}
+
+
+jrnl* jrnl_new(const char* filename, const jrnlsession* session)
+{
+    jrnl* jr = jrnl_private_new();
+    jrnlhead head;
+
+    if (!jr)
+        goto fail0;
+
+    jr->session = *session;
+
+    if (!(jr->ring = jack_ringbuffer_create(JRNL_RING_SIZE)))
+        goto fail1;
+
+    if (jack_ringbuffer_mlock(jr->ring))
+        WARNING("failed to lock journal ringbuffer into memory\n");
+
+    if (!(jr->fp = fopen(filename, "wb")))
+    {
+        WARNING("failed to open journal '%s'\n", filename);
+        goto fail2;
+    }
+
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, JRNL_MAGIC, 4);
+    head.version = JRNL_VERSION;
+    head.event_size = sizeof(event);
+    head.session = *session;
+
+    if (fwrite(&head, sizeof(head), 1, jr->fp) != 1)
+        goto fail3;
+
+    return jr;
+
+fail3:  fclose(jr->fp);
+fail2:  jack_ringbuffer_free(jr->ring);
+fail1:  free(jr);
+fail0:  WARNING("failed to create journal\n");
+    return 0;
+}
+
+
+void jrnl_free(jrnl* jr)
+{
+    size_t i;
+
+    if (!jr)
+        return;
+
+    if (jr->fp)
+    {
+        jrnl_ui_drain(jr);
+
+        /* changes the RT thread never used changed nothing */
+        if (jr->pend_count)
+            DMESSAGE("%d changes never used\n", jr->pend_count);
+
+        fclose(jr->fp);
+    }
+
+    if (jr->ring)
+        jack_ringbuffer_free(jr->ring);
+
+    for (i = 0; i < (size_t)jr->pend_count; ++i)
+        free(jr->pend[i].events);
+
+    for (i = 0; i < jr->rec_count; ++i)
+        free(jr->recs[i].events);
+
+    free(jr->pend);
+    free(jr->recs);
+    free(jr);
+}
+
+
+static void jrnl_pos_pack(jrnlpos* jp, const jack_position_t* pos)
+{
+    jp->frame =             pos->frame;
+    jp->frame_rate =        pos->frame_rate;
+    jp->valid =             pos->valid;
+    jp->bar =               pos->bar;
+    jp->beat =              pos->beat;
+    jp->tick =              pos->tick;
+    jp->beats_per_bar =     pos->beats_per_bar;
+    jp->beat_type =         pos->beat_type;
+    jp->bar_start_tick =    pos->bar_start_tick;
+    jp->ticks_per_beat =    pos->ticks_per_beat;
+    jp->beats_per_minute =  pos->beats_per_minute;
+}
+
+
+static void jrnl_pos_unpack(jack_position_t* pos, const jrnlpos* jp)
+{
+    memset(pos, 0, sizeof(*pos));
+
+    pos->frame =            jp->frame;
+    pos->frame_rate =       jp->frame_rate;
+    pos->valid =            jp->valid;
+    pos->bar =              jp->bar;
+    pos->beat =             jp->beat;
+    pos->tick =             jp->tick;
+    pos->beats_per_bar =    jp->beats_per_bar;
+    pos->beat_type =        jp->beat_type;
+    pos->bar_start_tick =   jp->bar_start_tick;
+    pos->ticks_per_beat =   jp->ticks_per_beat;
+    pos->beats_per_minute = jp->beats_per_minute;
+}
+
+
+static void jrnl_rt_write(jrnl* jr, int type, const void* data, size_t size)
+{
+    char buf[1 + sizeof(jrnltb) + sizeof(event)];
+
+    if (jack_ringbuffer_write_space(jr->ring) < size + 1)
+    {
+        g_atomic_int_inc(&jr->overflows);
+        return;
+    }
+
+    /* in one piece, so the reader never sees half a record */
+    buf[0] = type;
+    memcpy(buf + 1, data, size);
+    jack_ringbuffer_write(jr->ring, buf, size + 1);
+}
+
+
+void jrnl_rt_timebase(jrnl* jr, jack_transport_state_t state,
+                                jack_nframes_t nframes,
+                                const jack_position_t* pos,
+                                int new_pos,
+                                int recalc,
+                                double master_bpm)
+{
+    jrnltb tb;
+
+    if (!jr)
+        return;
+
+    memset(&tb, 0, sizeof(tb));
+    tb.state = state;
+    tb.new_pos = new_pos;
+    tb.recalc = recalc;
+    tb.nframes = nframes;
+    tb.master_bpm = master_bpm;
+    jrnl_pos_pack(&tb.pos, pos);
+
+    jrnl_rt_write(jr, JRNL_TIMEBASE, &tb, sizeof(tb));
+}
+
+
+void jrnl_rt_cycle(jrnl* jr,    jack_transport_state_t state,
+                                jack_nframes_t nframes,
+                                const jack_position_t* pos)
+{
+    jrnlcyc cyc;
+
+    if (!jr)
+        return;
+
+    memset(&cyc, 0, sizeof(cyc));
+    cyc.cycle = rtdata_rt_cycle();
+    cyc.nframes = nframes;
+    cyc.state = state;
+    jrnl_pos_pack(&cyc.pos, pos);
+
+    jrnl_rt_write(jr, JRNL_CYCLE, &cyc, sizeof(cyc));
+}
+
+
+void jrnl_rt_input(jrnl* jr, const event* ev)
+{
+    if (!jr)
+        return;
+
+    jrnl_rt_write(jr, JRNL_INPUT, ev, sizeof(*ev));
+}
+
+
+static jrnlpend* jrnl_ui_pend(jrnl* jr, int type, rtdata* rt)
+{
+    jrnlpend* pd;
+
+    if (jr->pend_count == jr->pend_alloc)
+    {
+        int alloc = jr->pend_alloc ? jr->pend_alloc * 2 : 16;
+
+        if (!(pd = realloc(jr->pend, sizeof(*pd) * alloc)))
+        {
+            WARNING("out of memory, journal incomplete\n");
+            return 0;
+        }
+
+        jr->pend = pd;
+        jr->pend_alloc = alloc;
+    }
+
+    pd = &jr->pend[jr->pend_count++];
+    memset(pd, 0, sizeof(*pd));
+    pd->type = type;
+    pd->rt = rt;
+    pd->gen = rtdata_gen(rt);
+
+    return pd;
+}
+
+
+void jrnl_ui_grbound(jrnl* jr, grbound* grb, int port, int moport)
+{
+    jrnlpend* pd;
+
+    if (!jr || !(pd = jrnl_ui_pend(jr, JRNL_GRBOUND, grbound_rtdata(grb))))
+        return;
+
+    pd->rec.grb.id = grbound_id(grb);
+    grbound_state_get(grb, &pd->rec.grb.grb);
+    pd->rec.grb.port = port;
+    pd->rec.grb.moport = moport;
+}
+
+
+void jrnl_ui_pattern(jrnl* jr, pattern* pat, int port)
+{
+    evlist* el = pattern_event_list(pat);
+    jrnlpend* pd;
+    lnode* ln;
+    size_t count = evlist_event_count(el);
+    size_t i;
+
+    if (!jr || !(pd = jrnl_ui_pend(jr, JRNL_PATTERN, pattern_rtdata(pat))))
+        return;
+
+    if (count && !(pd->events = malloc(sizeof(event) * count)))
+    {
+        WARNING("out of memory, journal incomplete\n");
+        --jr->pend_count;
+        return;
+    }
+
+    /* as the events are, bytes and all, so a replay copies them alike */
+    for (i = 0, ln = evlist_head(el); ln; ln = lnode_next(ln), ++i)
+        memcpy(&pd->events[i], lnode_data(ln), sizeof(event));
+
+    pd->rec.pat.id = rtdata_id(pattern_rtdata(pat));
+    pattern_state_get(pat, &pd->rec.pat.pat);
+    pd->rec.pat.port = port;
+    pd->rec.pat.event_count = count;
+}
+
+
+void jrnl_ui_list(jrnl* jr, int type, rtdata* rt, int index, int flags)
+{
+    jrnlpend* pd;
+
+    if (!jr || !(pd = jrnl_ui_pend(jr, type, rt)))
+        return;
+
+    pd->rec.list.index = index;
+    pd->rec.list.flags = flags;
+}
+
+
+void jrnl_ui_grbound_order(jrnl* jr, grbound_manager* grbman,
+                                     grbound* grb, int dir)
+{
+    jrnlpend* pd;
+
+    if (!jr || !(pd = jrnl_ui_pend(jr, JRNL_GRBOUND_ORDER,
+                                        grbound_manager_rtdata(grbman))))
+        return;
+
+    pd->rec.ord.id = grbound_id(grb);
+    pd->rec.ord.dir = dir;
+}
+
+
+bool jrnl_ui_drain(jrnl* jr)
+{
+    char buf[sizeof(jrnltb) + sizeof(event)];
+    char evtype = JRNL_PATTERN_EVENT;
+    int overflows;
+    int i = 0;
+    int n = 0;
+    uint32_t e;
+
+    if (!jr || !jr->fp)
+        return 1;
+
+    while (jack_ringbuffer_read_space(jr->ring))
+    {
+        char type;
+        size_t size;
+
+        jack_ringbuffer_peek(jr->ring, &type, 1);
+        size = jrnl_record_size(type);
+
+        if (jack_ringbuffer_read_space(jr->ring) < size + 1)
+            break;
+
+        jack_ringbuffer_read_advance(jr->ring, 1);
+        jack_ringbuffer_read(jr->ring, buf, size);
+
+        if (fwrite(&type, 1, 1, jr->fp) != 1
+         || fwrite(buf, size, 1, jr->fp) != 1)
+            goto fail;
+    }
+
+    /* the changes the RT thread has used, and in which cycle */
+    for (; i < jr->pend_count; ++i)
+    {
+        jrnlpend* pd = &jr->pend[i];
+        unsigned cycle;
+        char type = pd->type;
+        int seen = rtdata_ui_seen(pd->rt, pd->gen, &cycle);
+
+        if (seen == 0)
+        {
+            jr->pend[n++] = *pd;
+            continue;
+        }
+
+        if (seen < 0)
+        {
+            WARNING("journal lost track of a change\n");
+            free(pd->events);
+            continue;
+        }
+
+        pd->rec.cycle = cycle;
+
+        if (fwrite(&type, 1, 1, jr->fp) != 1
+         || fwrite(&pd->rec, jrnl_record_size(type), 1, jr->fp) != 1)
+            goto fail;
+
+        for (e = 0; type == JRNL_PATTERN && e < pd->rec.pat.event_count; ++e)
+        {
+            if (fwrite(&evtype, 1, 1, jr->fp) != 1
+             || fwrite(&pd->events[e], sizeof(event), 1, jr->fp) != 1)
+                goto fail;
+        }
+
+        free(pd->events);
+    }
+
+    jr->pend_count = n;
+
+    overflows = g_atomic_int_get(&jr->overflows);
+
+    if (overflows != jr->overflows_told)
+    {
+        WARNING("journal overflowed, %d records lost\n",
+                                    overflows - jr->overflows_told);
+        jr->overflows_told = overflows;
+    }
+
+    return 1;
+
+fail:
+    /* what was not written is kept, to be freed along with the jrnl */
+    while (i < jr->pend_count)
+        jr->pend[n++] = jr->pend[i++];
+
+    jr->pend_count = n;
+
+    WARNING("failed writing journal, closing it\n");
+    fclose(jr->fp);
+    jr->fp = 0;
+    return 0;
+}
+
+
+static bool jrnl_load_record(jrnl* jr, int type, const void* data)
+{
+    jrnlrec* rec;
+
+    /* the events of a pattern follow it */
+    if (type == JRNL_PATTERN_EVENT)
+    {
+        if (!jr->events_left)
+        {
+            WARNING("journal pattern event without a pattern\n");
+            return 1;
+        }
+
+        rec = &jr->recs[jr->rec_count - 1];
+        memcpy(&rec->events[rec->event_count++], data, sizeof(event));
+        --jr->events_left;
+        return 1;
+    }
+
+    if (jr->events_left)
+        WARNING("journal pattern is missing %lu events\n",
+                                    (unsigned long)jr->events_left);
+
+    jr->events_left = 0;
+
+    if (jr->rec_count == jr->rec_alloc)
+    {
+        size_t alloc = jr->rec_alloc ? jr->rec_alloc * 2 : 1024;
+
+        if (!(rec = realloc(jr->recs, sizeof(*rec) * alloc)))
+            return 0;
+
+        jr->recs = rec;
+        jr->rec_alloc = alloc;
+    }
+
+    rec = &jr->recs[jr->rec_count++];
+    memset(rec, 0, sizeof(*rec));
+    rec->type = type;
+
+    switch (type)
+    {
+    case JRNL_TIMEBASE:
+    {
+        const jrnltb* tb = data;
+        rec->state =        tb->state;
+        rec->nframes =      tb->nframes;
+        rec->new_pos =      tb->new_pos;
+        rec->recalc =       tb->recalc;
+        rec->master_bpm =   tb->master_bpm;
+        jrnl_pos_unpack(&rec->pos, &tb->pos);
+        break;
+    }
+
+    case JRNL_CYCLE:
+    {
+        const jrnlcyc* cyc = data;
+        rec->cycle =        cyc->cycle;
+        rec->state =        cyc->state;
+        rec->nframes =      cyc->nframes;
+        jrnl_pos_unpack(&rec->pos, &cyc->pos);
+        break;
+    }
+
+    case JRNL_INPUT:
+        memcpy(&rec->ev, data, sizeof(rec->ev));
+        break;
+
+    case JRNL_GRBOUND:
+    {
+        const jrnlgrb* grb = data;
+        rec->cycle =        grb->cycle;
+        rec->id =           grb->id;
+        rec->grb =          grb->grb;
+        rec->port =         grb->port;
+        rec->moport =       grb->moport;
+        break;
+    }
+
+    case JRNL_GRBOUND_ORDER:
+    {
+        const jrnlord* ord = data;
+        rec->cycle =        ord->cycle;
+        rec->id =           ord->id;
+        rec->dir =          ord->dir;
+        break;
+    }
+
+    case JRNL_PATTERN:
+    {
+        const jrnlpat* pat = data;
+        rec->cycle =        pat->cycle;
+        rec->id =           pat->id;
+        rec->pat =          pat->pat;
+        rec->port =         pat->port;
+
+        if (pat->event_count && !(rec->events =
+                            malloc(sizeof(event) * pat->event_count)))
+        {
+            --jr->rec_count;
+            return 0;
+        }
+
+        jr->events_left =   pat->event_count;
+        break;
+    }
+
+    case JRNL_GRBOUNDS:
+    case JRNL_PATTERNS:
+    case JRNL_EVPORTS:
+    case JRNL_MOPORTS:
+    {
+        const jrnllist* list = data;
+        rec->cycle =        list->cycle;
+        rec->port =         list->index;
+        rec->flags =        list->flags;
+        break;
+    }
+    }
+
+    return 1;
+}
+
+
+jrnl* jrnl_load(const char* filename)
+{
+    jrnl* jr = jrnl_private_new();
+    char buf[sizeof(jrnltb) + sizeof(event)];
+    jrnlhead head;
+    FILE* fp;
+    int type;
+
+    if (!jr)
+        goto fail0;
+
+    if (!(fp = fopen(filename, "rb")))
+    {
+        WARNING("failed to open journal '%s'\n", filename);
+        goto fail1;
+    }
+
+    if (fread(&head, sizeof(head), 1, fp) != 1
+     || memcmp(head.magic, JRNL_MAGIC, 4) != 0)
+    {
+        WARNING("'%s' is not a journal\n", filename);
+        goto fail2;
+    }
+
+    if (head.version != JRNL_VERSION || head.event_size != sizeof(event))
+    {
+        WARNING("journal '%s' was recorded by another version\n",
+                                                            filename);
+        goto fail2;
+    }
+
+    jr->session = head.session;
+
+    while ((type = fgetc(fp)) != EOF)
+    {
+        size_t size = jrnl_record_size(type);
+
+        if (!size || fread(buf, size, 1, fp) != 1)
+        {
+            WARNING("journal '%s' is truncated or corrupt\n", filename);
+            break;
+        }
+
+        if (!jrnl_load_record(jr, type, buf))
+        {
+            WARNING("out of memory loading journal\n");
+            goto fail2;
+        }
+    }
+
+    fclose(fp);
+
+    return jr;
+
+fail2:  fclose(fp);
+fail1:  jrnl_free(jr);
+fail0:  WARNING("failed to load journal\n");
+    return 0;
+}
+
+
+const jrnlsession* jrnl_session(jrnl* jr)
+{
+    return &jr->session;
+}
+
+
+size_t jrnl_record_count(jrnl* jr)
+{
+    return jr->rec_count;
+}
+
+
+const jrnlrec* jrnl_record(jrnl* jr, size_t index)
+{
+    return &jr->recs[index];
+}
@@ -0,0 +1,187 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "event.h"
+#include "grbound_manager.h"
+#include "grid_boundary.h"
+#include "pattern.h"
+
+
+#include <jack/jack.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*  input journal
+ *-----------------
+ *  records everything entering the RT side from outside, in a compact
+ *  binary file, so that a session can be replayed offline cycle for
+ *  cycle and produce the very same output:
+ *
+ *      JRNL_TIMEBASE       each call of the timebase callback, with the
+ *                          master tempo it was given,
+ *      JRNL_CYCLE          the transport state and position each
+ *                          process cycle polled, and nframes,
+ *      JRNL_INPUT          each event read from the UI input buffer,
+ *      JRNL_GRBOUND        each boundary published, with its settings
+ *                          and the indices of its ports,
+ *      JRNL_GRBOUND_ORDER  a boundary the UI moved in the order,
+ *      JRNL_GRBOUNDS       each list of the boundaries published,
+ *      JRNL_PATTERN        each pattern published, with its settings
+ *                          and the index of its output port, followed
+ *                          by a JRNL_PATTERN_EVENT for each of its
+ *                          events,
+ *      JRNL_PATTERNS       each list of the patterns published,
+ *      JRNL_EVPORTS        each list of the pattern ports published, a
+ *                          record for each port with its sort flags,
+ *      JRNL_MOPORTS        each list of the midi out ports published, a
+ *                          record for each port.
+ *
+ *  everything the UI publishes is stamped with the cycle
+ *  (rtdata_rt_cycle) in which the RT thread first used it, and a replay
+ *  builds the session from these records as it goes. ports are only
+ *  ever added, and are known by their index in their list, boundaries
+ *  and patterns by their rtdata_id. the jrnl_rt_* functions write
+ *  into a lock-free ringbuffer and are for the RT thread only. the
+ *  jrnl_ui_* functions are for a single non-RT thread, which must call
+ *  jrnl_ui_drain regularly to write out what was recorded. all do
+ *  nothing when the jrnl is NULL. should the ringbuffer overflow, the
+ *  journal is incomplete, and a warning says so.
+ *
+ *  jrnlsession holds what the records do not: the number of grids the
+ *  host made, and the seed it built the session with. the journal must
+ *  be set (boxyseq_set_journal) before the session is built.
+ *
+ *  jrnl_load reads a journal back in full (see offrender_replay).
+ */
+
+
+typedef struct journal jrnl;
+
+
+typedef struct journal_session
+{
+    uint32_t    seed;
+    int32_t     grids;
+
+} jrnlsession;
+
+
+enum JOURNAL_RECORD_TYPES
+{
+    JRNL_TIMEBASE = 1,
+    JRNL_CYCLE,
+    JRNL_INPUT,
+    JRNL_GRBOUND,
+    JRNL_GRBOUND_ORDER,
+    JRNL_GRBOUNDS,
+    JRNL_PATTERN,
+    JRNL_PATTERN_EVENT,
+    JRNL_PATTERNS,
+    JRNL_EVPORTS,
+    JRNL_MOPORTS
+};
+
+
+typedef struct journal_record
+{
+    int             type;
+    unsigned        cycle;      /* all but TIMEBASE and INPUT */
+
+    /* TIMEBASE, CYCLE */
+    jack_transport_state_t  state;
+    jack_nframes_t          nframes;
+    jack_position_t         pos;
+
+    /* TIMEBASE */
+    int             new_pos;
+    int             recalc;
+    double          master_bpm;
+
+    /* INPUT */
+    event           ev;
+
+    /* GRBOUND, GRBOUND_ORDER, PATTERN */
+    unsigned        id;         /* rtdata_id */
+    grbstate        grb;
+    int             dir;
+
+    /* PATTERN */
+    patstate        pat;
+    event*          events;
+    size_t          event_count;
+
+    /* GRBOUND, PATTERN: the index of the port, -1 for none */
+    int             port;       /* also EVPORTS, MOPORTS */
+    int             moport;
+
+    /* EVPORTS */
+    int             flags;
+
+} jrnlrec;
+
+
+jrnl*   jrnl_new(const char* filename, const jrnlsession*);
+void    jrnl_free(jrnl*);
+
+void    jrnl_rt_timebase(jrnl*,     jack_transport_state_t,
+                                    jack_nframes_t,
+                                    const jack_position_t*,
+                                    int new_pos,
+                                    int recalc,
+                                    double master_bpm);
+
+void    jrnl_rt_cycle(jrnl*,        jack_transport_state_t,
+                                    jack_nframes_t,
+                                    const jack_position_t*);
+
+void    jrnl_rt_input(jrnl*, const event*);
+
+/*  as each scene is committed (see rtdata_ui_set_published_cb):
+
+    jrnl_ui_grbound:        records the boundary as just published, port
+                            and moport being the indices of its input
+                            port and midi out port.
+    jrnl_ui_pattern:        records the pattern and its events as just
+                            published, port being the index of its
+                            output port.
+    jrnl_ui_list:           records a list just published by rt, type
+                            being one of JRNL_GRBOUNDS, JRNL_PATTERNS,
+                            JRNL_EVPORTS and JRNL_MOPORTS. the lists of
+                            ports are recorded port by port, index and
+                            flags being those of each port.
+
+    jrnl_ui_grbound_order:  records grbound_manager_grbound_order, after
+                            grbound_manager_update_rt_data.
+*/
+void    jrnl_ui_grbound(jrnl*, grbound*, int port, int moport);
+void    jrnl_ui_pattern(jrnl*, pattern*, int port);
+void    jrnl_ui_list(jrnl*, int type, rtdata*, int index, int flags);
+void    jrnl_ui_grbound_order(jrnl*, grbound_manager*, grbound*, int dir);
+
+/*  jrnl_ui_drain:  writes out the records made since the last drain,
+                    returns false if writing failed.
+*/
+bool    jrnl_ui_drain(jrnl*);
+
+
+jrnl*               jrnl_load(const char* filename);
+
+const jrnlsession*  jrnl_session(jrnl*);
+size_t              jrnl_record_count(jrnl*);
+const jrnlrec*      jrnl_record(jrnl*, size_t index);
+
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+
+
+#endif
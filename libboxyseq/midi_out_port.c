@@ -4,11 +4,11 @@
 #include "debug.h"
 #include "freespace_state.h"
 #include "grid_boundary.h"
-#include "musical_scale.h"
 #include "box_grid.h"
 
 
 #include <jack/midiport.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -28,22 +28,26 @@ moport* moport_new(jack_client_t* client,   int port_id,
     snprintf(tmp, 79, "port-%2d", port_id);
     mo->name = strdup(tmp);
 
+    mo->jack_out_port = 0;
+
     #ifndef NO_REAL_TIME
-    mo->jack_out_port = jack_port_register( client,
-                                            mo->name,
-                                            JACK_DEFAULT_MIDI_TYPE,
-                                            JackPortIsOutput,
-                                            0);
-    if (!mo->jack_out_port)
+    if (client)
     {
-        WARNING("failed to register jack port\n");
-        goto fail2;
+        mo->jack_out_port = jack_port_register( client,
+                                                mo->name,
+                                                JACK_DEFAULT_MIDI_TYPE,
+                                                JackPortIsOutput,
+                                                0);
+        if (!mo->jack_out_port)
+        {
+            WARNING("failed to register jack port\n");
+            goto fail2;
+        }
     }
-    #else
-    mo->jack_out_port = 0;
     #endif
 
     mo->jport_buf = 0;
+    mo->capture_count = 0;
 
     int c, p;
 
@@ -51,8 +55,12 @@ moport* moport_new(jack_client_t* client,   int port_id,
     {
         for (p = 0; p < 128; ++p)
              mo->play[c][p].flags = 0;
+
+        mo->active[c][0] = mo->active[c][1] = 0;
     }
 
+    mo->heap_count = 0;
+
     return mo;
 
 fail2:  free(mo->name);
@@ -72,11 +80,97 @@ void moport_free(moport* mo)
 }
 
 
+static inline bool moactive_less(const moactive* a, const moactive* b)
+{
+    return a->note_dur < b->note_dur
+        || (a->note_dur == b->note_dur && a->note < b->note);
+}
+
+
+static void moport_rt_active_add(moport* midiport, int channel, int pitch,
+                                                   bbt_t note_dur)
+{
+    moactive* heap = midiport->heap;
+    moactive na;
+    int i = midiport->heap_count++;
+
+    na.note_dur = note_dur;
+    na.note = (uint16_t)(channel * 128 + pitch);
+
+    while (i)
+    {
+        int parent = (i - 1) / 2;
+
+        if (!moactive_less(&na, &heap[parent]))
+            break;
+
+        heap[i] = heap[parent];
+        i = parent;
+    }
+
+    heap[i] = na;
+
+    midiport->active[channel][pitch >> 6] |= (uint64_t)1 << (pitch & 63);
+}
+
+
+static void moport_rt_active_pop(moport* midiport)
+{
+    moactive* heap = midiport->heap;
+    moactive na;
+    int count = --midiport->heap_count;
+    int i = 0;
+
+    if (!count)
+        return;
+
+    na = heap[count];
+
+    for (;;)
+    {
+        int child = i * 2 + 1;
+
+        if (child >= count)
+            break;
+
+        if (child + 1 < count && moactive_less(&heap[child + 1],
+                                               &heap[child]))
+            ++child;
+
+        if (!moactive_less(&heap[child], &na))
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = na;
+}
+
+
+/* bits lo to hi (inclusive, 0 to 127) of a 128-bit mask word n */
+static inline uint64_t moport_mask_range(int n, int lo, int hi)
+{
+    lo -= n * 64;
+    hi -= n * 64;
+
+    if (lo < 0)
+        lo = 0;
+
+    if (hi > 63)
+        hi = 63;
+
+    if (lo > hi)
+        return 0;
+
+    return (~(uint64_t)0 << lo) & (~(uint64_t)0 >> (63 - hi));
+}
+
+
 int moport_rt_push_event_pitch(moport* midiport,
                                     const event* ev,
                                     int grb_flags,
-                                    int scale_bin,
-                                    int scale_key )
+                                    const uint64_t scale_mask[2])
 {
     if (ev->note_dur == ev->pos)
         return -1;
@@ -85,100 +179,161 @@ int moport_rt_push_event_pitch(moport* midiport,
     EVENT_IS(ev, EV_STATUS_ON | EV_TYPE_NOTE);
     #endif
 
-    event*  play =  midiport->play[EVENT_GET_CHANNEL(ev)];
+    int channel = EVENT_GET_CHANNEL(ev);
+    event*  play =  midiport->play[channel];
+
+    /* in scale and not already playing */
+    uint64_t avail[2] =
+    {
+        scale_mask[0] & ~midiport->active[channel][0],
+        scale_mask[1] & ~midiport->active[channel][1]
+    };
 
     int pitch = ev->box.x;
 
     if (grb_flags & GRBOUND_PITCH_STRICT_POS)
     {
-        if (!scale_note_is_valid(scale_bin, scale_key, pitch))
-            return -1;
-
-        if (play[pitch].flags)
+        if (pitch < 0 || pitch > 127
+         || !(avail[pitch >> 6] & ((uint64_t)1 << (pitch & 63))))
             return -1;
     }
     else
     {
-        int startpitch, endpitch;
-        int pitchdir = 1;
+        /*  left to right tries pitches x to x + w - 1 lowest first,
+            right to left tries x + w down to x + 1.
+        */
+        int lo = pitch, hi = pitch + ev->box.w - 1;
+        uint64_t bits;
 
-        startpitch = endpitch = pitch;
+        if (!(grb_flags & FSPLACE_LEFT_TO_RIGHT))
+            ++lo, ++hi;
 
         if (grb_flags & FSPLACE_LEFT_TO_RIGHT)
-            endpitch += ev->box.w;
-        else
         {
-            pitch = startpitch += ev->box.w;
-            pitchdir = -1;
+            if ((bits = avail[0] & moport_mask_range(0, lo, hi)))
+                pitch = __builtin_ctzll(bits);
+            else if ((bits = avail[1] & moport_mask_range(1, lo, hi)))
+                pitch = 64 + __builtin_ctzll(bits);
+            else
+                return -1;
         }
-
-        while(pitch != endpitch)
+        else
         {
-            if (scale_note_is_valid(scale_bin, scale_key, pitch)
-             && !play[pitch].flags)
-            {
-                goto output;
-            }
-
-            pitch += pitchdir;
+            if ((bits = avail[1] & moport_mask_range(1, lo, hi)))
+                pitch = 127 - __builtin_clzll(bits);
+            else if ((bits = avail[0] & moport_mask_range(0, lo, hi)))
+                pitch = 63 - __builtin_clzll(bits);
+            else
+                return -1;
         }
-
-        return -1;
     }
 
-output:
-
     event_copy(&play[pitch], ev);
     play[pitch].note_pitch = pitch;
     EVENT_SET_STATUS_ON( &play[pitch] );
 
+    moport_rt_active_add(midiport, channel, pitch, ev->note_dur);
+
     return pitch;
 }
 
 
-void moport_rt_pull_ending(moport* midiport, bbt_t ph, bbt_t nph,
-                                             evport* grid_intersort)
+/*  the ending of an event goes back to the grid it was placed within,
+    which its boundary may since have been moved away from.
+*/
+static inline evport* moport_rt_intersort(const event* play,
+                                            evport** grid_intersorts,
+                                            int grid_count)
 {
-    int channel, pitch;
-    event* play;
+    int g = play->grid;
 
-    for (channel = 0; channel < 16; ++channel)
+    return grid_intersorts[(g < 0 || g >= grid_count) ? 0 : g];
+}
+
+
+void moport_rt_pull_ending(moport* midiport, bbt_t ph, bbt_t nph,
+                                             evport** grid_intersorts,
+                                             uint32_t* grid_joins,
+                                             int grid_count)
+{
+    while (midiport->heap_count && midiport->heap[0].note_dur < nph)
     {
-        play = midiport->play[channel];
+        int channel = midiport->heap[0].note >> 7;
+        int pitch = midiport->heap[0].note & 127;
+        event* play = &midiport->play[channel][pitch];
 
-        for (pitch = 0; pitch < 128; ++pitch)
+        moport_rt_active_pop(midiport);
+        midiport->active[channel][pitch >> 6] &=
+                                        ~((uint64_t)1 << (pitch & 63));
+
+        if (play->note_dur >= ph)
         {
-            if (!play[pitch].flags)
-                continue;
+            play->pos = play->note_dur;
+            EVENT_SET_STATUS_OFF( play );
 
-            if (play[pitch].note_dur < nph)
+            if (!evport_write_event(moport_rt_intersort(play,
+                                                        grid_intersorts,
+                                                        grid_count), play))
             {
-                if (play[pitch].note_dur >= ph)
-                {
-                    play[pitch].pos = play[pitch].note_dur;
-                    EVENT_SET_STATUS_OFF( &play[pitch] );
+                WARNING("failed to write to grid intersort\n");
+            }
+            else if (play->grb)
+            {
+                int g = play->grid;
+                int h = grbound_rt_grid(play->grb);
 
-                    if (!evport_write_event(grid_intersort, &play[pitch]))
-                    {
-                        WARNING("failed to write to grid intersort\n");
-                    }
-                }
+                if (g < 0 || g >= grid_count)
+                    g = 0;
 
-                play[pitch].flags = 0;
+                if (h < 0 || h >= grid_count)
+                    h = 0;
+
+                if (g != h)
+                    grid_joins[g] |= (uint32_t)1 << h;
             }
         }
+
+        play->flags = 0;
     }
 }
 
 
 void moport_rt_init_jack_cycle(moport* midiport, jack_nframes_t nframes)
 {
+    midiport->capture_count = 0;
+
+    if (!midiport->jack_out_port)
+        return;
+
     midiport->jport_buf = jack_port_get_buffer( midiport->jack_out_port,
                                                 nframes);
     jack_midi_clear_buffer(midiport->jport_buf);
 }
 
 
+static unsigned char* moport_rt_midi_event_reserve(moport* midiport,
+                                                    jack_nframes_t pos)
+{
+    momidi* mm;
+
+    if (midiport->jack_out_port)
+        return jack_midi_event_reserve(midiport->jport_buf, pos, 3);
+
+    if (midiport->capture_count == MOPORT_CAPTURE_SIZE)
+        return 0;
+
+    /* as jack_midi_event_reserve, nothing earlier than the last event */
+    if (midiport->capture_count
+     && pos < midiport->capture[midiport->capture_count - 1].frame)
+        return 0;
+
+    mm = &midiport->capture[midiport->capture_count++];
+    mm->frame = pos;
+
+    return mm->data;
+}
+
+
 void moport_rt_output_jack_midi_event(  moport* midiport,
                                         event* ev,
                                         bbt_t ph,
@@ -186,12 +341,11 @@ void moport_rt_output_jack_midi_event(  moport* midiport,
                                         double frames_per_tick )
 {
     unsigned char* buf;
-    void* jport_buf = midiport->jport_buf;
     jack_nframes_t pos = (ev->pos - ph) * frames_per_tick;
 
     if (EVENT_IS_STATUS_ON( ev ))
     {
-        buf = jack_midi_event_reserve(jport_buf, pos, 3);
+        buf = moport_rt_midi_event_reserve(midiport, pos);
 
         if (buf)
         {
@@ -205,7 +359,7 @@ void moport_rt_output_jack_midi_event(  moport* midiport,
     }
     else if(EVENT_IS_STATUS_OFF( ev ))
     {
-        buf = jack_midi_event_reserve(jport_buf, pos, 3);
+        buf = moport_rt_midi_event_reserve(midiport, pos);
 
         if (buf)
         {
@@ -222,25 +376,36 @@ void moport_rt_output_jack_midi_event(  moport* midiport,
 
 void moport_rt_pull_playing_and_empty(  moport* midiport,
                                         bbt_t ph, bbt_t nph,
-                                        evport* grid_intersort)
+                                        evport** grid_intersorts,
+                                        int grid_count)
 {
-    int channel, pitch;
+    int channel, n;
 
     for (channel = 0; channel < 16; ++channel)
     {
         event* play = midiport->play[channel];
 
-        for (pitch = 0; pitch < 128; ++pitch)
+        for (n = 0; n < 2; ++n)
         {
-            if (play[pitch].flags)
+            uint64_t bits = midiport->active[channel][n];
+
+            midiport->active[channel][n] = 0;
+
+            while (bits)
             {
+                int pitch = n * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+
                 play[pitch].pos = 0;
                 play[pitch].note_dur = 1;
                 play[pitch].box_release = 2;/*ph;*/
 
                 EVENT_SET_STATUS_OFF( &play[pitch] );
 
-                if (!evport_write_event(grid_intersort, &play[pitch]))
+                if (!evport_write_event(moport_rt_intersort(&play[pitch],
+                                                        grid_intersorts,
+                                                        grid_count),
+                                                        &play[pitch]))
                 {
                     WARNING("failed to write play-event "
                             "to grid intersort\n");
@@ -250,6 +415,15 @@ void moport_rt_pull_playing_and_empty(  moport* midiport,
             }
         }
     }
+
+    midiport->heap_count = 0;
+}
+
+
+const momidi* moport_captured_midi(moport* midiport, int* count)
+{
+    *count = midiport->capture_count;
+    return midiport->capture;
 }
 
 
@@ -13,6 +13,27 @@ extern "C" {
 
 #include <jack/jack.h>
 
+#include <stdint.h>
+
+
+#define MOPORT_CAPTURE_SIZE 1024
+
+
+/*  captured midi data
+ *----------------------
+ *  a moport created without a JACK client (ie for offline rendering)
+ *  has no JACK port to write to, the MIDI data it would have written
+ *  is captured instead. the capture holds a single cycle's worth of
+ *  data (frame is relative to the start of the cycle) and is emptied
+ *  by moport_rt_init_jack_cycle.
+ */
+typedef struct midi_out_port_captured_midi
+{
+    jack_nframes_t  frame;
+    unsigned char   data[3];
+
+} momidi;
+
 
 moport*     moport_new(jack_client_t* client,   int port_id,
                                                 evport_manager* portman);
@@ -57,18 +78,29 @@ void        moport_free(moport*);
  *  placed when this is called. this determines if the x placement is valid
  *  within the key/scale (width may or may not be taken into account) and if
  *  the resultant pitch is already active on that midi port/channel.
+ *  scale_mask is the key/scale expanded by scale_note_mask.
  *  returns pitch on success, -1 on failure.
  */
 
 int         moport_rt_push_event_pitch( moport*, const event* ev,
                                         int grb_flags,
-                                        int scale_bin,
-                                        int scale_key  );
+                                        const uint64_t scale_mask[2]);
 
 void        moport_rt_init_jack_cycle(  moport*,  jack_nframes_t nframes);
 
+/*  the ending and playing events are written to the intersort of the
+    grid they were placed within (see event.grid).
+
+    a grid outputs the events ending within it to the midi out port of
+    their boundary, which may since have moved to another grid. for each
+    event ending in grid g whose boundary is now in grid h,
+    moport_rt_pull_ending sets bit h of grid_joins[g], so the two grids
+    can be processed together (see grbound_manager_rt_group_grids).
+*/
 void        moport_rt_pull_ending(      moport*, bbt_t ph, bbt_t nph,
-                                                evport* grid_intersort);
+                                                evport** grid_intersorts,
+                                                uint32_t* grid_joins,
+                                                int grid_count);
 
 void        moport_rt_output_jack_midi_event(moport*, event*,
                                                 bbt_t ph,
@@ -77,7 +109,10 @@ void        moport_rt_output_jack_midi_event(moport*, event*,
 
 void        moport_rt_pull_playing_and_empty(   moport*,
                                                 bbt_t ph, bbt_t nph,
-                                                evport* grid_intersort);
+                                                evport** grid_intersorts,
+                                                int grid_count);
+
+const momidi*   moport_captured_midi(moport*, int* count);
 
 void        moport_event_dump(moport*);
 
@@ -139,6 +139,30 @@ moport* moport_manager_moport_next(moport_manager* mopman)
 }
 
 
+moport* moport_manager_moport_nth(moport_manager* mopman, int index)
+{
+    lnode* ln = llist_head(mopman->moplist);
+
+    while (ln && index--)
+        ln = lnode_next(ln);
+
+    return ln ? lnode_data(ln) : 0;
+}
+
+
+int moport_manager_moport_index(moport_manager* mopman, moport* mop)
+{
+    lnode* ln = llist_head(mopman->moplist);
+    int index = 0;
+
+    for (; ln; ln = lnode_next(ln), ++index)
+        if (lnode_data(ln) == mop)
+            return index;
+
+    return -1;
+}
+
+
 static void* moport_manager_rtdata_get_cb(const void* data)
 {
     const moport_manager* mopman = data;
@@ -158,6 +182,12 @@ void moport_manager_update_rt_data(const moport_manager* mopman)
 }
 
 
+rtdata* moport_manager_rtdata(moport_manager* mopman)
+{
+    return mopman->rt;
+}
+
+
 void moport_manager_rt_init_jack_cycle( moport_manager* mopman,
                                         jack_nframes_t nframes )
 {
@@ -173,7 +203,9 @@ void moport_manager_rt_init_jack_cycle( moport_manager* mopman,
 
 void moport_manager_rt_pull_ending(moport_manager* mopman,
                                     bbt_t ph, bbt_t nph,
-                                    evport* grid_intersort)
+                                    evport** grid_intersorts,
+                                    uint32_t* grid_joins,
+                                    int grid_count)
 {
     moport** mops = rtdata_data(mopman->rt);
 
@@ -181,13 +213,15 @@ void moport_manager_rt_pull_ending(moport_manager* mopman,
         return;
 
     while(*mops)
-        moport_rt_pull_ending(*mops++, ph, nph, grid_intersort);
+        moport_rt_pull_ending(*mops++, ph, nph, grid_intersorts,
+                                                grid_joins, grid_count);
 }
 
 
 void moport_manager_rt_pull_playing_and_empty(moport_manager* mopman,
                                                     bbt_t ph, bbt_t nph,
-                                                    evport* grid_intersort)
+                                                    evport** grid_intersorts,
+                                                    int grid_count)
 {
     moport** mops = rtdata_data(mopman->rt);
 
@@ -195,7 +229,8 @@ void moport_manager_rt_pull_playing_and_empty(moport_manager* mopman,
         return;
 
     while(*mops)
-        moport_rt_pull_playing_and_empty(*mops++, ph, nph, grid_intersort);
+        moport_rt_pull_playing_and_empty(*mops++, ph, nph,
+                                        grid_intersorts, grid_count);
 }
 
 
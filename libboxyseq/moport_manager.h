@@ -8,6 +8,7 @@ extern "C" {
 
 
 #include "midi_out_port.h"
+#include "real_time_data.h"
 
 
 #include <jack/jack.h>
@@ -26,8 +27,16 @@ moport*         moport_manager_moport_new(moport_manager*);
 moport*         moport_manager_moport_first(moport_manager*);
 moport*         moport_manager_moport_next(moport_manager*);
 
+/*  moport_manager_moport_nth:      the port at index, or NULL.
+    moport_manager_moport_index:    the index of mop, or -1.
+    neither disturbs first/next.
+*/
+moport*         moport_manager_moport_nth(moport_manager*, int index);
+int             moport_manager_moport_index(moport_manager*, moport*);
+
 
 void    moport_manager_update_rt_data(const moport_manager*);
+rtdata* moport_manager_rtdata(moport_manager*);
 
 
 /*  moport_manager_rt_init_jack_cycle is called at the beginning of every
@@ -39,11 +48,14 @@ void    moport_manager_rt_init_jack_cycle(  moport_manager*,
 void    moport_manager_rt_pull_ending(  moport_manager*,
                                         bbt_t ph,
                                         bbt_t nph,
-                                        evport* grid_intersort);
+                                        evport** grid_intersorts,
+                                        uint32_t* grid_joins,
+                                        int grid_count);
 
 void    moport_manager_rt_pull_playing_and_empty(   moport_manager*,
                                                     bbt_t ph, bbt_t nph,
-                                                    evport* grid_intersort);
+                                                    evport** grid_intersorts,
+                                                    int grid_count);
 
 
 void    moport_manager_dump_events(moport_manager*);
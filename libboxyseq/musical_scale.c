@@ -52,6 +52,18 @@ int note_to_octave(int n)
 }
 
 
+void scale_note_mask(int scale_binary, int key, uint64_t mask[2])
+{
+    int n;
+
+    mask[0] = mask[1] = 0;
+
+    for (n = 0; n < 128; ++n)
+        if (scale_note_is_valid(scale_binary, key, n))
+            mask[n >> 6] |= (uint64_t)1 << (n & 63);
+}
+
+
 struct musical_scale
 {
     char* name;
@@ -7,10 +7,20 @@ extern "C" {
 #endif
 
 
+#include <stdint.h>
+
+
 #define scale_note_is_valid( scale_binary, key, note ) \
     ( (scale_binary) & (1 << (12 - (( (note) + (key) ) % 12))))
 
 
+/*  scale_note_mask: expands a scale binary and key into a mask of all
+    128 MIDI notes (bit n of mask[n / 64]) for which
+    scale_note_is_valid would be true.
+*/
+void            scale_note_mask(int scale_binary, int key, uint64_t mask[2]);
+
+
 int             note_number(const char*);
 const char*     note_name(int);
 int             note_to_octave(int);
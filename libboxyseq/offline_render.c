@@ -0,0 +1,592 @@
+#include "offline_render.h"
+
+
+#include "boxy_sequencer.h"
+#include "common.h"
+#include "debug.h"
+#include "midi_out_port.h"
+#include "moport_manager.h"
+#include "real_time_data.h"
+
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+typedef struct offline_render_midi
+{
+    uint64_t        frame;      /* from start of render */
+    unsigned char   data[3];
+
+} ormidi;
+
+
+typedef struct offline_render_track
+{
+    moport*     mo;
+
+    ormidi*     midi;
+    size_t      count;
+    size_t      alloc;
+
+} ortrack;
+
+
+/*  a tempo in effect from frame on, and the tick it starts at, so the
+    tick of any later frame follows.
+*/
+typedef struct offline_render_tempo
+{
+    uint64_t    frame;
+    double      bpm;
+    double      frames_per_quarter;
+    double      tick;
+
+} ortempo;
+
+
+struct offline_render
+{
+    boxyseq*        bs;
+    jackdata*       jd;
+
+    jack_nframes_t  frame_rate;
+    jack_nframes_t  nframes;
+
+    uint64_t        frame;      /* total frames processed */
+
+    ortrack*        tracks;
+    int             track_count;
+
+    ortempo*        tempos;
+    size_t          tempo_count;
+    size_t          tempo_alloc;
+};
+
+
+static bool offrender_tempo(offrender*);
+
+
+offrender* offrender_new(boxyseq* bs,   jack_nframes_t frame_rate,
+                                        jack_nframes_t nframes)
+{
+    offrender* rdr = malloc(sizeof(*rdr));
+
+    if (!rdr)
+        goto fail0;
+
+    if (!(rdr->jd = jackdata_new()))
+        goto fail1;
+
+    if (!jackdata_startup_offline(rdr->jd, bs, frame_rate))
+        goto fail2;
+
+    rdr->bs = bs;
+    rdr->frame_rate = frame_rate;
+    rdr->nframes = nframes;
+    rdr->frame = 0;
+    rdr->tracks = 0;
+    rdr->track_count = 0;
+    rdr->tempos = 0;
+    rdr->tempo_count = 0;
+    rdr->tempo_alloc = 0;
+
+    if (!offrender_tempo(rdr))
+        goto fail3;
+
+    return rdr;
+
+fail3:  jackdata_shutdown(rdr->jd);
+fail2:  jackdata_free(rdr->jd);
+fail1:  free(rdr);
+fail0:  WARNING("failed to create offline renderer\n");
+    return 0;
+}
+
+
+void offrender_free(offrender* rdr)
+{
+    int i;
+
+    if (!rdr)
+        return;
+
+    for (i = 0; i < rdr->track_count; ++i)
+        free(rdr->tracks[i].midi);
+
+    free(rdr->tracks);
+    free(rdr->tempos);
+    jackdata_free(rdr->jd);
+    free(rdr);
+}
+
+
+jackdata* offrender_jackdata(offrender* rdr)
+{
+    return rdr->jd;
+}
+
+
+static ortrack* offrender_track(offrender* rdr, moport* mo)
+{
+    int i;
+    ortrack* tracks;
+
+    for (i = 0; i < rdr->track_count; ++i)
+        if (rdr->tracks[i].mo == mo)
+            return &rdr->tracks[i];
+
+    tracks = realloc(rdr->tracks,
+                        sizeof(*tracks) * (rdr->track_count + 1));
+
+    if (!tracks)
+        return 0;
+
+    rdr->tracks = tracks;
+    tracks = &rdr->tracks[rdr->track_count++];
+    tracks->mo = mo;
+    tracks->midi = 0;
+    tracks->count = 0;
+    tracks->alloc = 0;
+
+    return tracks;
+}
+
+
+static bool offrender_collect(offrender* rdr)
+{
+    moport_manager* mopman = boxyseq_moport_manager(rdr->bs);
+    moport* mo = moport_manager_moport_first(mopman);
+
+    while (mo)
+    {
+        int i, count;
+        const momidi* mm = moport_captured_midi(mo, &count);
+        ortrack* trk;
+
+        if (!count)
+        {
+            mo = moport_manager_moport_next(mopman);
+            continue;
+        }
+
+        if (!(trk = offrender_track(rdr, mo)))
+            return 0;
+
+        if (trk->count + count > trk->alloc)
+        {
+            size_t alloc = trk->alloc ? trk->alloc * 2 : 1024;
+            ormidi* midi;
+
+            while (alloc < trk->count + count)
+                alloc *= 2;
+
+            if (!(midi = realloc(trk->midi, sizeof(*midi) * alloc)))
+                return 0;
+
+            trk->midi = midi;
+            trk->alloc = alloc;
+        }
+
+        for (i = 0; i < count; ++i)
+        {
+            ormidi* om = &trk->midi[trk->count++];
+            om->frame = rdr->frame + mm[i].frame;
+            memcpy(om->data, mm[i].data, 3);
+        }
+
+        mo = moport_manager_moport_next(mopman);
+    }
+
+    return 1;
+}
+
+
+/*  notes the tempo (and frame rate) of the cycle starting at the frame
+    reached, should it differ from the last noted.
+*/
+static bool offrender_tempo(offrender* rdr)
+{
+    double bpm = jackdata_master_beats_per_minute(rdr->jd);
+    double frames_per_quarter = (rdr->frame_rate * 60.0) / bpm;
+    ortempo* tp = rdr->tempo_count ? &rdr->tempos[rdr->tempo_count - 1]
+                                   : 0;
+
+    if (tp && tp->bpm == bpm && tp->frames_per_quarter == frames_per_quarter)
+        return 1;
+
+    /* a tempo no frame was played at is replaced */
+    if (!tp || tp->frame != rdr->frame)
+    {
+        if (rdr->tempo_count == rdr->tempo_alloc)
+        {
+            size_t alloc = rdr->tempo_alloc ? rdr->tempo_alloc * 2 : 16;
+
+            if (!(tp = realloc(rdr->tempos, sizeof(*tp) * alloc)))
+                return 0;
+
+            rdr->tempos = tp;
+            rdr->tempo_alloc = alloc;
+        }
+
+        tp = &rdr->tempos[rdr->tempo_count++];
+        tp->frame = rdr->frame;
+        tp->tick = 0;
+
+        if (rdr->tempo_count > 1)
+        {
+            const ortempo* prev = tp - 1;
+            tp->tick = prev->tick + (tp->frame - prev->frame)
+                            * internal_ppqn / prev->frames_per_quarter;
+        }
+    }
+
+    tp->bpm = bpm;
+    tp->frames_per_quarter = frames_per_quarter;
+
+    return 1;
+}
+
+
+/*  what follows each process cycle: the UI side work there is no UI
+    thread to do, and collecting the midi.
+*/
+static bool offrender_cycle_end(offrender* rdr, jack_nframes_t nframes)
+{
+    int g;
+
+    cytiming_ui_update(boxyseq_cycle_timing(rdr->bs));
+    debug_log_drain(0);
+    jrnl_ui_drain(boxyseq_journal(rdr->bs));
+    rtdata_ui_reclaim();
+
+    for (g = 0; g < boxyseq_grid_count(rdr->bs); ++g)
+        grid_ui_stats_update(boxyseq_grid(rdr->bs, g));
+
+    if (!offrender_collect(rdr))
+    {
+        WARNING("out of memory collecting offline midi output\n");
+        return 0;
+    }
+
+    if (!offrender_tempo(rdr))
+    {
+        WARNING("out of memory noting the offline tempo\n");
+        return 0;
+    }
+
+    rdr->frame += nframes;
+
+    return 1;
+}
+
+
+static bool offrender_cycle(offrender* rdr)
+{
+    jackdata_offline_process(rdr->jd, rdr->nframes);
+
+    return offrender_cycle_end(rdr, rdr->nframes);
+}
+
+
+bool offrender_cycles(offrender* rdr, int count)
+{
+    while (count-- > 0)
+        if (!offrender_cycle(rdr))
+            return 0;
+
+    return 1;
+}
+
+
+bool offrender_run(offrender* rdr, bbt_t ticks)
+{
+    double frames_per_tick = (rdr->frame_rate * 60.0)
+                / jackdata_master_beats_per_minute(rdr->jd)
+                / internal_ppqn;
+
+    uint64_t frames = (uint64_t)ceil(ticks * frames_per_tick);
+
+    jackdata_transport_play(rdr->jd);
+
+    return offrender_cycles(rdr,
+                        (int)((frames + rdr->nframes - 1) / rdr->nframes));
+}
+
+
+bool offrender_stop(offrender* rdr)
+{
+    jackdata_transport_stop(rdr->jd);
+    return offrender_cycle(rdr);
+}
+
+
+bool offrender_replay(offrender* rdr, jrnl* jr)
+{
+    size_t count = jrnl_record_count(jr);
+    size_t* changes = malloc(sizeof(*changes) * (count + 1));
+    size_t change_count = 0;
+    size_t next_change = 0;
+    size_t i, j;
+    bool ret = 1;
+
+    if (!changes)
+    {
+        WARNING("out of memory replaying journal\n");
+        return 0;
+    }
+
+    /*  the changes, in the order of the cycles the RT thread first used
+        them in (and otherwise as recorded).
+    */
+    for (i = 0; i < count; ++i)
+    {
+        const jrnlrec* rec = jrnl_record(jr, i);
+
+        if (rec->type == JRNL_TIMEBASE || rec->type == JRNL_CYCLE
+                                       || rec->type == JRNL_INPUT)
+            continue;
+
+        for (j = change_count++; j > 0; --j)
+        {
+            if ((int)(jrnl_record(jr, changes[j - 1])->cycle
+                                                    - rec->cycle) <= 0)
+                break;
+
+            changes[j] = changes[j - 1];
+        }
+
+        changes[j] = i;
+    }
+
+    if (!boxyseq_ui_replay_ports(rdr->bs, jr))
+    {
+        WARNING("failed to make the journaled ports\n");
+        ret = 0;
+    }
+
+    for (i = 0; i < count && ret; ++i)
+    {
+        const jrnlrec* rec = jrnl_record(jr, i);
+
+        switch (rec->type)
+        {
+        case JRNL_TIMEBASE:
+            jackdata_replay(rdr->jd, rec);
+            break;
+
+        case JRNL_CYCLE:
+            rtdata_ui_scene_begin();
+
+            while (next_change < change_count
+                && (int)(jrnl_record(jr, changes[next_change])->cycle
+                                                    - rec->cycle) <= 0)
+            {
+                boxyseq_ui_replay(rdr->bs,
+                                jrnl_record(jr, changes[next_change++]));
+            }
+
+            rtdata_ui_scene_commit();
+
+            /* the UI input the RT thread read during the cycle */
+            for (j = i + 1; j < count; ++j)
+            {
+                const jrnlrec* in = jrnl_record(jr, j);
+
+                if (in->type == JRNL_CYCLE)
+                    break;
+
+                if (in->type == JRNL_INPUT)
+                    boxyseq_ui_input_event(rdr->bs, &in->ev);
+            }
+
+            if (rec->pos.frame_rate)
+                rdr->frame_rate = rec->pos.frame_rate;
+
+            jackdata_replay(rdr->jd, rec);
+            ret = offrender_cycle_end(rdr, rec->nframes);
+            break;
+
+        default: /* fed in along with the cycles */
+            break;
+        }
+    }
+
+    free(changes);
+
+    return ret;
+}
+
+
+size_t offrender_event_count(offrender* rdr)
+{
+    size_t count = 0;
+    int i;
+
+    for (i = 0; i < rdr->track_count; ++i)
+        count += rdr->tracks[i].count;
+
+    return count;
+}
+
+
+static void smf_write_be(FILE* f, uint32_t n, int bytes)
+{
+    while (bytes--)
+        fputc((n >> (bytes * 8)) & 0xff, f);
+}
+
+
+static void smf_write_vlq(FILE* f, uint32_t n)
+{
+    unsigned char buf[5];
+    int i = 0;
+
+    buf[i++] = n & 0x7f;
+
+    while ((n >>= 7))
+        buf[i++] = 0x80 | (n & 0x7f);
+
+    while (i--)
+        fputc(buf[i], f);
+}
+
+
+/*  track chunk length isn't known until the chunk is written, so a
+    place holder is written and the length is filled in afterward.
+*/
+static long smf_track_begin(FILE* f)
+{
+    long lenpos;
+
+    fwrite("MTrk", 1, 4, f);
+    lenpos = ftell(f);
+    smf_write_be(f, 0, 4);
+
+    return lenpos;
+}
+
+
+static void smf_track_end(FILE* f, long lenpos)
+{
+    long endpos;
+
+    smf_write_vlq(f, 0);
+    fputc(0xff, f);
+    fputc(0x2f, f);
+    fputc(0x00, f);
+
+    endpos = ftell(f);
+    fseek(f, lenpos, SEEK_SET);
+    smf_write_be(f, (uint32_t)(endpos - lenpos - 4), 4);
+    fseek(f, endpos, SEEK_SET);
+}
+
+
+/*  the tick frame is at, by the tempos noted. *tempo is the index of a
+    tempo starting no later than frame, to search on from.
+*/
+static uint32_t offrender_tick(const offrender* rdr, uint64_t frame,
+                                                     size_t* tempo)
+{
+    const ortempo* tp;
+
+    while (*tempo + 1 < rdr->tempo_count
+        && rdr->tempos[*tempo + 1].frame <= frame)
+    {
+        ++*tempo;
+    }
+
+    tp = &rdr->tempos[*tempo];
+
+    return (uint32_t)llround(tp->tick + (frame - tp->frame)
+                                * internal_ppqn / tp->frames_per_quarter);
+}
+
+
+bool offrender_write_smf(offrender* rdr, const char* filename)
+{
+    FILE* f;
+    long lenpos;
+    uint32_t last = 0;
+    double bpm = 0;
+    size_t n;
+    int i;
+
+    if (!(f = fopen(filename, "wb")))
+    {
+        WARNING("failed to open '%s' for writing\n", filename);
+        return 0;
+    }
+
+    /* format 1: a tempo track followed by one track per moport */
+    fwrite("MThd", 1, 4, f);
+    smf_write_be(f, 6, 4);
+    smf_write_be(f, 1, 2);
+    smf_write_be(f, rdr->track_count + 1, 2);
+    smf_write_be(f, internal_ppqn, 2);
+
+    /* a tempo for each change, those of the frame rate alone aside */
+    lenpos = smf_track_begin(f);
+
+    for (n = 0; n < rdr->tempo_count; ++n)
+    {
+        const ortempo* tp = &rdr->tempos[n];
+        uint32_t t = (uint32_t)llround(tp->tick);
+
+        if (tp->bpm == bpm)
+            continue;
+
+        smf_write_vlq(f, t - last);
+        fputc(0xff, f);
+        fputc(0x51, f);
+        fputc(0x03, f);
+        smf_write_be(f, (uint32_t)(60000000.0 / tp->bpm), 3);
+        last = t;
+        bpm = tp->bpm;
+    }
+
+    smf_track_end(f, lenpos);
+
+    for (i = 0; i < rdr->track_count; ++i)
+    {
+        ortrack* trk = &rdr->tracks[i];
+        size_t tempo = 0;
+        size_t late = 0;
+
+        last = 0;
+        lenpos = smf_track_begin(f);
+
+        for (n = 0; n < trk->count; ++n)
+        {
+            uint32_t t = offrender_tick(rdr, trk->midi[n].frame, &tempo);
+
+            if (t < last)
+            {
+                ++late;
+                t = last;
+            }
+
+            smf_write_vlq(f, t - last);
+            fwrite(trk->midi[n].data, 1, 3, f);
+            last = t;
+        }
+
+        smf_track_end(f, lenpos);
+
+        if (late)
+            WARNING("track %d: %lu midi events out of order, moved later\n",
+                                                i + 1, (unsigned long)late);
+    }
+
+    if (fclose(f) != 0)
+    {
+        WARNING("error writing '%s'\n", filename);
+        return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,86 @@
+#ifndef OFFLINE_RENDER_H
+#define OFFLINE_RENDER_H
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include "boxyseq_types.h"
+#include "jack_process.h"
+#include "journal.h"
+
+
+#include <jack/jack.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/*  offline rendering
+ *---------------------
+ *  drives the sequencer without a JACK server, as fast as the machine
+ *  will go. the offrender owns a jackdata started with
+ *  jackdata_startup_offline and runs the exact same RT code path as
+ *  JACK would (boxyseq_rt_init_jack_cycle, boxyseq_rt_play, and
+ *  boxyseq_rt_clear on stop/relocate), all within the calling thread.
+ *
+ *  the MIDI the moports would have written to JACK is collected after
+ *  each cycle into memory (one track per moport) with frame positions
+ *  relative to the start of the render. it can then be written out as
+ *  a standard MIDI file.
+ *
+ *  the offrender must be created before any moports are created.
+ */
+
+
+typedef struct offline_render offrender;
+
+
+offrender*  offrender_new(boxyseq*, jack_nframes_t frame_rate,
+                                    jack_nframes_t nframes);
+void        offrender_free(offrender*);
+
+jackdata*   offrender_jackdata(offrender*);
+
+/*  offrender_run:      starts the transport rolling (from wherever it
+                        was left) and runs enough process cycles to
+                        cover 'ticks' ticks.
+*/
+bool        offrender_run(offrender*, bbt_t ticks);
+
+/*  offrender_stop:     stops the transport and runs a single cycle so
+                        that the sequencer clears out any playing notes.
+*/
+bool        offrender_stop(offrender*);
+
+/*  offrender_cycles:   runs 'count' process cycles without touching the
+                        transport.
+*/
+bool        offrender_cycles(offrender*, int count);
+
+/*  offrender_replay:   runs the process cycles recorded in a journal,
+                        with the transport, UI input and everything
+                        published recorded, in place of the simulated
+                        transport. the session is built from the journal
+                        as it goes, the boxyseq must hold nothing but the
+                        grids it had when the journal was recorded.
+*/
+bool        offrender_replay(offrender*, jrnl*);
+
+size_t      offrender_event_count(offrender*);
+
+/*  offrender_write_smf: writes the midi rendered as a standard midi
+                        file, with a tempo map of the tempos it was
+                        rendered at.
+*/
+bool        offrender_write_smf(offrender*, const char* filename);
+
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+
+
+#endif
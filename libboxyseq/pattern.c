@@ -16,6 +16,9 @@
 #include "include/event_pattern_data.h"
 
 
+static rt_pattern* rt_pattern_new(void);
+static void        rt_evchunk_unref(rt_evchunk*);
+
 static void*    pattern_rtdata_get_cb(const void* pat);
 static void     pattern_rtdata_free_cb(void* pat);
 
@@ -53,8 +56,13 @@ pattern* pattern_new(int id)
 /*
     pattern_set_random_seed_type(pat, SEED_TIME_SYS);
 */
+    pat->seed = time(NULL);
     pat->evout = 0;
 
+    pat->chunks = 0;
+    pat->chunk_count = 0;
+    pat->rnd = 0;
+
     return pat;
 
 fail3:  evlist_free(pat->events);
@@ -95,8 +103,8 @@ pattern* pattern_dup(const pattern* pat)
     dest->beat_type =       pat->beat_type;
     dest->beat_ratio =      pat->beat_ratio;
 
-/*    dest->seedtype =        pat->seedtype;
-    dest->seed =            pat->seed;*/
+/*    dest->seedtype =        pat->seedtype;*/
+    dest->seed =            pat->seed;
 
     dest->evout =           pat->evout;
 
@@ -111,10 +119,21 @@ fail0:
 
 void pattern_free(pattern* pat)
 {
+    int c;
+
     if (!pat)
         return;
 
     rtdata_free(pat->rt);
+
+    for (c = 0; c < pat->chunk_count; ++c)
+        rt_evchunk_unref(pat->chunks[c]);
+
+    free(pat->chunks);
+
+    if (pat->rnd)
+        g_rand_free(pat->rnd);
+
     evlist_free(pat->events);
     free(pat->name);
     free(pat);
@@ -207,6 +226,47 @@ void pattern_set_random_seed(pattern* pat, int seed)
 }
 */
 
+void pattern_set_random_seed(pattern* pat, uint32_t seed)
+{
+    pat->seed = seed;
+}
+
+
+void pattern_state_get(pattern* pat, patstate* st)
+{
+    st->loop_length =   pat->loop_length;
+    st->beats_per_bar = pat->beats_per_bar;
+    st->beat_type =     pat->beat_type;
+    st->width_min =     pat->width_min;
+    st->width_max =     pat->width_max;
+    st->height_min =    pat->height_min;
+    st->height_max =    pat->height_max;
+    st->seed =          pat->seed;
+}
+
+
+void pattern_state_set(pattern* pat, const patstate* st)
+{
+    pattern_set_meter(pat, st->beats_per_bar, st->beat_type);
+    pattern_set_loop_length(pat, st->loop_length);
+    pattern_set_event_width_range(pat, st->width_min, st->width_max);
+    pattern_set_event_height_range(pat, st->height_min, st->height_max);
+    pattern_set_random_seed(pat, st->seed);
+}
+
+
+rtdata* pattern_rtdata(pattern* pat)
+{
+    return pat->rt;
+}
+
+
+evport* pattern_output_port(pattern* pat)
+{
+    return pat->evout;
+}
+
+
 void pattern_dump(const pattern* pat)
 {
     MESSAGE("pattern: %p\n", (const void*)pat);
@@ -257,22 +317,75 @@ void pattern_trigger(prtdata* prt, bbt_t start_tick, bbt_t end_tick)
 */
 
 
-void pattern_rt_play(pattern* pat,  bool repositioned,
-                                    bbt_t ph,
+static void rt_pattern_play_event(rt_pattern* rtpat, const event* ev,
+                                                     const rt_evdims* dims,
+                                                     bbt_t evpos)
+{
+    event out = *ev;
+
+    out.box.w = dims->w;
+    out.box.h = dims->h;
+    out.pos = evpos;
+    out.note_dur += evpos;
+    out.box_release += out.note_dur;
+
+    if (!evport_write_event(rtpat->evout, &out))
+        WARNING("dropped event\n");
+}
+
+
+/*  plays the events positioned from 'from' up to 'to' within the pattern,
+    offset by 'offset'. the chunk holding 'from' is found directly, and
+    the first event within it by binary search.
+*/
+static void rt_pattern_play_range(rt_pattern* rtpat, bbt_t from,
+                                                     bbt_t to,
+                                                     bbt_t offset)
+{
+    int c;
+
+    if (from < 0)
+        from = 0;
+
+    for (c = from / rtpat->chunk_ticks;
+         c < rtpat->chunk_count && c * rtpat->chunk_ticks < to;
+         ++c)
+    {
+        rt_evchunk* ch = rtpat->chunks[c];
+        int lo = 0;
+        int hi;
+
+        if (!ch)
+            continue;
+
+        hi = ch->count;
+
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+
+            if (ch->events[mid].pos < from)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        for (; lo < ch->count && ch->events[lo].pos < to; ++lo)
+            rt_pattern_play_event(rtpat, &ch->events[lo], &ch->dims[lo],
+                                         ch->events[lo].pos + offset);
+    }
+}
+
+
+void pattern_rt_play(pattern* pat,  bbt_t ph,
                                     bbt_t nph)
 {
     rt_pattern* rtpat;
-    event*      events;
 
-    bbt_t       tick;
     bbt_t       offset;
     bbt_t       nextoffset;
-    bbt_t       evpos;
+    bbt_t       nextend;
     int         patix;
-    int         count;
-    event*      ev;
-    event*      evlast;
-    bool       play_event;
 
     rtpat = rtdata_data(pat->rt);
 
@@ -282,80 +395,24 @@ void pattern_rt_play(pattern* pat,  bool repositioned,
         return;
     }
 
-    events = rtpat->events;
-
-    tick = ph % rtpat->loop_length;
-
     patix = ph / rtpat->loop_length;
 
     offset = rtpat->start_tick + (rtpat->loop_length * patix);
     nextoffset = offset + rtpat->loop_length;
 
-    count = 1;
+    /*  events from the start of the next loop come earlier in the
+        pattern than those of this loop, and are played first. an event
+        is played once, in this loop, should the period span the loop.
+    */
+    nextend = ph + rtpat->loop_length;
 
-    rtpat->index = tick % rtpat->loop_length;
-    rtpat->playing = 1;
+    if (nextend > nph)
+        nextend = nph;
 
-    if (repositioned || !rtpat->evlast)
-        ev = rtpat->events;
-    else
-        ev = rtpat->evlast;
-
-    while (ev->pos > -1)
-    {
-        play_event = 0;
-        evpos = ev->pos + offset;
-
-        if (evpos >= ph && evpos < nph)
-            play_event = 1;
-        else
-        {
-            evpos = ev->pos + nextoffset;
-            if (evpos >= ph && evpos < nph)
-                play_event = 1;
-        }
-
-        if (play_event) /* store/restore to not modify pattern */
-        {
-            bbt_t opos = ev->pos;
-            bbt_t odur = ev->note_dur;
-            bbt_t orel = ev->box_release;
-
-            /* FIXME:   weren't we going to have events where the
-                        dimensions were specified rather than random?
-            */
-            if (!ev->box.w)
-                ev->box.w = g_rand_int_range(rtpat->rnd, rtpat->width_min,
-                                                         rtpat->width_max);
-            if (!ev->box.h)
-                ev->box.h = g_rand_int_range(rtpat->rnd, rtpat->height_min,
-                                                         rtpat->height_max);
-            ev->pos = evpos;
-            ev->note_dur += evpos;
-            ev->box_release += ev->note_dur;
-
-            if (!evport_write_event(rtpat->evout, ev))
-                WARNING("dropped event\n");
-
-            ev->pos = opos;
-            ev->note_dur = odur;
-            ev->box_release = orel;
-            evlast = ev;
-        }
-        ++ev;
-    }
-    rtpat->evlast = (ev->pos > -1) ? evlast : 0;
-}
+    rt_pattern_play_range(rtpat, ph - nextoffset, nextend - nextoffset,
+                                                  nextoffset);
 
-
-void pattern_rt_stop(pattern* pat)
-{
-    rt_pattern* rtpat = rtdata_data(pat->rt);
-
-    rtpat->playing =      0;
-    rtpat->start_tick =   0;
-    rtpat->end_tick =     0;
-    rtpat->index =        0;
+    rt_pattern_play_range(rtpat, ph - offset, nph - offset, offset);
 }
 
 
@@ -368,29 +425,21 @@ static rt_pattern* rt_pattern_new(void)
     if (!rtpat)
         goto fail0;
 
-    rtpat->rnd = g_rand_new_with_seed((guint32)time(NULL));
-
-    if (!rtpat->rnd)
-        goto fail1;
-
-    rtpat->playing = 0;
-    rtpat->triggered = 0;
-
 /*    rtpat->seedtype = SEED_TIME_SYS;*/
 
-    rtpat->start_tick = rtpat->end_tick = 0;
-    rtpat->index = rtpat->loop_length = 0;
+    rtpat->start_tick = 0;
+    rtpat->loop_length = 0;
 
     rtpat->width_min = rtpat->width_max = 0;
     rtpat->height_min = rtpat->height_max = 0;
 
-    rtpat->events = 0;
-    rtpat->evlast = 0;
+    rtpat->chunks = 0;
+    rtpat->chunk_count = 0;
+    rtpat->chunk_ticks = internal_ppqn;
     rtpat->evout = 0;
 
     return rtpat;
 
-fail1:  free(rtpat);
 fail0:  MESSAGE("out of memory for rt_pattern\n");
     return 0;
 }
@@ -398,18 +447,177 @@ fail0:  MESSAGE("out of memory for rt_pattern\n");
 
 static void rt_pattern_free(rt_pattern* rtpat)
 {
+    int c;
+
     if (!rtpat)
         return;
 
-    g_rand_free(rtpat->rnd);
-    free(rtpat->events);
+    for (c = 0; c < rtpat->chunk_count; ++c)
+        rt_evchunk_unref(rtpat->chunks[c]);
+
+    free(rtpat->chunks);
     free(rtpat);
 }
 
 
+/*  copies count events of the evlist, from ln on, into a new chunk,
+    drawing the dimensions of those which do not specify them.
+*/
+static rt_evchunk* rt_evchunk_new(const pattern* pat, const lnode* ln,
+                                                      int count)
+{
+    rt_evchunk* ch = malloc(sizeof(*ch) + (sizeof(event)
+                                         + sizeof(rt_evdims)) * count);
+    int i;
+
+    if (!ch)
+        return 0;
+
+    ch->refs = 0;
+    ch->count = count;
+    ch->dims = (rt_evdims*)(ch->events + count);
+
+    for (i = 0; i < count; ++i, ln = lnode_next(ln))
+    {
+        const event* ev = lnode_data(ln);
+
+        memcpy(&ch->events[i], ev, sizeof(event));
+
+        ch->dims[i].w = ev->box.w ? ev->box.w
+                                  : g_rand_int_range(pat->rnd,
+                                                     pat->width_min,
+                                                     pat->width_max);
+        ch->dims[i].h = ev->box.h ? ev->box.h
+                                  : g_rand_int_range(pat->rnd,
+                                                     pat->height_min,
+                                                     pat->height_max);
+    }
+
+    return ch;
+}
+
+
+/*  whether the count events of the evlist, from ln on, are those the
+    chunk was copied from.
+*/
+static bool rt_evchunk_same(const rt_evchunk* ch, const lnode* ln,
+                                                  int count)
+{
+    int i;
+
+    if (!ch)
+        return !count;
+
+    if (ch->count != count)
+        return false;
+
+    for (i = 0; i < count; ++i, ln = lnode_next(ln))
+        if (memcmp(&ch->events[i], lnode_data(ln), sizeof(event)))
+            return false;
+
+    return true;
+}
+
+
+static void rt_evchunk_unref(rt_evchunk* ch)
+{
+    if (ch && !--ch->refs)
+        free(ch);
+}
+
+
+/*  fills in the chunks of rtpat, sharing those of the previous
+    rt_pattern which are unchanged, and makes them the latest.
+*/
+static bool pattern_rt_chunks(pattern* pat, rt_pattern* rtpat)
+{
+    const lnode* ln = evlist_head(pat->events);
+    const lnode* tail = evlist_tail(pat->events);
+    rt_evchunk** chunks = 0;
+    int count = 0;
+    int c;
+
+    while (ln && ((const event*)lnode_data(ln))->pos < 0)
+        ln = lnode_next(ln);
+
+    if (ln)
+        count = ((const event*)lnode_data(tail))->pos
+                                        / rtpat->chunk_ticks + 1;
+
+    if (!pat->rnd || pat->rnd_seed != pat->seed)
+    {
+        GRand* rnd = g_rand_new_with_seed((guint32)pat->seed);
+
+        if (!rnd)
+            goto fail0;
+
+        if (pat->rnd)
+            g_rand_free(pat->rnd);
+
+        pat->rnd = rnd;
+        pat->rnd_seed = pat->seed;
+    }
+
+    if (count && !(chunks = calloc(count, sizeof(*chunks))))
+        goto fail0;
+
+    for (c = 0; c < count; ++c)
+    {
+        bbt_t end = (c + 1) * rtpat->chunk_ticks;
+        rt_evchunk* old = (c < pat->chunk_count) ? pat->chunks[c] : 0;
+        const lnode* first = ln;
+        int n = 0;
+
+        while (ln && ((const event*)lnode_data(ln))->pos < end)
+        {
+            ln = lnode_next(ln);
+            ++n;
+        }
+
+        if (rt_evchunk_same(old, first, n))
+            chunks[c] = old;
+        else if (n && !(chunks[c] = rt_evchunk_new(pat, first, n)))
+            goto fail1;
+    }
+
+    if (count && !(rtpat->chunks = calloc(count, sizeof(*chunks))))
+        goto fail1;
+
+    /* one reference from rtpat, one from pat */
+    for (c = 0; c < count; ++c)
+    {
+        rtpat->chunks[c] = chunks[c];
+
+        if (chunks[c])
+            chunks[c]->refs += 2;
+    }
+
+    for (c = 0; c < pat->chunk_count; ++c)
+        rt_evchunk_unref(pat->chunks[c]);
+
+    free(pat->chunks);
+    pat->chunks = chunks;
+    pat->chunk_count = count;
+
+    rtpat->chunk_count = count;
+
+    return true;
+
+fail1:
+    for (c = 0; c < count; ++c)
+        if (chunks[c] && !chunks[c]->refs)
+            free(chunks[c]);
+
+    free(chunks);
+fail0:
+    return false;
+}
+
+
 static void* pattern_rtdata_get_cb(const void* data)
 {
-    const pattern* pat = data;
+    /* the latest chunks are the UI's own to update */
+    pattern* pat = (pattern*)data;
     rt_pattern* rtpat = rt_pattern_new();
 
     MESSAGE("getting rt_pattern from callback\n");
@@ -417,9 +625,7 @@ static void* pattern_rtdata_get_cb(const void* data)
     if (!rtpat)
         goto fail0;
 
-    rtpat->events = evlist_to_array(pat->events);
-
-    if (!rtpat->events)
+    if (!pattern_rt_chunks(pat, rtpat))
         goto fail1;
 
     rtpat->loop_length =    pat->loop_length;
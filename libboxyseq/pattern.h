@@ -8,12 +8,14 @@ extern "C" {
 
 
 #include <stdbool.h>
+#include <stdint.h>
 
 
 #include "common.h"
 #include "event.h"
 #include "event_list.h"
 #include "event_port.h"
+#include "real_time_data.h"
 
 
 typedef struct event_pattern pattern;
@@ -46,20 +48,62 @@ void        pattern_set_event_height_range( pattern*,
 
 /*
 void        pattern_set_random_seed_type(   pattern*, seed_type seedtype);
-void        pattern_set_random_seed(        pattern*, uint32_t seed);
 */
 
+/*  pattern_set_random_seed: seeds the RNG choosing the dimensions of
+                        events which do not specify them, drawn as the
+                        events are copied for the RT thread (see
+                        pattern_update_rt_data), and played with in
+                        every loop until copied anew. the RNG is
+                        reseeded by the next pattern_update_rt_data,
+                        and carries on across updates made without
+                        changing the seed. the seed defaults to the time
+                        the pattern was made.
+*/
+void        pattern_set_random_seed(        pattern*, uint32_t seed);
+
 void        pattern_dump(const pattern*);
 
 
+/*  the settings of a pattern (everything but its events and output
+    port), as kept by the journal so a replay can make the same pattern.
+    pattern_rtdata is what publishes the pattern to the RT thread.
+*/
+typedef struct event_pattern_state
+{
+    int32_t     loop_length;
+    float       beats_per_bar;
+    float       beat_type;
+    int32_t     width_min, width_max;
+    int32_t     height_min, height_max;
+    uint32_t    seed;
+
+} patstate;
+
+void        pattern_state_get(pattern*, patstate*);
+void        pattern_state_set(pattern*, const patstate*);
+
+rtdata*     pattern_rtdata(pattern*);
+evport*     pattern_output_port(pattern*);
+
+
+/*  pattern_update_rt_data: copies the pattern for the RT thread. only
+                        the beats of the event list changed since the
+                        last update are copied anew, the rest are
+                        shared with the previous copy. the event list
+                        must be kept in order of position.
+
+                        the dimensions drawn are copied along with the
+                        beat: a beat copied anew has them drawn again
+                        for all its events, not only those edited, while
+                        the beats shared keep theirs. changing the seed
+                        does not by itself copy anything anew.
+*/
 void        pattern_update_rt_data(const pattern*);
 
-void        pattern_rt_play(    pattern*,   bool repositioned,
-                                            bbt_t ph,
+void        pattern_rt_play(    pattern*,   bbt_t ph,
                                             bbt_t nph );
 
-void        pattern_rt_stop(    pattern* );
-
 void        pattern_set_output_port(pattern*, evport*);
 
 
@@ -113,6 +113,19 @@ pattern* pattern_manager_pattern_next(pattern_manager* patman)
 }
 
 
+pattern* pattern_manager_pattern_by_rtdata(pattern_manager* patman,
+                                                        rtdata* rt)
+{
+    lnode* ln = llist_head(patman->patlist);
+
+    for (; ln; ln = lnode_next(ln))
+        if (pattern_rtdata(lnode_data(ln)) == rt)
+            return lnode_data(ln);
+
+    return 0;
+}
+
+
 static void* pattern_manager_rtdata_get_cb(const void* data)
 {
     const pattern_manager* patman = data;
@@ -132,8 +145,13 @@ void pattern_manager_update_rt_data(const pattern_manager* patman)
 }
 
 
+rtdata* pattern_manager_rtdata(pattern_manager* patman)
+{
+    return patman->rt;
+}
+
+
 void pattern_manager_rt_play(   pattern_manager* patman,
-                                bool repositioned,
                                 bbt_t ph,
                                 bbt_t nph )
 {
@@ -143,5 +161,5 @@ void pattern_manager_rt_play(   pattern_manager* patman,
         return;
 
     while(*p)
-        pattern_rt_play(*p++, repositioned, ph, nph);
+        pattern_rt_play(*p++, ph, nph);
 }
@@ -25,10 +25,15 @@ void        pattern_manager_pattern_free(pattern_manager*, pattern*);
 pattern*    pattern_manager_pattern_first(pattern_manager*);
 pattern*    pattern_manager_pattern_next(pattern_manager*);
 
+/*  pattern_manager_pattern_by_rtdata: the pattern rt publishes, or NULL.
+                        does not disturb first/next.
+*/
+pattern*    pattern_manager_pattern_by_rtdata(pattern_manager*, rtdata*);
+
 void    pattern_manager_update_rt_data(const pattern_manager*);
+rtdata* pattern_manager_rtdata(pattern_manager*);
 
 void    pattern_manager_rt_play(    pattern_manager*,
-                                    bool repositioned,
                                     bbt_t ph,
                                     bbt_t nph );
 
@@ -5,9 +5,46 @@
 
 
 #include <glib.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 
+/* generations remembered as seen by the RT thread, a power of two */
+#define RTDATA_SEEN_SIZE    16
+
+/* rt_cycle while a reader is latching the data for the cycle */
+#define RTDATA_LATCHING     G_MININT
+
+
+/*  the data is published along with its generation, so the RT thread
+    reads a matching pair, and with the scene that commits it. until the
+    scene is committed the RT thread goes on using prev. once replaced,
+    it waits in the retired list for the RT thread to be done with it.
+*/
+typedef struct real_time_data_gen rtgen;
+
+struct real_time_data_gen
+{
+    void*       data;
+    unsigned    gen;
+    gint        scene;
+    rtgen*      prev;
+
+    /* retired */
+    datacb_free cb_free;
+    gint        cycle;
+    rtgen*      next;
+};
+
+
+typedef struct real_time_data_seen
+{
+    gint        gen;
+    gint        cycle;
+
+} rtseen;
+
+
 struct real_time_data
 {
     const void* data;
@@ -15,17 +52,99 @@ struct real_time_data
     datacb_rtdata   cb_rtdata_get;
     datacb_free     cb_rtdata_free;
 
-    void* ptr;
-    void* ptr_in_use;
-    void* ptr_old;
-    void* ptr_free;
+    unsigned    id;
+    unsigned    gen;
+
+    rtgen*      ptr;
+
+    /* UI only, updated in the scene open */
+    bool        pending;
+
+    /* RT only, written by the reader latching the data */
+    rtgen*      rt_ptr;
+    unsigned    rt_gen;
+    gint        rt_cycle;
+
+    /* written by the RT thread for the UI */
+    gint        seen_latest;
+    rtseen      seen[RTDATA_SEEN_SIZE];
 };
 
 
+/*  rtdata_cycle counts the cycles begun, rtdata_quiet the cycles ended.
+    they differ only while the RT thread is within a cycle.
+*/
+static gint rtdata_cycle = 0;
+static gint rtdata_quiet = 0;
+static gint rtdata_count = 0;
+
+/*  rtdata_scene counts the scenes committed, rtdata_rt_scene is the
+    scene the RT thread latched at the start of the cycle.
+*/
+static gint rtdata_scene = 0;
+static gint rtdata_rt_scene = 0;
+
+/* UI only */
+static rtgen* rtdata_retired = 0;
+
+static int      rtdata_scene_depth = 0;
+static rtdata** rtdata_pending = 0;
+static int      rtdata_pending_count = 0;
+static int      rtdata_pending_size = 0;
+
+static rtdata_published_cb  rtdata_published = 0;
+static void*                rtdata_published_arg = 0;
+
+
+static void rtgen_free(rtgen* rg)
+{
+    if (!rg)
+        return;
+
+    rg->cb_free(rg->data);
+    free(rg);
+}
+
+
+/*  frees the data retired before the last cycle the RT thread ended
+    (or retired while it was between cycles): nothing the RT thread
+    latched since can be retired data.
+*/
+static void rtdata_reclaim(void)
+{
+    gint quiet = g_atomic_int_get(&rtdata_quiet);
+    rtgen** rgp = &rtdata_retired;
+    rtgen* done = 0;
+
+    while (*rgp)
+    {
+        rtgen* rg = *rgp;
+
+        if ((gint)((guint)quiet - (guint)rg->cycle) >= 0)
+        {
+            *rgp = rg->next;
+            rg->next = done;
+            done = rg;
+        }
+        else
+            rgp = &rg->next;
+    }
+
+    /* freeing the data may free rtdata and reclaim in turn */
+    while (done)
+    {
+        rtgen* rg = done;
+        done = rg->next;
+        rtgen_free(rg);
+    }
+}
+
+
 rtdata* rtdata_new(const void* data,    datacb_rtdata cb_rtdata_get,
                                         datacb_free cb_rtdata_free   )
 {
     rtdata* rt = malloc(sizeof(*rt));
+    int i;
 
     if (!rt)
         goto fail0;
@@ -35,10 +154,20 @@ rtdata* rtdata_new(const void* data,    datacb_rtdata cb_rtdata_get,
     rt->cb_rtdata_get =  cb_rtdata_get;
     rt->cb_rtdata_free = cb_rtdata_free;
 
+    rt->id = g_atomic_int_add(&rtdata_count, 1);
+    rt->gen = 0;
+
     rt->ptr = 0;
-    rt->ptr_in_use = 0;
-    rt->ptr_old = 0;
-    rt->ptr_free = 0;
+    rt->pending = false;
+
+    rt->rt_ptr = 0;
+    rt->rt_gen = 0;
+    rt->rt_cycle = g_atomic_int_get(&rtdata_cycle) - 1;
+
+    rt->seen_latest = 0;
+
+    for (i = 0; i < RTDATA_SEEN_SIZE; ++i)
+        rt->seen[i].gen = rt->seen[i].cycle = -1;
 
     return rt;
 
@@ -50,73 +179,286 @@ fail0:
 
 void rtdata_free(rtdata* rt)
 {
+    int i;
+
     if (!rt)
         return;
 
-    rt->cb_rtdata_free(rt->ptr_free);
-    rt->cb_rtdata_free(rt->ptr_old);
-    rt->cb_rtdata_free(rt->ptr);
+    if (rt->pending)
+    {
+        for (i = 0; rtdata_pending[i] != rt; ++i)
+            ;
+        rtdata_pending[i] = rtdata_pending[--rtdata_pending_count];
+    }
 
+    rtgen_free(rt->ptr);
     free(rt);
+
+    rtdata_reclaim();
 }
 
 
-void* rtdata_update(rtdata* rt)
+void rtdata_update(rtdata* rt)
 {
-    void* ret_free = rt->ptr_free;
-    void* ptr_new = rt->cb_rtdata_get(rt->data);
+    if (rt->pending)
+        return;
 
-    #ifdef RTDATA_DEBUG
-    MESSAGE("rtdata data:%p\n", rt->data);
-    MESSAGE("ptr_new:%p\n", ptr_new);
-    #endif
+    if (rtdata_pending_count == rtdata_pending_size)
+    {
+        int size = rtdata_pending_size ? rtdata_pending_size * 2 : 64;
+        rtdata** pending = realloc(rtdata_pending,
+                                    sizeof(*pending) * size);
+        if (!pending)
+        {
+            WARNING("out of memory for rtdata update\n");
+            return;
+        }
+
+        rtdata_pending = pending;
+        rtdata_pending_size = size;
+    }
+
+    rtdata_pending[rtdata_pending_count++] = rt;
+    rt->pending = true;
+    ++rt->gen;
+
+    if (!rtdata_scene_depth)
+    {
+        rtdata_ui_scene_begin();
+        rtdata_ui_scene_commit();
+    }
+}
+
+
+void rtdata_ui_scene_begin(void)
+{
+    ++rtdata_scene_depth;
+}
+
+
+/*  makes the copy of rt for the scene, and publishes it: the RT thread
+    does not use it until the scene is committed.
+*/
+static bool rtdata_scene_copy(rtdata* rt, gint scene)
+{
+    rtgen* ptr_new = malloc(sizeof(*ptr_new));
 
     if (!ptr_new)
-        return 0;
+        goto fail0;
+
+    if (!(ptr_new->data = rt->cb_rtdata_get(rt->data)))
+        goto fail1;
 
     #ifdef RTDATA_DEBUG
-    MESSAGE("rt->ptr_free:%p rt->ptr_old:%p...\n",
-            rt->ptr_free, rt->ptr_old);
-    MESSAGE("Updating...\n");
+    MESSAGE("rtdata data:%p\n", rt->data);
+    MESSAGE("ptr_new:%p scene:%d\n", ptr_new->data, scene);
     #endif
 
-    rt->ptr_free =  rt->ptr_old;
-    rt->ptr_old =   g_atomic_pointer_get(&rt->ptr);
+    ptr_new->gen = rt->gen;
+    ptr_new->scene = scene;
+    ptr_new->prev = rt->ptr;
+    ptr_new->cb_free = rt->cb_rtdata_free;
+    ptr_new->next = 0;
+
+    g_atomic_pointer_set(&rt->ptr, ptr_new);
+
+    return true;
+
+fail1:  free(ptr_new);
+fail0:  WARNING("failed to update rtdata\n");
+    return false;
+}
 
-    #ifdef RTDATA_DEBUG
-    MESSAGE("rt->ptr_free:%p rt->ptr_old:%p\n",
-            rt->ptr_free, rt->ptr_old);
-    #endif
 
-    if (rt->ptr_free)
+bool rtdata_ui_scene_commit(void)
+{
+    gint scene = g_atomic_int_get(&rtdata_scene) + 1;
+    gint cycle;
+    bool ret = true;
+    int i;
+
+    if (!rtdata_scene_depth)
     {
-        struct timespec req = { .tv_sec = 0, .tv_nsec = 50000 };
-        struct timespec rem = { 0, 0 };
+        WARNING("no rtdata scene to commit\n");
+        return false;
+    }
+
+    if (--rtdata_scene_depth)
+        return true;
+
+    rtdata_reclaim();
 
-        if (g_atomic_pointer_get(&rt->ptr_in_use) == rt->ptr_free)
-            nanosleep(&req, &rem);
+    if (!rtdata_pending_count)
+        return true;
+
+    for (i = 0; i < rtdata_pending_count; ++i)
+        if (!rtdata_scene_copy(rtdata_pending[i], scene))
+            ret = false;
+
+    /* the whole scene becomes visible from the next cycle on */
+    g_atomic_int_set(&rtdata_scene, scene);
+
+    /*  any cycle beginning from now on latches the scene, so the copies
+        it replaces are free to go once the current one (if any) ends.
+    */
+    cycle = g_atomic_int_get(&rtdata_cycle);
+
+    for (i = 0; i < rtdata_pending_count; ++i)
+    {
+        rtdata* rt = rtdata_pending[i];
+        rtgen* ptr_old;
+
+        rt->pending = false;
+
+        if (!rt->ptr || rt->ptr->scene != scene)
+            continue;
+
+        if (rtdata_published)
+            rtdata_published(rt, rtdata_published_arg);
+
+        if (!(ptr_old = rt->ptr->prev))
+            continue;
+
+        ptr_old->cycle = cycle;
+        ptr_old->next = rtdata_retired;
+        rtdata_retired = ptr_old;
 
         #ifdef RTDATA_DEBUG
-        WARNING("rtdata free rt->ptr_free:%p\n", rt->ptr_free);
+        MESSAGE("retired:%p cycle:%d\n", ptr_old->data, ptr_old->cycle);
         #endif
-
-        rt->cb_rtdata_free(rt->ptr_free);
-        rt->ptr_free = 0; /* important to zero-out! */
     }
 
-    g_atomic_pointer_set(&rt->ptr, ptr_new);
+    rtdata_pending_count = 0;
+    rtdata_reclaim();
+
+    return ret;
+}
 
-    return ret_free;
+
+void rtdata_ui_set_published_cb(rtdata_published_cb cb, void* arg)
+{
+    rtdata_published = cb;
+    rtdata_published_arg = arg;
+}
+
+
+/*  the first reader in a cycle latches the data for the cycle. further
+    readers in the same cycle, on other threads, wait for it to be done.
+*/
+static void rtdata_rt_latch(rtdata* rt, gint cycle)
+{
+    gint scene = g_atomic_int_get(&rtdata_rt_scene);
+    rtgen* ptr_new = g_atomic_pointer_get(&rt->ptr);
+
+    /* prev is only retired once the scene of ptr_new is committed */
+    while (ptr_new && (gint)((guint)ptr_new->scene - (guint)scene) > 0)
+        ptr_new = ptr_new->prev;
+
+    if (ptr_new && ptr_new->gen != rt->rt_gen)
+    {
+        rtseen* seen = &rt->seen[ptr_new->gen & (RTDATA_SEEN_SIZE - 1)];
+
+        g_atomic_int_set(&seen->gen, -1);
+        g_atomic_int_set(&seen->cycle, cycle);
+        g_atomic_int_set(&seen->gen, ptr_new->gen);
+        g_atomic_int_set(&rt->seen_latest, ptr_new->gen);
+
+        rt->rt_gen = ptr_new->gen;
+    }
+
+    rt->rt_ptr = ptr_new;
+    g_atomic_int_set(&rt->rt_cycle, cycle);
 }
 
 
 void* rtdata_data(rtdata* rt)
 {
-    void* ptr_new = g_atomic_pointer_get(&rt->ptr);
+    gint cycle = g_atomic_int_get(&rtdata_cycle);
+    gint latched;
 
-    g_atomic_pointer_compare_and_exchange( &rt->ptr_in_use,
-                                            rt->ptr_old,
-                                            ptr_new         );
-    return ptr_new;
+    while ((latched = g_atomic_int_get(&rt->rt_cycle)) != cycle)
+    {
+        if (latched != RTDATA_LATCHING
+         && g_atomic_int_compare_and_exchange(&rt->rt_cycle, latched,
+                                                    RTDATA_LATCHING))
+        {
+            rtdata_rt_latch(rt, cycle);
+            break;
+        }
+    }
+
+    return rt->rt_ptr ? rt->rt_ptr->data : 0;
 }
 
+
+void rtdata_rt_cycle_begin(void)
+{
+    if (g_atomic_int_add(&rtdata_cycle, 1) + 1 == RTDATA_LATCHING)
+        g_atomic_int_inc(&rtdata_cycle);
+
+    g_atomic_int_set(&rtdata_rt_scene, g_atomic_int_get(&rtdata_scene));
+}
+
+
+void rtdata_rt_cycle_end(void)
+{
+    g_atomic_int_set(&rtdata_quiet, g_atomic_int_get(&rtdata_cycle));
+}
+
+
+void rtdata_ui_reclaim(void)
+{
+    rtdata_reclaim();
+}
+
+
+unsigned rtdata_rt_cycle(void)
+{
+    return g_atomic_int_get(&rtdata_cycle);
+}
+
+
+unsigned rtdata_id(const rtdata* rt)
+{
+    return rt->id;
+}
+
+
+unsigned rtdata_gen(const rtdata* rt)
+{
+    return rt->gen;
+}
+
+
+int rtdata_ui_seen(rtdata* rt, unsigned gen, unsigned* cycle)
+{
+    unsigned latest = g_atomic_int_get(&rt->seen_latest);
+    unsigned g;
+
+    if ((int)(latest - gen) < 0)
+        return 0;
+
+    if (latest - gen >= RTDATA_SEEN_SIZE)
+        return -1;
+
+    /* the first generation from gen on that the RT thread used */
+    for (g = gen; (int)(latest - g) >= 0; ++g)
+    {
+        rtseen* seen = &rt->seen[g & (RTDATA_SEEN_SIZE - 1)];
+        unsigned c;
+
+        if ((unsigned)g_atomic_int_get(&seen->gen) != g)
+            continue;
+
+        c = g_atomic_int_get(&seen->cycle);
+
+        /* the RT thread invalidates the gen before rewriting the cycle */
+        if ((unsigned)g_atomic_int_get(&seen->gen) != g)
+            return 0;
+
+        *cycle = c;
+        return 1;
+    }
+
+    return 0;
+}
@@ -10,22 +10,29 @@ extern "C" {
 #include "datacb.h"
 
 
+#include <stdbool.h>
+
+
 typedef struct real_time_data rtdata;
 
 
-/*  this is a very primitive update mechanism... the datacb_rtdata
-    callback is used to provide a copy of the data for RT use. whether
-    the RT data is a plain duplicate or is a modified version is of no
-    importance here. the datacb_free callback is used to free this data.
+/*  the datacb_rtdata callback is used to provide a copy of the data for
+    RT use. whether the RT data is a plain duplicate or is a modified
+    version is of no importance here. the datacb_free callback is used
+    to free this data.
 
-    the update uses GLIB atomic functions - g_atomic_pointer_get,
-    g_atomic_pointer_set, and g_atomic_pointer_compare_and_exchange.
+    rtdata_update publishes a new copy and retires the one it replaces.
+    the RT side marks the bounds of each JACK period with
+    rtdata_rt_cycle_begin and rtdata_rt_cycle_end, and only reads data
+    in between: outside a period it holds nothing, and a copy retired
+    is freed once the period in progress (if any) has ended. nothing
+    sleeps or waits on the UI side, however quickly updates come, and
+    any number of threads working within the period may read the data.
 
-    in this early stage, this mechanism is only filled-out enough to
-    provide the update mechanism - it has the potential to offer full(?)
-    UNDO functionality, but here, were the UNDO functionality actually
-    implemented (it wouldn't take much), it would only offer one level of
-    UNDO.
+    rtdata_update, rtdata_free, rtdata_ui_reclaim and the scene
+    functions are for a single non-RT thread. a copy retired while the
+    RT thread is within a period is freed by the next of these calls
+    after it ends, so the UI should call rtdata_ui_reclaim regularly.
 */
 
 
@@ -33,7 +40,57 @@ rtdata*     rtdata_new(const void*, datacb_rtdata, datacb_free);
 void        rtdata_free(rtdata*);
 
 void*       rtdata_data(rtdata*);
-void*       rtdata_update(rtdata*);
+void        rtdata_update(rtdata*);
+void        rtdata_ui_reclaim(void);
+
+
+/*  scenes
+ *----------
+ *  rtdata_update outside a scene publishes the copy at once. within a
+ *  scene, opened by rtdata_ui_scene_begin, it only marks the rtdata as
+ *  changed, and rtdata_ui_scene_commit makes one copy of each rtdata
+ *  changed, however many times, and publishes them all together: the
+ *  RT thread sees either none or all of them, from the start of a
+ *  period on. scenes nest, the outermost commit publishes.
+ *
+ *  rtdata_ui_scene_commit returns false if any copy could not be made,
+ *  the others are published regardless.
+ */
+void        rtdata_ui_scene_begin(void);
+bool        rtdata_ui_scene_commit(void);
+
+
+/*  rtdata_ui_set_published_cb: has cb called, with arg, for each rtdata
+                        the commit of a scene publishes, once the scene
+                        is visible to the RT thread. for a journal to
+                        record every change. NULL for none.
+*/
+typedef void (*rtdata_published_cb)(rtdata*, void* arg);
+
+void        rtdata_ui_set_published_cb(rtdata_published_cb cb, void* arg);
+
+
+/*  generations and cycles
+ *--------------------------
+ *  within a period rtdata_data returns the same data however many
+ *  times, and from however many threads, it is called: the data current
+ *  when it was first called in that period, so an update made
+ *  mid-period is only seen from the next.
+ *
+ *  each copy published is a new generation of the data. rtdata_id
+ *  numbers the rtdata in order of creation. rtdata_ui_seen finds the
+ *  period in which the RT thread first used the generation gen (or a
+ *  later one, if gen was replaced before being used): it returns 1 and
+ *  sets *cycle, or 0 if not yet used, or -1 when the RT thread has
+ *  moved on too many generations since to tell.
+ */
+void        rtdata_rt_cycle_begin(void);
+void        rtdata_rt_cycle_end(void);
+unsigned    rtdata_rt_cycle(void);
+
+unsigned    rtdata_id(const rtdata*);
+unsigned    rtdata_gen(const rtdata*);
+int         rtdata_ui_seen(rtdata*, unsigned gen, unsigned* cycle);
 
 
 #ifdef __cplusplus
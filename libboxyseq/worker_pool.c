@@ -0,0 +1,174 @@
+#include "worker_pool.h"
+
+
+#include "debug.h"
+
+
+#include <glib.h>
+#include <jack/thread.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+
+
+struct worker_pool
+{
+    int         threads;
+    pthread_t*  thread;
+
+    sem_t       start;      /* posted once for each thread woken */
+    sem_t       done;       /* posted by each thread woken when done */
+
+    gint        quit;
+
+    /* the jobs of the current wkpool_rt_run */
+    wkpool_job_cb   cb;
+    void*           arg;
+    int             jobs;
+    gint            next;
+};
+
+
+static void wkpool_work(wkpool* wkp)
+{
+    int job;
+
+    while ((job = g_atomic_int_add(&wkp->next, 1)) < wkp->jobs)
+        wkp->cb(wkp->arg, job);
+}
+
+
+static void* wkpool_thread(void* arg)
+{
+    wkpool* wkp = arg;
+
+    debug_rt_thread(1);
+
+    for (;;)
+    {
+        while (sem_wait(&wkp->start) != 0)
+            /* interrupted */;
+
+        if (g_atomic_int_get(&wkp->quit))
+            break;
+
+        wkpool_work(wkp);
+        sem_post(&wkp->done);
+    }
+
+    return 0;
+}
+
+
+wkpool* wkpool_new(jack_client_t* client, int threads)
+{
+    wkpool* wkp = malloc(sizeof(*wkp));
+
+    if (!wkp)
+        goto fail0;
+
+    if (threads < 0)
+        threads = 0;
+
+    wkp->threads = 0;
+    wkp->quit = 0;
+    wkp->cb = 0;
+    wkp->arg = 0;
+    wkp->jobs = 0;
+    wkp->next = 0;
+
+    if (!(wkp->thread = malloc(sizeof(*wkp->thread) * (threads + 1))))
+        goto fail1;
+
+    if (sem_init(&wkp->start, 0, 0))
+        goto fail2;
+
+    if (sem_init(&wkp->done, 0, 0))
+        goto fail3;
+
+    while (wkp->threads < threads)
+    {
+        pthread_t* thread = &wkp->thread[wkp->threads];
+        int err;
+
+        #ifndef NO_REAL_TIME
+        if (client)
+            err = jack_client_create_thread(client, thread,
+                                    jack_client_real_time_priority(client),
+                                    jack_is_realtime(client),
+                                    wkpool_thread, wkp);
+        else
+        #endif
+            err = pthread_create(thread, 0, wkpool_thread, wkp);
+
+        if (err)
+        {
+            WARNING("created only %d of %d worker threads\n",
+                    wkp->threads, threads);
+            break;
+        }
+
+        ++wkp->threads;
+    }
+
+    return wkp;
+
+fail3:  sem_destroy(&wkp->start);
+fail2:  free(wkp->thread);
+fail1:  free(wkp);
+fail0:  WARNING("failed to create worker pool\n");
+    return 0;
+}
+
+
+void wkpool_free(wkpool* wkp)
+{
+    int i;
+
+    if (!wkp)
+        return;
+
+    g_atomic_int_set(&wkp->quit, 1);
+
+    for (i = 0; i < wkp->threads; ++i)
+        sem_post(&wkp->start);
+
+    for (i = 0; i < wkp->threads; ++i)
+        pthread_join(wkp->thread[i], 0);
+
+    sem_destroy(&wkp->done);
+    sem_destroy(&wkp->start);
+    free(wkp->thread);
+    free(wkp);
+}
+
+
+int wkpool_threads(wkpool* wkp)
+{
+    return wkp->threads;
+}
+
+
+void wkpool_rt_run(wkpool* wkp, wkpool_job_cb cb, void* arg, int jobs)
+{
+    int i, wake = jobs - 1;
+
+    if (wake > wkp->threads)
+        wake = wkp->threads;
+
+    wkp->cb = cb;
+    wkp->arg = arg;
+    wkp->jobs = jobs;
+    g_atomic_int_set(&wkp->next, 0);
+
+    /* sem_post publishes the jobs to the threads woken */
+    for (i = 0; i < wake; ++i)
+        sem_post(&wkp->start);
+
+    wkpool_work(wkp);
+
+    /* and sem_wait publishes the work done back to the caller */
+    for (i = 0; i < wake; ++i)
+        while (sem_wait(&wkp->done) != 0)
+            /* interrupted */;
+}
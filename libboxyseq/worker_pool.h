@@ -0,0 +1,51 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+#include <jack/jack.h>
+
+
+/*  worker pool
+ *---------------
+ *  a fixed set of threads for the RT thread to share work out amongst
+ *  within a JACK period. the threads are created with the same real
+ *  time priority as the JACK process thread (by jack_client_create_thread)
+ *  or, without a JACK client (ie when rendering offline), as plain
+ *  threads.
+ *
+ *  wkpool_rt_run calls the job callback once for each of jobs jobs, on
+ *  the caller and as many of the threads as there are jobs for, and
+ *  returns once every job is done. the jobs are claimed one at a time
+ *  so a slow job does not hold up the others. with one job, or no
+ *  threads, the jobs are run by the caller alone without waking any
+ *  thread.
+ *
+ *  wkpool_rt_run is for a single (the RT) thread only. nothing the jobs
+ *  share may be written by them without being made safe to.
+ */
+
+
+typedef struct worker_pool wkpool;
+
+typedef void (*wkpool_job_cb)(void* arg, int job);
+
+
+wkpool*     wkpool_new(jack_client_t* client, int threads);
+void        wkpool_free(wkpool*);
+
+int         wkpool_threads(wkpool*);
+
+void        wkpool_rt_run(wkpool*, wkpool_job_cb, void* arg, int jobs);
+
+
+#ifdef __cplusplus
+} /* closing brace for extern "C" */
+#endif
+
+
+#endif